@@ -2,17 +2,40 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "miniaudio.h"
 #include "DualOutEngine.h"
+#include "SpscQueue.h"
+#include "Fft.h"
+#include "OnsetTracker.h"
+#include "GlitchDetector.h"
+#include "Limiter.h"
+#include "dualout_telemetry.h"
 #include <mutex>
 #include <atomic>
 #include <thread>
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
 #include <chrono>
 #include <string>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <ctime>
+#include <unistd.h>
+#endif
 #include <cmath>
 #include <algorithm>
+#include <vector>
+#include <functional>
+#include <cwchar>
+#include <fstream>
+#include <filesystem>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DUALOUT_ENGINE_SSE 1
+#endif
 // маленький helper для конвертации std::wstring -> UTF-8
+#ifdef _WIN32
 static std::string utf8_from_wide(const std::wstring& ws){
     if(ws.empty()) return {};
     int n = WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), nullptr, 0, nullptr, nullptr);
@@ -22,6 +45,37 @@ static std::string utf8_from_wide(const std::wstring& ws){
     return s;
 }
 
+static unsigned long process_id(){ return GetCurrentProcessId(); }
+#else
+// wchar_t здесь — UTF-32
+static std::string utf8_from_wide(const std::wstring& ws){
+    std::string s;
+    s.reserve(ws.size());
+    for (wchar_t wc : ws) {
+        uint32_t c = (uint32_t)wc;
+        if (c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = 0xFFFD;
+        if (c < 0x80) {
+            s += (char)c;
+        } else if (c < 0x800) {
+            s += (char)(0xC0 | (c >> 6));
+            s += (char)(0x80 | (c & 0x3F));
+        } else if (c < 0x10000) {
+            s += (char)(0xE0 | (c >> 12));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        } else {
+            s += (char)(0xF0 | (c >> 18));
+            s += (char)(0x80 | ((c >> 12) & 0x3F));
+            s += (char)(0x80 | ((c >> 6) & 0x3F));
+            s += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return s;
+}
+
+static unsigned long process_id(){ return (unsigned long)getpid(); }
+#endif
+
 #define MA_CHECK(expr) \
     do { \
         if(!(expr)) { \
@@ -35,6 +89,159 @@ static std::string utf8_from_wide(const std::wstring& ws){
         } \
     } while(0)
 
+// НОВОЕ: состояние splice на стороне колбэка (своё у каждого устройства)
+struct DevSplice {
+    std::atomic_bool pending{false};   // продюсер выставил, колбэк подхватывает
+    std::atomic_bool cancel{false};    // flush(): бросить недоигранный splice
+    std::atomic<int64_t> ackNs{0};     // когда колбэк переключился на новый кусок
+    const int16_t* src = nullptr;      // текущий splice-буфер (только колбэк)
+    uint32_t srcPos    = 0;
+    uint32_t srcFrames = 0;
+    std::vector<int16_t> fadeOut;      // хвост старого аудио для кроссфейда
+    uint32_t xfadeLen  = 0;
+    uint32_t xfadeDone = 0;
+};
+
+// НОВОЕ: медиа-часы устройства. Продюсер кладёт метки (позиция в ринге ->
+// медиа-кадр) только на разрывах; колбэк по ним ведёт позицию того, что звучит.
+struct MediaStamp { uint64_t pos; int64_t media; };
+
+struct DevClock {
+    std::atomic<uint64_t> writePos{0};   // кадров положено в ринг (продюсер)
+    std::atomic<uint64_t> readPos{0};    // кадров взято/выброшено из ринга (колбэк)
+    std::atomic<int64_t>  mediaPos{0};   // медиа-кадр следующего кадра на выход
+    std::atomic_bool flushReq{false};    // flush(): колбэк сам выбрасывает очередь
+    std::atomic<uint32_t> queued{0};     // колбэк: ринг + остаток splice — для второго устройства
+    int64_t nextMedia = -1;              // продюсер: где должен начаться следующий write
+    SpscQueue<MediaStamp, 256> stamps;
+};
+
+// НОВОЕ: параметры выхода. Команды идут в колбэк через SPSC-очередь,
+// колбэк ведёт рампы сам — никаких общих float между потоками.
+enum class ParamKind : uint8_t { Gain, Swap, Delay };
+
+struct ParamCmd {
+    ParamKind kind  = ParamKind::Gain;
+    float    value  = 1.0f;    // Gain: линейный (с master), Swap: 0/1
+    int32_t  delayFrames = 0;
+    uint32_t rampFrames  = 0;
+    int64_t  atMedia     = -1; // -1 — сразу
+};
+
+static constexpr uint32_t kMaxPendingParams = 16;
+static constexpr uint32_t kMinDuckFrames    = 48;   // 1 мс: сдвиг задержки без щелчка
+
+struct DevParams {
+    SpscQueue<ParamCmd, 64> queue;
+    // дальше — только колбэк
+    ParamCmd pending[kMaxPendingParams];
+    uint32_t pendingCount = 0;
+    float gain = 1.0f, gainTarget = 1.0f, gainStep = 0.0f; uint32_t gainLeft = 0;
+    float swap = 0.0f, swapTarget = 0.0f, swapStep = 0.0f; uint32_t swapLeft = 0;
+    float duck = 1.0f, duckTarget = 1.0f, duckStep = 0.0f; uint32_t duckLeft = 0;
+    int32_t  delayCur = 0, delayTarget = 0;
+    uint32_t delayRamp = kMinDuckFrames;
+    bool     delayShiftReady = false;
+    uint32_t holdFrames = 0;   // сколько тишины ещё вставить перед данными
+    // выходной каскад во float: громкость/swap -> лимитер -> s16 с насыщением
+    Limiter  lim;
+    std::vector<float> fbuf;   // Limiter::kMaxBlock кадров, выделяется в init
+    uint32_t silentFrames = 0; // подряд нулевых кадров на входе каскада
+};
+
+// НОВОЕ: простой. Тишина дольше kIdleSettleSec — колбэк только отдаёт нули
+// (без метров и тапа); setIdleSuspendMs — потом ещё и устройства стоят.
+static constexpr float kIdleSettleSec = 1.0f;
+
+// НОВОЕ: метры одного устройства. Баллистика считается в колбэке по блоку,
+// наружу отдаются уже готовые значения (атомики, читаются без блокировок).
+static constexpr float kVuTauSec        = 0.300f;  // интеграция VU
+static constexpr float kPpmFallDbPerSec = 20.0f / 1.7f;
+static constexpr float kPeakHoldSec     = 1.5f;
+
+struct DevMeter {
+    // только колбэк
+    float ms[kDualOutMeterMaxCh]{};       // сглаженный средний квадрат
+    float ppm[kDualOutMeterMaxCh]{};
+    float hold[kDualOutMeterMaxCh]{};
+    float holdAge[kDualOutMeterMaxCh]{};
+    float cbUsAcc = 0.0f, tapUsAcc = 0.0f;
+    // под busy: считает либо колбэк (тап выключен), либо поток анализа
+    float meterUsAcc = 0.0f;
+    std::atomic_bool busy{false};
+    // наружу
+    std::atomic<uint32_t> channels{0};
+    std::atomic<float>    outRms[kDualOutMeterMaxCh]{};
+    std::atomic<float>    outPeak[kDualOutMeterMaxCh]{};
+    std::atomic<float>    outHold[kDualOutMeterMaxCh]{};
+    std::atomic<uint32_t> clips[kDualOutMeterMaxCh]{};
+    std::atomic<float>    cbUsAvg{0.0f}, cbUsMax{0.0f}, meterUsAvg{0.0f}, periodUs{0.0f};
+    std::atomic<float>    tapUsAvg{0.0f};
+    std::atomic<uint32_t> tapDrops{0};
+    std::atomic_bool      resetReq{false};
+    std::atomic<float>    limGrDb{0.0f}, limGrMaxDb{0.0f};   // ослабление лимитера, дБ (<= 0)
+    // простой: колбэк пишет, читают управление и поток анализа
+    std::atomic_bool      idle{false};
+    std::atomic<int64_t>  idleSinceNs{0};
+    std::atomic_bool      clearReq{false};     // после простоя баллистика метров с нуля
+    std::atomic<uint64_t> wakeups{0}, idleWakeups{0};
+    std::atomic<uint64_t> savedNs{0};
+    float activeUsAcc = 0.0f;                  // только колбэк: цена колбэка с обработкой
+    std::atomic<float> activeUsAvg{0.0f};
+};
+
+// НОВОЕ: анализ-тап. Колбэк кладёт готовый выход (после gain/swap) в
+// SPSC-очередь своего устройства, фоновый поток считает по нему метры
+// и прочий анализ. Очередь полна — блок выбрасываем, колбэк не ждёт.
+static constexpr uint32_t kTapBlockFrames = 1024;
+
+struct TapBlock {
+    uint32_t frames = 0;
+    uint32_t ch     = 0;      // каналы упакованы плотно, до kDualOutMeterMaxCh
+    int64_t  media  = 0;      // медиа-кадр первого сэмпла
+    int64_t  tNs    = 0;      // steady_clock, когда блок ушёл на устройство
+    uint32_t gen    = 0;      // поколение очереди (flush/seek его меняют)
+    uint32_t pad    = 0;      // кадров недобора в конце блока (underrun)
+    uint32_t drops  = 0;      // счётчик выброшенных блоков на момент записи
+    bool     quiet  = false;  // тишина намеренная (буферизация, плеер не кормит)
+    int16_t  pcm[kTapBlockFrames * kDualOutMeterMaxCh];
+};
+using TapQueue = SpscQueue<TapBlock, 32>;   // ~680 мс на 48 кГц
+
+// НОВОЕ: спектр для UI — лог-полосы по выходу A, 60 кадров на секунду
+// звучащего аудио. Всё считается в потоке анализа, наружу — под мьютексом.
+static constexpr uint32_t kSpecFftSize = 2048;
+static constexpr float    kSpecLoHz    = 30.0f;
+static constexpr float    kSpecHiHz    = 16000.0f;
+static constexpr uint32_t kSpecRateHz  = 60;
+
+struct SpecState {
+    Fft fft{kSpecFftSize};
+    std::vector<float> window, hist, re, im;
+    uint32_t histPos = 0, hop = 800, sinceHop = 0;
+    uint32_t binLo[kDualOutSpectrumBands]{}, binHi[kDualOutSpectrumBands]{};
+    float    usAcc = 0.0f;
+    std::mutex mtx;
+    DualOutSpectrum out{};
+};
+
+// НОВОЕ: детектор артефактов одного устройства — считает поток анализа
+static constexpr uint32_t kGlitchRing     = 256;
+static constexpr uint64_t kGlitchLogBytes = 1u << 20;   // потом path -> path.1
+
+static_assert((int)GlitchDetector::Discontinuity == (int)DUALOUT_GLITCH_DISCONTINUITY &&
+              (int)GlitchDetector::Gap == (int)DUALOUT_GLITCH_GAP &&
+              (int)GlitchDetector::ClipBurst == (int)DUALOUT_GLITCH_CLIP_BURST &&
+              (int)GlitchDetector::Underrun == (int)DUALOUT_GLITCH_UNDERRUN, "glitch kinds out of sync");
+
+struct GlitchState {
+    GlitchDetector det;
+    uint32_t dropsSeen = 0;
+    float    usAcc = 0.0f;
+    std::atomic<uint32_t> count[GlitchDetector::KindCount]{};
+    std::atomic<float>    usAvg{0.0f};
+};
+
 struct DualOutEngineImpl {
 
     ma_context ctx{};
@@ -47,27 +254,435 @@ struct DualOutEngineImpl {
     ma_uint32 rbCapacityFrames=0;
     std::chrono::steady_clock::time_point lastStats{};
     uint64_t framesSubmitted{0};
+    std::atomic<uint64_t> ringBytesIn{0};   // НОВОЕ: копии write()/writev() в кольца
     uint64_t dropA{0};
     uint64_t dropB{0};
     std::atomic_bool loggedCallbackA{false};
     std::atomic_bool loggedCallbackB{false};
-    std::atomic_bool swapLR{false};
 
-    // НОВОЕ: коэффициенты громкости
+    // НОВОЕ: коэффициенты громкости — только на стороне управления,
+    // в колбэк уходят командами (prmA/prmB)
     float gainA      = 1.0f;
     float gainB      = 1.0f;
     float masterGain = 1.0f;
-
-    // НОВОЕ: последние измеренные уровни (0..1)
-    std::atomic<float> lastRmsL{0.0f};
-    std::atomic<float> lastRmsR{0.0f};
-    std::atomic<float> lastPeakL{0.0f};
-    std::atomic<float> lastPeakR{0.0f};
+    float trimGain   = 1.0f;                // нормализация громкости (setTrimDb)
+    DevParams prmA, prmB;
+    DevClock  clkA, clkB;
+    // НОВОЕ: переход между элементами на ленте (markTransition): [from, to) по writePos
+    std::atomic<uint64_t> transFromA{0}, transToA{0}, transFromB{0}, transToB{0};
+    std::mutex paramMtx;                    // несколько управляющих потоков -> один писатель очереди
+    std::atomic<uint32_t> paramRampFrames{960};
+    std::atomic_bool  limiterOn{true};
+    // НОВОЕ: остановка устройств на простое (write()/splice() запускают снова)
+    std::atomic<int>  idleSuspendMs{0};
+    std::atomic_bool  suspended{false};
+    std::mutex        suspendMtx;
+    int64_t           suspendStartNs = 0;      // под suspendMtx
+    std::atomic<uint32_t> suspends{0}, resumes{0};
+    std::atomic<int>      lastResumeMs{0};
+    std::atomic<uint64_t> wakeupsAvoided{0}, suspendSavedNs{0};
+    std::atomic<float> limiterCeil{0.891251f * 32768.0f};   // -1 dBTP в шкале s16
+
+    // НОВОЕ: метры по обоим устройствам и всем каналам
+    DevMeter mtA, mtB;
+    TapQueue tapA, tapB;
+    SpecState spec;
+
+    // НОВОЕ: атаки/темп — по записанному (ещё не сыгранному) аудио, чтобы
+    // событие приходило заранее с оценкой, когда атака прозвучит на A
+    SpscQueue<TapBlock, 64> onsetQ;           // писатель — write()/splice()
+    std::atomic<uint32_t> onsetDrops{0};
+    std::atomic<uint32_t> onsetGen{0};        // flush/splice: старые блоки не анализируем
+    uint32_t onsetGenSeen = 0;                // только поток анализа
+    OnsetTracker onset;                       // только поток анализа
+    std::vector<float> onsetMono;
+    std::vector<OnsetTracker::Onset> onsetOut;
+    std::atomic<float> tempoBpm{0.0f}, tempoConf{0.0f};
+    std::atomic<uint64_t> onsetCount{0};
+    std::atomic<int> extraLatencyMs{0};
+    std::mutex onsetMtx;
+    std::function<void(const DualOutOnset&)> onsetSink;
+
+    // НОВОЕ: артефакты выхода. Кольцо событий и лог — под glitchMtx
+    GlitchState glitchA, glitchB;
+    std::atomic_bool glitchOn{false};
+    std::atomic_bool glitchResetReq{true};
+    std::vector<GlitchDetector::Event> glitchOut;   // только поток анализа
+    mutable std::mutex glitchMtx;
+    DualOutGlitch glitchRing[kGlitchRing]{};
+    uint64_t glitchSeq = 0;
+    std::wstring glitchLogPath;
+    std::ofstream glitchLog;
+    uint64_t glitchLogSize = 0;
+
+    // НОВОЕ: телеметрия в общей памяти (пишет только поток анализа / stop)
+#ifdef _WIN32
+    HANDLE tmMap = nullptr;
+#endif
+    dualout_telemetry* tm = nullptr;
+    std::wstring tmName;
+    int64_t tmLastNs = 0;
+    std::atomic<int> playerState{DUALOUT_TM_STOPPED};
+    std::atomic_bool tapOn{true};
+    std::atomic_bool analysisRun{false};
+    std::thread analysisThr;
+
+    // НОВОЕ: splice (seek с кроссфейдом). Два буфера по очереди: пока
+    // продюсер заполняет один, колбэки могут ещё доигрывать другой.
+    std::vector<int16_t> spliceBuf[2];
+    uint32_t spliceCapFrames   = 0;
+    uint32_t spliceMaxXfade    = 0;
+    uint32_t spliceIdx         = 0;
+    uint32_t spliceFrames      = 0;
+    uint32_t spliceXfadeFrames = 0;
+    int64_t  spliceMedia       = 0;
+    DevSplice spA, spB;
+
+    // НОВОЕ: EOS — колбэк отмечает, что очередь опустела после маркера
+    std::atomic_bool eosArmed{false};
+    std::atomic_bool eosDoneA{false};
+    std::atomic_bool eosDoneB{false};
+    std::atomic_bool eosReached{false};
+
+    // НОВОЕ: watermarks / буферизация
+    std::atomic<uint32_t> lowWaterFrames{0};
+    std::atomic<uint32_t> highWaterFrames{0};
+    std::atomic_bool watermarksArmed{false};
+    std::atomic_bool buffering{false};
+    std::atomic<int64_t> stallStartNs{0};
+    std::atomic<uint32_t> stalls{0};
+    std::atomic<int> lastStallMs{0};
+    std::atomic<int64_t> totalStallMs{0};
+    bool bufMutedA = false, bufMutedB = false;      // только колбэк
+    uint32_t bufFadeInA = 0, bufFadeInB = 0;        // сколько кадров fade-in осталось
 } g;
 
+// короткие рампы на входе/выходе из буферизации — без щелчков
+static constexpr uint32_t kBufferingRampFrames = 240;
 
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-static void dev_callback(ma_device* d, void* out, const void*, ma_uint32 frameCount)
+// Забрать до frames кадров из ринга; вернёт сколько реально прочитано
+static ma_uint32 rb_read_frames(ma_pcm_rb* rb, DevClock& clk, uint8_t* dst, ma_uint32 frames, ma_uint32 bpf)
+{
+    ma_uint32 totalRead = 0;
+    while (totalRead < frames) {
+        void* p = nullptr;
+        ma_uint32 capFrames = frames - totalRead;
+        if (ma_pcm_rb_acquire_read(rb, &capFrames, &p) != MA_SUCCESS || capFrames == 0) {
+            break;
+        }
+        std::memcpy(dst + totalRead * bpf, p, capFrames * bpf);
+        ma_pcm_rb_commit_read(rb, capFrames);
+        totalRead += capFrames;
+    }
+    clk.readPos.fetch_add(totalRead, std::memory_order_relaxed);
+    return totalRead;
+}
+
+// Выбросить всё, что лежит в ринге (позиция чтения сдвигается вместе с ним)
+static void rb_discard_all(ma_pcm_rb* rb, DevClock& clk)
+{
+    const ma_uint32 stale = ma_pcm_rb_available_read(rb);
+    if (stale) {
+        ma_pcm_rb_seek_read(rb, stale);
+        clk.readPos.fetch_add(stale, std::memory_order_relaxed);
+    }
+}
+
+// Метки медиа-часов, до которых дошло чтение. Пока играет splice-буфер,
+// ринг ещё не звучит — его метки не трогаем.
+static void apply_media_stamps(DevClock& clk, const DevSplice& sp)
+{
+    if (sp.src && sp.srcPos < sp.srcFrames) return;
+    const uint64_t rp = clk.readPos.load(std::memory_order_relaxed);
+    while (const MediaStamp* st = clk.stamps.peek()) {
+        if (st->pos > rp) break;
+        clk.mediaPos.store(st->media + (int64_t)(rp - st->pos), std::memory_order_relaxed);
+        MediaStamp done;
+        clk.stamps.pop(done);
+    }
+}
+
+// Сначала доигрываем активный splice-буфер, потом читаем ринг
+static ma_uint32 pull_frames(DevSplice& sp, DevClock& clk, ma_pcm_rb* rb, uint8_t* dst, ma_uint32 frames, ma_uint32 bpf)
+{
+    ma_uint32 got = 0;
+    if (sp.src && sp.srcPos < sp.srcFrames) {
+        got = ma_min(frames, sp.srcFrames - sp.srcPos);
+        std::memcpy(dst, sp.src + (size_t)sp.srcPos * g.ch, got * bpf);
+        sp.srcPos += got;
+    }
+    if (got < frames) {
+        got += rb_read_frames(rb, clk, dst + got * bpf, frames - got, bpf);
+    }
+    clk.mediaPos.fetch_add(got, std::memory_order_relaxed);
+    return got;
+}
+
+// Колбэк подхватывает новый splice: хвост старого — в fadeOut, остальное выкидываем
+static void take_splice(DevSplice& sp, DevClock& clk, ma_pcm_rb* rb, ma_uint32 bpf)
+{
+    const uint32_t xfade = g.spliceXfadeFrames;
+    ma_uint32 got = pull_frames(sp, clk, rb, reinterpret_cast<uint8_t*>(sp.fadeOut.data()), xfade, bpf);
+    if (got < xfade) {
+        std::memset(sp.fadeOut.data() + (size_t)got * g.ch, 0, (xfade - got) * bpf);
+    }
+
+    // всё в ринге — старое аудио (продюсер ждёт подтверждения и не пишет)
+    rb_discard_all(rb, clk);
+    clk.stamps.clear();
+    clk.mediaPos.store(g.spliceMedia, std::memory_order_relaxed);
+
+    sp.src       = g.spliceBuf[g.spliceIdx].data();
+    sp.srcPos    = 0;
+    sp.srcFrames = g.spliceFrames;
+    sp.xfadeLen  = xfade;
+    sp.xfadeDone = 0;
+    sp.ackNs.store(steady_now_ns(), std::memory_order_relaxed);
+    sp.pending.store(false, std::memory_order_release);
+}
+
+// Equal-power кроссфейд: старое (fadeOut) гаснет, новое в out нарастает
+static void apply_splice_xfade(DevSplice& sp, int16_t* out, ma_uint32 frames)
+{
+    const uint32_t ch = g.ch;
+    const float halfPi = 1.57079632679f;
+    for (ma_uint32 i = 0; i < frames && sp.xfadeDone < sp.xfadeLen; ++i, ++sp.xfadeDone) {
+        const float t    = ((float)sp.xfadeDone + 0.5f) / (float)sp.xfadeLen;
+        const float gIn  = std::sin(t * halfPi);
+        const float gOut = std::cos(t * halfPi);
+        const int16_t* old = sp.fadeOut.data() + (size_t)sp.xfadeDone * ch;
+        for (uint32_t c = 0; c < ch; ++c) {
+            float s = (float)out[i * ch + c] * gIn + (float)old[c] * gOut;
+            if (s > 32767.0f)  s = 32767.0f;
+            if (s < -32768.0f) s = -32768.0f;
+            out[i * ch + c] = (int16_t)s;
+        }
+    }
+}
+
+
+
+static void start_ramp(float& cur, float& target, float& step, uint32_t& left, float to, uint32_t ramp)
+{
+    target = to;
+    if (ramp == 0 || cur == to) {
+        cur = to; step = 0.0f; left = 0;
+        return;
+    }
+    step = (to - cur) / (float)ramp;
+    left = ramp;
+}
+
+static void apply_param(DevParams& pr, const ParamCmd& c)
+{
+    switch (c.kind) {
+    case ParamKind::Gain:
+        start_ramp(pr.gain, pr.gainTarget, pr.gainStep, pr.gainLeft, c.value, c.rampFrames);
+        break;
+    case ParamKind::Swap:
+        start_ramp(pr.swap, pr.swapTarget, pr.swapStep, pr.swapLeft, c.value, c.rampFrames);
+        break;
+    case ParamKind::Delay:
+        // задержку меняем в тишине: увели в ноль -> сдвинули -> вернули
+        pr.delayTarget = c.delayFrames;
+        pr.delayRamp   = std::max(c.rampFrames, kMinDuckFrames);
+        if (pr.delayTarget != pr.delayCur) {
+            start_ramp(pr.duck, pr.duckTarget, pr.duckStep, pr.duckLeft, 0.0f, pr.delayRamp);
+        }
+        break;
+    }
+}
+
+// Кусок блока с неизменным набором команд: рампы по-сэмплово, иначе быстрый путь.
+// Считаем во float без ограничения — перегрузку снимает лимитер.
+static void render_params(DevParams& pr, float* samples, ma_uint32 frames)
+{
+    const uint32_t ch = g.ch;
+    if (!pr.gainLeft && !pr.swapLeft && !pr.duckLeft) {
+        const float k = pr.gain * pr.duck;
+        if (k <= 0.0f) {
+            std::memset(samples, 0, (size_t)frames * ch * sizeof(float));
+        } else {
+            if (ch == 2 && pr.swap >= 1.0f) {
+                for (ma_uint32 i = 0; i < frames; ++i) {
+                    std::swap(samples[i*2 + 0], samples[i*2 + 1]); // L <-> R
+                }
+            } else if (ch == 2 && pr.swap > 0.0f) {
+                const float m = pr.swap;
+                for (ma_uint32 i = 0; i < frames; ++i) {
+                    const float l = samples[i*2 + 0], r = samples[i*2 + 1];
+                    samples[i*2 + 0] = l + (r - l) * m;
+                    samples[i*2 + 1] = r + (l - r) * m;
+                }
+            }
+            if (std::fabs(k - 1.0f) > 0.0001f) {
+                const size_t sampleCount = (size_t)frames * ch;
+                for (size_t i = 0; i < sampleCount; ++i) {
+                    samples[i] *= k;
+                }
+            }
+        }
+    } else {
+        for (ma_uint32 i = 0; i < frames; ++i) {
+            if (pr.gainLeft) { pr.gain += pr.gainStep; if (--pr.gainLeft == 0) pr.gain = pr.gainTarget; }
+            if (pr.swapLeft) { pr.swap += pr.swapStep; if (--pr.swapLeft == 0) pr.swap = pr.swapTarget; }
+            if (pr.duckLeft) { pr.duck += pr.duckStep; if (--pr.duckLeft == 0) pr.duck = pr.duckTarget; }
+
+            float* f = samples + (size_t)i * ch;
+            if (ch == 2 && pr.swap > 0.0f) {
+                const float l = f[0], r = f[1];
+                f[0] = l + (r - l) * pr.swap;
+                f[1] = r + (l - r) * pr.swap;
+            }
+            const float k = pr.gain * pr.duck;
+            for (uint32_t c = 0; c < ch; ++c) {
+                f[c] *= k;
+            }
+        }
+    }
+
+    if (!pr.duckLeft && pr.duck <= 0.0f && pr.delayTarget != pr.delayCur) {
+        pr.delayShiftReady = true;   // сдвиг — в начале следующего блока
+    }
+}
+
+// Seek/flush/splice: отложенные команды к старой шкале media больше не
+// относятся — их точку могли перепрыгнуть или отмотать назад. Применяем
+// сразу, по порядку: слоты pending[] освобождаются, настройки не теряются.
+static void release_pending_params(DevParams& pr)
+{
+    for (uint32_t k = 0; k < pr.pendingCount; ++k) apply_param(pr, pr.pending[k]);
+    pr.pendingCount = 0;
+}
+
+// Применить команды к блоку: наступившие (и уже пройденные) — сразу,
+// отложенные — с точностью до кадра
+static void process_params(DevParams& pr, float* samples, ma_uint32 frames, int64_t blockMedia)
+{
+    ParamCmd c;
+    while (pr.pendingCount < kMaxPendingParams && pr.queue.pop(c)) {
+        pr.pending[pr.pendingCount++] = c;
+    }
+
+    ma_uint32 i = 0;
+    while (true) {
+        ma_uint32 next = frames;
+        for (uint32_t k = 0; k < pr.pendingCount; ) {
+            const ParamCmd& pc = pr.pending[k];
+            const int64_t off = pc.atMedia < 0 ? 0 : pc.atMedia - blockMedia;
+            if (off <= (int64_t)i) {
+                apply_param(pr, pc);
+                // порядок сохраняем: поздняя команда того же вида должна победить
+                for (uint32_t j = k + 1; j < pr.pendingCount; ++j) pr.pending[j - 1] = pr.pending[j];
+                --pr.pendingCount;
+            } else {
+                if (off < (int64_t)next) next = (ma_uint32)off;
+                ++k;
+            }
+        }
+        if (i >= frames) break;
+        render_params(pr, samples + (size_t)i * g.ch, next - i);
+        i = next;
+    }
+}
+
+static void s16_to_f32(const int16_t* s, float* f, size_t n)
+{
+    size_t i = 0;
+#ifdef DUALOUT_ENGINE_SSE
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(f + i,     _mm_cvtepi32_ps(lo));
+        _mm_storeu_ps(f + i + 4, _mm_cvtepi32_ps(hi));
+    }
+#endif
+    for (; i < n; ++i) f[i] = (float)s[i];
+}
+
+// Округление и насыщение без ветвлений на сэмпл (packs сам режет до ±32767)
+static void f32_to_s16(const float* f, int16_t* s, size_t n)
+{
+    size_t i = 0;
+#ifdef DUALOUT_ENGINE_SSE
+    const __m128 hiLim = _mm_set1_ps(32767.0f), loLim = _mm_set1_ps(-32768.0f);
+    for (; i + 8 <= n; i += 8) {
+        const __m128 a = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(f + i),     hiLim), loLim);
+        const __m128 b = _mm_max_ps(_mm_min_ps(_mm_loadu_ps(f + i + 4), hiLim), loLim);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(s + i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#endif
+    for (; i < n; ++i) s[i] = (int16_t)std::lrint(std::min(32767.0f, std::max(-32768.0f, f[i])));
+}
+
+// Весь блок — цифровая тишина (OR по 16 байт за раз)
+static bool all_zero(const int16_t* s, size_t n)
+{
+    size_t i = 0;
+#ifdef DUALOUT_ENGINE_SSE
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm_or_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) return false;
+#endif
+    for (; i < n; ++i) if (s[i]) return false;
+    return true;
+}
+
+// НОВОЕ: выходной каскад кусками по Limiter::kMaxBlock: s16 -> float,
+// команды (громкость/swap/задержка), look-ahead лимитер, float -> s16.
+// Лимитер меряет уровень, только пока gain > 1: без усиления выход
+// бит-в-бит совпадает со входом (с задержкой лимитера).
+static void render_output(DevParams& pr, DevMeter& m, int16_t* samples, ma_uint32 frames,
+                          int64_t blockMedia, bool params)
+{
+    const uint32_t ch   = g.ch;
+    const bool    limOn = g.limiterOn.load(std::memory_order_relaxed);
+    const float   ceil  = g.limiterCeil.load(std::memory_order_relaxed);
+    float gmin = 1.0f;
+    for (ma_uint32 off = 0; off < frames; ) {
+        const ma_uint32 n = ma_min(frames - off, Limiter::kMaxBlock);
+        int16_t* s = samples + (size_t)off * ch;
+        float*   f = pr.fbuf.data();
+        s16_to_f32(s, f, (size_t)n * ch);
+        bool boost = pr.gain > 1.0f || pr.gainTarget > 1.0f;
+        if (params) process_params(pr, f, n, blockMedia + off);
+        boost = boost || pr.gain > 1.0f || pr.gainTarget > 1.0f;
+        pr.lim.process(f, n, limOn && boost, ceil);
+        gmin = std::min(gmin, pr.lim.minGain());
+        f32_to_s16(f, s, (size_t)n * ch);
+        off += n;
+    }
+    const float gr = gmin < 1.0f ? 20.0f * std::log10(gmin) : 0.0f;
+    m.limGrDb.store(gr, std::memory_order_relaxed);
+    if (gr < m.limGrMaxDb.load(std::memory_order_relaxed)) {
+        m.limGrMaxDb.store(gr, std::memory_order_relaxed);
+    }
+}
+
+// Выход из буферизации: ровно один колбэк закрывает остановку и пишет статистику
+static void end_stall()
+{
+    bool expected = true;
+    if (g.buffering.compare_exchange_strong(expected, false)) {
+        const int64_t ms = (steady_now_ns() - g.stallStartNs.load(std::memory_order_relaxed)) / 1000000;
+        g.lastStallMs.store((int)ms, std::memory_order_relaxed);
+        g.totalStallMs.fetch_add(ms, std::memory_order_relaxed);
+    }
+}
+
+// Возвращает кадры недобора (underrun), добитые тишиной, пока плеер кормит
+// движок; намеренная тишина (буферизация, пауза, EOS) сюда не входит.
+// idle — тишина держится дольше kIdleSettleSec: метры и тап не нужны.
+static ma_uint32 dev_render(ma_device* d, void* out, ma_uint32 frameCount, bool& idle)
 {
     const bool isA = (d == &g.devA);
     ma_pcm_rb* rb = (isA ? &g.rbA : &g.rbB);
@@ -85,23 +700,121 @@ static void dev_callback(ma_device* d, void* out, const void*, ma_uint32 frameCo
     const ma_uint32 needFrames = frameCount;                 // FRAMES
     const ma_uint32 bpf        = g.ch * sizeof(int16_t);     // bytes per frame
 
-    ma_uint32 totalRead = 0;
     uint8_t* outBytes = static_cast<uint8_t*>(out);
+    DevSplice& sp  = isA ? g.spA : g.spB;
+    DevClock&  clk = isA ? g.clkA : g.clkB;
+    DevParams& pr  = isA ? g.prmA : g.prmB;
+
+    // НОВОЕ: flush() просит бросить недоигранный splice
+    if (sp.cancel.exchange(false, std::memory_order_acquire)) {
+        sp.src = nullptr;
+        sp.srcPos = sp.srcFrames = 0;
+        sp.xfadeLen = sp.xfadeDone = 0;
+    }
+    // НОВОЕ: flush() — очередь выбрасывает сам колбэк, ринг остаётся SPSC
+    if (clk.flushReq.load(std::memory_order_acquire)) {
+        rb_discard_all(rb, clk);
+        clk.stamps.clear();
+        release_pending_params(pr);
+        clk.flushReq.store(false, std::memory_order_release);
+    }
+    // НОВОЕ: продюсер выложил новый кусок для seek — переключаемся
+    if (sp.pending.load(std::memory_order_acquire)) {
+        take_splice(sp, clk, rb, bpf);
+        release_pending_params(pr);
+    }
+    apply_media_stamps(clk, sp);
+
+    // НОВОЕ: watermarks — при нехватке данных глушим оба выхода и копим очередь
+    bool& bufMuted     = isA ? g.bufMutedA : g.bufMutedB;
+    uint32_t& bufFadeIn = isA ? g.bufFadeInA : g.bufFadeInB;
+    const uint32_t lowW  = g.lowWaterFrames.load(std::memory_order_relaxed);
+    const uint32_t highW = g.highWaterFrames.load(std::memory_order_relaxed);
+    const bool wmActive = highW > 0 &&
+                          g.watermarksArmed.load(std::memory_order_relaxed) &&
+                          !g.eosArmed.load(std::memory_order_relaxed) &&
+                          !sp.pending.load(std::memory_order_relaxed);
+    // поля splice — только своего колбэка: второму устройству отдаём число
+    const uint32_t queued = ma_pcm_rb_available_read(rb) + (sp.srcFrames - sp.srcPos);
+    clk.queued.store(queued, std::memory_order_relaxed);
+    if (wmActive) {
+        if (!g.buffering.load(std::memory_order_acquire) && queued < lowW) {
+            bool expected = false;
+            if (g.buffering.compare_exchange_strong(expected, true)) {
+                g.stallStartNs.store(steady_now_ns(), std::memory_order_relaxed);
+                g.stalls.fetch_add(1, std::memory_order_relaxed);
+            }
+        } else if (g.buffering.load(std::memory_order_acquire)) {
+            const DevClock& other = isA ? g.clkB : g.clkA;
+            if (queued >= highW && other.queued.load(std::memory_order_relaxed) >= highW) {
+                end_stall();
+            }
+        }
+    } else if (g.buffering.load(std::memory_order_acquire)) {
+        // плеер перестал кормить (пауза/EOS) — буферизация больше не нужна
+        end_stall();
+    }
 
-    while (totalRead < needFrames) {
-        ma_uint32 remaining = needFrames - totalRead;
+    if (g.buffering.load(std::memory_order_acquire)) {
+        ma_uint32 got = 0;
+        if (!bufMuted) {
+            // доигрываем короткий хвост с fade-out, дальше тишина
+            got = pull_frames(sp, clk, rb, outBytes, ma_min(needFrames, kBufferingRampFrames), bpf);
+            int16_t* samples = reinterpret_cast<int16_t*>(outBytes);
+            for (ma_uint32 i = 0; i < got; ++i) {
+                const float k = 1.0f - (float)(i + 1) / (float)got;
+                for (uint32_t c = 0; c < g.ch; ++c) {
+                    samples[i * g.ch + c] = (int16_t)((float)samples[i * g.ch + c] * k);
+                }
+            }
+            bufMuted = true;
+        }
+        std::memset(outBytes + got * bpf, 0, (needFrames - got) * bpf);
+        // линия задержки лимитера должна доиграть и дальше идти без разрыва
+        render_output(pr, isA ? g.mtA : g.mtB, reinterpret_cast<int16_t*>(outBytes), needFrames, 0, false);
+        pr.silentFrames = 0;
+        return 0;
+    }
+    if (bufMuted) {
+        bufMuted  = false;
+        bufFadeIn = kBufferingRampFrames;
+    }
 
-        void* p = nullptr;
-        ma_uint32 capFrames = remaining;
-        if (ma_pcm_rb_acquire_read(rb, &capFrames, &p) != MA_SUCCESS || capFrames == 0) {
-            // Нечего читать — выходим из цикла
-            break;
+    // НОВОЕ: сдвиг задержки (выход уже уведён в тишину)
+    if (pr.delayShiftReady) {
+        const int32_t delta = pr.delayTarget - pr.delayCur;
+        if (delta > 0) {
+            pr.holdFrames += (uint32_t)delta;
+        } else if (delta < 0) {
+            const ma_uint32 skip = ma_min((ma_uint32)(-delta), ma_pcm_rb_available_read(rb));
+            if (skip) {
+                ma_pcm_rb_seek_read(rb, skip);
+                clk.readPos.fetch_add(skip, std::memory_order_relaxed);
+                clk.mediaPos.fetch_add(skip, std::memory_order_relaxed);
+            }
         }
+        pr.delayCur = pr.delayTarget;
+        pr.delayShiftReady = false;
+        start_ramp(pr.duck, pr.duckTarget, pr.duckStep, pr.duckLeft, 1.0f, pr.delayRamp);
+    }
+    ma_uint32 lead = 0;
+    if (pr.holdFrames) {
+        lead = ma_min(pr.holdFrames, needFrames);
+        std::memset(outBytes, 0, lead * bpf);
+        pr.holdFrames -= lead;
+    }
 
-        // Копируем то, что реально доступно
-        std::memcpy(outBytes + totalRead * bpf, p, capFrames * bpf);
-        ma_pcm_rb_commit_read(rb, capFrames);
-        totalRead += capFrames;
+    const int64_t blockMedia = clk.mediaPos.load(std::memory_order_relaxed);
+    ma_uint32 totalRead = lead + pull_frames(sp, clk, rb, outBytes + lead * bpf, needFrames - lead, bpf);
+
+    if (bufFadeIn > 0) {
+        int16_t* samples = reinterpret_cast<int16_t*>(outBytes);
+        for (ma_uint32 i = 0; i < totalRead && bufFadeIn > 0; ++i, --bufFadeIn) {
+            const float k = 1.0f - (float)bufFadeIn / (float)kBufferingRampFrames;
+            for (uint32_t c = 0; c < g.ch; ++c) {
+                samples[i * g.ch + c] = (int16_t)((float)samples[i * g.ch + c] * k);
+            }
+        }
     }
 
         // Если кадров не хватило — добиваем тишиной
@@ -110,66 +823,608 @@ static void dev_callback(ma_device* d, void* out, const void*, ma_uint32 frameCo
         std::memset(outBytes + totalRead * bpf, 0, missing * bpf);
     }
 
-    // НОВОЕ: применяем громкость (на выходе, отдельно для A и B)
-        // НОВОЕ: применяем громкость (на выходе, отдельно для A и B)
-    float devGain   = isA ? g.gainA : g.gainB;
-    float totalGain = devGain * g.masterGain;
+    if (sp.xfadeDone < sp.xfadeLen) {
+        apply_splice_xfade(sp, reinterpret_cast<int16_t*>(outBytes), needFrames);
+    }
 
-    if (std::fabs(totalGain - 1.0f) > 0.0001f) {
-        int16_t* samples = reinterpret_cast<int16_t*>(outBytes);
-        const size_t sampleCount = static_cast<size_t>(needFrames) * g.ch;
-        for (size_t i = 0; i < sampleCount; ++i) {
-            float s = static_cast<float>(samples[i]) * totalGain;
-            if (s > 32767.0f)  s = 32767.0f;
-            if (s < -32768.0f) s = -32768.0f;
-            samples[i] = static_cast<int16_t>(s);
+    // НОВОЕ: после EOS-маркера ждём, пока устройство отдаст последний кадр
+    std::atomic_bool& eosDone = isA ? g.eosDoneA : g.eosDoneB;
+    if (g.eosArmed.load(std::memory_order_acquire) && !eosDone.load(std::memory_order_relaxed)) {
+        const bool drained = (totalRead < needFrames) ||
+                             (sp.srcPos >= sp.srcFrames && ma_pcm_rb_available_read(rb) == 0);
+        if (drained) {
+            // seq_cst: из двух колбэков хотя бы один увидит флаг другого
+            eosDone.store(true);
+            std::atomic_bool& other = isA ? g.eosDoneB : g.eosDoneA;
+            if (other.load()) {
+                g.eosReached.store(true, std::memory_order_release);
+            }
         }
     }
 
-    // === NEW: swap L/R if enabled and stereo ===
-    if (g.swapLR.load(std::memory_order_relaxed) && g.ch == 2) {
-        int16_t* samples = reinterpret_cast<int16_t*>(outBytes);
-        const size_t frames = needFrames;
-        for (size_t i = 0; i < frames; ++i) {
-            std::swap(samples[i*2 + 0], samples[i*2 + 1]); // L <-> R
+    // НОВОЕ: тишина без команд в очереди и без рамп — нули так и остаются
+    // нулями; когда лимитер доиграл свою задержку, каскад не нужен вовсе
+    int16_t* samples = reinterpret_cast<int16_t*>(outBytes);
+    DevMeter& mt = isA ? g.mtA : g.mtB;
+    const bool still = pr.pendingCount == 0 && pr.queue.size() == 0 &&
+                       !pr.gainLeft && !pr.swapLeft && !pr.duckLeft &&
+                       !pr.delayShiftReady && pr.holdFrames == 0;
+    const bool silent = still && all_zero(samples, (size_t)needFrames * g.ch);
+    if (silent && pr.silentFrames >= pr.lim.latency()) {
+        pr.lim.settle();
+        mt.limGrDb.store(0.0f, std::memory_order_relaxed);
+    } else {
+        // НОВОЕ: громкость, swap и задержка — из очереди команд, с рампами;
+        // дальше лимитер вместо жёсткого клипа
+        render_output(pr, mt, samples, needFrames, blockMedia, true);
+    }
+    pr.silentFrames = silent ? pr.silentFrames + needFrames : 0;
+
+    const bool feeding = g.watermarksArmed.load(std::memory_order_relaxed) &&
+                         !g.eosArmed.load(std::memory_order_relaxed);
+    const ma_uint32 pad = (feeding && totalRead < needFrames) ? needFrames - totalRead : 0;
+    idle = pad == 0 && pr.silentFrames >= (uint32_t)(kIdleSettleSec * g.sr);
+    return pad;
+}
+
+
+
+// НОВОЕ: метры по ФАКТИЧЕСКОМУ выходу (после gain+swap), все каналы.
+// Один проход по блоку в целых числах, баллистика — раз на блок.
+static void run_meter(DevMeter& m, const int16_t* s, ma_uint32 frames, uint32_t stride)
+{
+    const uint32_t nch = std::min<uint32_t>(stride, kDualOutMeterMaxCh);
+    if (m.resetReq.exchange(false, std::memory_order_acquire)) {
+        for (uint32_t c = 0; c < kDualOutMeterMaxCh; ++c) {
+            m.hold[c] = 0.0f;
+            m.holdAge[c] = 0.0f;
+        }
+    }
+    // после простоя баллистика стартует с тишины, а не с уровня до неё
+    if (m.clearReq.exchange(false, std::memory_order_acquire)) {
+        for (uint32_t c = 0; c < kDualOutMeterMaxCh; ++c) {
+            m.ms[c] = m.ppm[c] = m.hold[c] = m.holdAge[c] = 0.0f;
+        }
+    }
+    if (frames == 0 || nch == 0) return;
+
+    int64_t  sumSq[kDualOutMeterMaxCh] = {};
+    int      peak[kDualOutMeterMaxCh]  = {};
+    uint32_t clip[kDualOutMeterMaxCh]  = {};
+    for (ma_uint32 i = 0; i < frames; ++i) {
+        const int16_t* f = s + (size_t)i * stride;
+        for (uint32_t c = 0; c < nch; ++c) {
+            const int v = f[c];
+            const int a = v < 0 ? -v : v;
+            sumSq[c] += v * v;
+            peak[c] = std::max(peak[c], a);
+            clip[c] += (a >= 32767);
         }
     }
 
-    // НОВОЕ: считаем RMS/peak по ФАКТИЧЕСКОМУ выходу (после gain+swap), только на A
-    if (isA && g.ch >= 1) {
-        int16_t* samples = reinterpret_cast<int16_t*>(outBytes);
-        const size_t frames = needFrames;
+    const float dt   = (float)frames / (float)g.sr;
+    const float vuK  = 1.0f - std::exp(-dt / kVuTauSec);
+    const float fall = std::pow(10.0f, -kPpmFallDbPerSec * dt / 20.0f);
+    const float invN = 1.0f / ((float)frames * 32768.0f * 32768.0f);
+    for (uint32_t c = 0; c < nch; ++c) {
+        m.ms[c] += ((float)sumSq[c] * invN - m.ms[c]) * vuK;
+        const float p = (float)peak[c] / 32768.0f;
+        m.ppm[c] = std::max(p, m.ppm[c] * fall);
+        if (p >= m.hold[c]) {
+            m.hold[c] = p;
+            m.holdAge[c] = 0.0f;
+        } else if ((m.holdAge[c] += dt) > kPeakHoldSec) {
+            m.hold[c] = std::max(m.hold[c] * fall, m.ppm[c]);
+        }
+        m.outRms[c].store(std::sqrt(m.ms[c]), std::memory_order_relaxed);
+        m.outPeak[c].store(m.ppm[c], std::memory_order_relaxed);
+        m.outHold[c].store(m.hold[c], std::memory_order_relaxed);
+        if (clip[c]) m.clips[c].fetch_add(clip[c], std::memory_order_relaxed);
+    }
+    m.channels.store(nch, std::memory_order_relaxed);
+}
 
-        double sumSqL = 0.0;
-        double sumSqR = 0.0;
-        float peakL   = 0.0f;
-        float peakR   = 0.0f;
+// Метры под флагом busy: колбэк не ждёт (занято — пропускаем блок),
+// поток анализа повторяет попытку
+static bool meter_try(DevMeter& m, const int16_t* s, ma_uint32 frames, uint32_t stride)
+{
+    if (m.busy.exchange(true, std::memory_order_acquire)) return false;
+    const int64_t t0 = steady_now_ns();
+    run_meter(m, s, frames, stride);
+    const float us = (float)(steady_now_ns() - t0) / 1000.0f;
+    m.meterUsAcc += (us - m.meterUsAcc) * 0.05f;
+    m.meterUsAvg.store(m.meterUsAcc, std::memory_order_relaxed);
+    m.busy.store(false, std::memory_order_release);
+    return true;
+}
 
-        for (size_t i = 0; i < frames; ++i) {
-            int16_t sL = samples[i * g.ch + 0];
-            int16_t sR = (g.ch > 1 ? samples[i * g.ch + 1] : sL);
+template <size_t N>
+static void tap_push(SpscQueue<TapBlock, N>& q, std::atomic<uint32_t>& drops,
+                     const int16_t* s, ma_uint32 frames, int64_t media, int64_t tNs,
+                     uint32_t gen = 0, ma_uint32 pad = 0, bool quiet = false)
+{
+    const uint32_t nch = std::min<uint32_t>(g.ch, kDualOutMeterMaxCh);
+    for (ma_uint32 off = 0; off < frames; ) {
+        const ma_uint32 n = ma_min(frames - off, kTapBlockFrames);
+        TapBlock* b = q.claim();
+        if (!b) {
+            drops.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        b->frames = n;
+        b->ch     = nch;
+        b->media  = media + off;
+        b->tNs    = tNs;
+        b->gen    = gen;
+        b->pad    = n - ma_min(n, (frames - pad > off) ? frames - pad - off : 0);
+        b->drops  = drops.load(std::memory_order_relaxed);
+        b->quiet  = quiet;
+        const int16_t* src = s + (size_t)off * g.ch;
+        if (nch == g.ch) {
+            std::memcpy(b->pcm, src, (size_t)n * nch * sizeof(int16_t));
+        } else {
+            for (ma_uint32 i = 0; i < n; ++i)
+                for (uint32_t c = 0; c < nch; ++c)
+                    b->pcm[i * nch + c] = src[(size_t)i * g.ch + c];
+        }
+        q.publish();
+        off += n;
+    }
+}
 
-            float fl = (float)sL / 32768.0f;
-            float fr = (float)sR / 32768.0f;
+static void spectrum_setup()
+{
+    SpecState& sp = g.spec;
+    const uint32_t n = kSpecFftSize;
+    const double pi = 3.14159265358979323846;
+    sp.window.resize(n);
+    for (uint32_t i = 0; i < n; ++i) sp.window[i] = (float)(0.5 - 0.5 * std::cos(2.0 * pi * i / n));
+    sp.hist.assign(n, 0.0f);
+    sp.re.assign(n, 0.0f);
+    sp.im.assign(n, 0.0f);
+    sp.histPos = sp.sinceHop = 0;
+    sp.hop = g.sr / kSpecRateHz;
+    sp.usAcc = 0.0f;
+
+    // края полос — геометрическая прогрессия; узкие низкие полосы, куда
+    // не попал ни один бин, берут ближайший бин к своему центру
+    const float binHz = (float)g.sr / (float)n;
+    const float hi    = std::min(kSpecHiHz, (float)g.sr * 0.5f);
+    std::lock_guard<std::mutex> lk(sp.mtx);
+    sp.out = DualOutSpectrum{};
+    for (uint32_t k = 0; k < kDualOutSpectrumBands; ++k) {
+        const float e0 = kSpecLoHz * std::pow(hi / kSpecLoHz, (float)k / kDualOutSpectrumBands);
+        const float e1 = kSpecLoHz * std::pow(hi / kSpecLoHz, (float)(k + 1) / kDualOutSpectrumBands);
+        const float fc = std::sqrt(e0 * e1);
+        uint32_t lo = (uint32_t)std::ceil(e0 / binHz);
+        uint32_t up = (uint32_t)std::ceil(e1 / binHz);
+        if (up <= lo) {
+            lo = (uint32_t)std::lround(fc / binHz);
+            up = lo + 1;
+        }
+        sp.binLo[k] = std::min(lo, n / 2 - 1);
+        sp.binHi[k] = std::min(up, n / 2);
+        sp.out.bandHz[k]  = fc;
+        sp.out.bandsDb[k] = -120.0f;
+    }
+}
 
-            sumSqL += (double)fl * (double)fl;
-            sumSqR += (double)fr * (double)fr;
+// Один кадр анализа: окно Ханна по последним kSpecFftSize сэмплам, БПФ,
+// энергия по полосам в дБ относительно полной шкалы
+static void spectrum_frame(int64_t media)
+{
+    SpecState& sp = g.spec;
+    const uint32_t n = kSpecFftSize;
+    const int64_t t0 = steady_now_ns();
+    for (uint32_t k = 0; k < n; ++k) {
+        sp.re[k] = sp.hist[(sp.histPos + k) & (n - 1)] * sp.window[k];
+        sp.im[k] = 0.0f;
+    }
+    sp.fft.forward(sp.re.data(), sp.im.data());
+
+    float db[kDualOutSpectrumBands];
+    const float norm = 16.0f / ((float)n * (float)n);   // синус полной шкалы ~ 0 дБ
+    for (uint32_t k = 0; k < kDualOutSpectrumBands; ++k) {
+        float sum = 0.0f;
+        for (uint32_t b = sp.binLo[k]; b < sp.binHi[k]; ++b) {
+            sum += sp.re[b] * sp.re[b] + sp.im[b] * sp.im[b];
+        }
+        db[k] = 10.0f * std::log10(std::max(sum * norm, 1e-12f));
+    }
+    const float us = (float)(steady_now_ns() - t0) / 1000.0f;
+    sp.usAcc += (us - sp.usAcc) * 0.05f;
+
+    std::lock_guard<std::mutex> lk(sp.mtx);
+    std::memcpy(sp.out.bandsDb, db, sizeof(db));
+    sp.out.media = media;
+    sp.out.frames++;
+    sp.out.usAvg = sp.usAcc;
+    sp.out.usMax = std::max(sp.out.usMax, us);
+}
 
-            peakL = std::max(peakL, std::fabs(fl));
-            peakR = std::max(peakR, std::fabs(fr));
+static void spectrum_feed(const TapBlock& b)
+{
+    SpecState& sp = g.spec;
+    for (uint32_t i = 0; i < b.frames; ++i) {
+        const int16_t* f = b.pcm + (size_t)i * b.ch;
+        const float x = b.ch >= 2 ? ((float)f[0] + (float)f[1]) * (0.5f / 32768.0f)
+                                  : (float)f[0] * (1.0f / 32768.0f);
+        sp.hist[sp.histPos] = x;
+        sp.histPos = (sp.histPos + 1) & (kSpecFftSize - 1);
+        if (++sp.sinceHop >= sp.hop) {
+            sp.sinceHop = 0;
+            spectrum_frame(b.media + i + 1);
         }
+    }
+}
 
-        const double n = (double)frames;
-        float rmsL = n > 0.0 ? (float)std::sqrt(sumSqL / n) : 0.0f;
-        float rmsR = n > 0.0 ? (float)std::sqrt(sumSqR / n) : 0.0f;
+// Задержка выхода A: упреждение лимитера + буфер устройства + добавка
+// пользователя (Bluetooth и т.п.)
+static int64_t output_latency_ns()
+{
+    const ma_uint32 sr = g.devA.playback.internalSampleRate ? g.devA.playback.internalSampleRate : g.sr;
+    const int64_t frames = (int64_t)g.devA.playback.internalPeriodSizeInFrames * g.devA.playback.internalPeriods;
+    return frames * 1000000000LL / sr + (int64_t)g.prmA.lim.latency() * 1000000000LL / g.sr +
+           (int64_t)g.extraLatencyMs.load(std::memory_order_relaxed) * 1000000LL;
+}
+
+static void onset_feed(const TapBlock& b)
+{
+    g.onsetMono.resize(b.frames);
+    for (uint32_t i = 0; i < b.frames; ++i) {
+        const int16_t* f = b.pcm + (size_t)i * b.ch;
+        g.onsetMono[i] = b.ch >= 2 ? ((float)f[0] + (float)f[1]) * (0.5f / 32768.0f)
+                                   : (float)f[0] * (1.0f / 32768.0f);
+    }
+    g.onsetOut.clear();
+    g.onset.feed(g.onsetMono.data(), b.frames, b.media, g.onsetOut);
+    g.tempoBpm.store(g.onset.bpm(), std::memory_order_relaxed);
+    g.tempoConf.store(g.onset.confidence(), std::memory_order_relaxed);
+    if (g.onsetOut.empty()) return;
+
+    // медиа-кадр -> момент, когда он прозвучит: от того, что колбэк A отдаёт
+    // устройству сейчас, плюс задержка выхода
+    const int64_t now      = steady_now_ns();
+    const int64_t mediaNow = g.clkA.mediaPos.load(std::memory_order_relaxed);
+    const int64_t latNs    = output_latency_ns();
+    std::lock_guard<std::mutex> lk(g.onsetMtx);
+    for (const OnsetTracker::Onset& o : g.onsetOut) {
+        g.onsetCount.fetch_add(1, std::memory_order_relaxed);
+        if (!g.onsetSink) continue;
+        DualOutOnset ev{};
+        ev.media         = o.media;
+        ev.presentNs     = now + (o.media - mediaNow) * 1000000000LL / g.sr + latNs;
+        ev.inMs          = (int)((ev.presentNs - now) / 1000000);
+        ev.strength      = o.strength;
+        ev.bpm           = g.onset.bpm();
+        ev.bpmConfidence = g.onset.confidence();
+        g.onsetSink(ev);
+    }
+}
+
+// Блок создаётся один раз на процесс и переживает переоткрытие устройств.
+// Именованный mapping есть только в Windows: в других ОС телеметрии нет,
+// telemetryName() пуст, публикация пропускается (g.tm == nullptr).
+static void telemetry_open()
+{
+#ifdef _WIN32
+    if (g.tm) return;
+    wchar_t name[64];
+    std::swprintf(name, 64, DUALOUT_TM_NAME_FMT, process_id());
+    g.tmMap = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                 (DWORD)sizeof(dualout_telemetry), name);
+    if (!g.tmMap) {
+        std::cerr << "[DualOutEngine] telemetry mapping failed\n";
+        return;
+    }
+    g.tm = static_cast<dualout_telemetry*>(MapViewOfFile(g.tmMap, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(dualout_telemetry)));
+    if (!g.tm) {
+        CloseHandle(g.tmMap);
+        g.tmMap = nullptr;
+        return;
+    }
+    std::memset(g.tm, 0, sizeof(dualout_telemetry));
+    g.tm->size    = (uint32_t)sizeof(dualout_telemetry);
+    g.tm->version = DUALOUT_TM_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    g.tm->magic   = DUALOUT_TM_MAGIC;
+    g.tmName = name;
+#endif
+}
 
-        g.lastRmsL.store(rmsL, std::memory_order_relaxed);
-        g.lastRmsR.store(rmsR, std::memory_order_relaxed);
-        g.lastPeakL.store(peakL, std::memory_order_relaxed);
-        g.lastPeakR.store(peakR, std::memory_order_relaxed);
+// Seqlock: нечётный seq — запись идёт; читатель повторяет, если seq поменялся
+static void telemetry_publish(bool running)
+{
+    dualout_telemetry* t = g.tm;
+    if (!t) return;
+    std::atomic_ref<uint32_t> seq(const_cast<uint32_t&>(t->seq));
+    const uint32_t s0 = seq.load(std::memory_order_relaxed);
+    seq.store(s0 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const uint32_t sr = g.sr ? g.sr : 48000;
+    int queueMs[2] = { 0, 0 };
+    for (int d = 0; d < 2; ++d) {
+        const DevMeter& m  = d ? g.mtB : g.mtA;
+        const DevClock& ck = d ? g.clkB : g.clkA;
+        dualout_tm_device& o = t->dev[d];
+        const bool idle = m.idle.load(std::memory_order_relaxed);
+        for (uint32_t c = 0; c < DUALOUT_TM_MAX_CH; ++c) {
+            o.rms[c]   = idle ? 0.0f : m.outRms[c].load(std::memory_order_relaxed);
+            o.peak[c]  = idle ? 0.0f : m.outPeak[c].load(std::memory_order_relaxed);
+            o.hold[c]  = idle ? 0.0f : m.outHold[c].load(std::memory_order_relaxed);
+            o.clips[c] = m.clips[c].load(std::memory_order_relaxed);
+        }
+        o.media_frame = ck.mediaPos.load(std::memory_order_relaxed);
+        if (running) {
+            queueMs[d] = (int)((uint64_t)ma_pcm_rb_available_read(d ? &g.rbB : &g.rbA) * 1000 / sr);
+        }
+        o.queue_ms = queueMs[d];
+        o.cb_us    = m.cbUsAvg.load(std::memory_order_relaxed);
+    }
+
+    int state = running ? g.playerState.load(std::memory_order_relaxed) : DUALOUT_TM_STOPPED;
+    if (running && g.buffering.load(std::memory_order_relaxed)) state = DUALOUT_TM_BUFFERING;
+    if (running && g.eosReached.load(std::memory_order_relaxed)) state = DUALOUT_TM_ENDED;
+    t->state        = state;
+    t->sample_rate  = sr;
+    t->channels     = g.ch;
+    t->pos_ms       = t->dev[0].media_frame * 1000 / sr;
+    t->drift_ms_ab  = queueMs[0] - queueMs[1];
+    t->latency_ms   = running ? (int32_t)(output_latency_ns() / 1000000) : 0;
+    t->stalls       = (int32_t)g.stalls.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(g.spec.mtx);
+        std::memcpy(t->bands_db, g.spec.out.bandsDb, sizeof(t->bands_db));
     }
+    t->bpm       = g.tempoBpm.load(std::memory_order_relaxed);
+    t->bpm_conf  = g.tempoConf.load(std::memory_order_relaxed);
+    t->update_ns = steady_now_ns();
+    t->updates++;
+
+    seq.store(s0 + 2, std::memory_order_release);
 }
 
+static const char* const kGlitchNames[GlitchDetector::KindCount] = {
+    "discontinuity", "gap", "clip_burst", "underrun"
+};
+
+// Строка лога: локальное время, устройство, тип, позиция, канал, величина.
+// Зовётся под glitchMtx.
+static void glitch_log_line(const DualOutGlitch& e)
+{
+    if (!g.glitchLog.is_open()) return;
+    // локальное время с миллисекундами
+    const auto now = std::chrono::system_clock::now();
+    const std::time_t tt = std::chrono::system_clock::to_time_t(now);
+    const unsigned ms = (unsigned)(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       now.time_since_epoch()).count() % 1000);
+    std::tm lt{};
+#ifdef _WIN32
+    localtime_s(&lt, &tt);
+#else
+    localtime_r(&tt, &lt);
+#endif
+    const uint32_t sr = g.sr ? g.sr : 48000;
+    const int64_t posMs = e.media * 1000 / sr;
+    char ch[12] = "-";   // "-2147483648" + \0
+    if (e.ch >= 0) std::snprintf(ch, sizeof(ch), "%d", e.ch);
+    const char* unit = e.kind == DUALOUT_GLITCH_DISCONTINUITY ? "fs"
+                     : e.kind == DUALOUT_GLITCH_CLIP_BURST    ? "smp" : "ms";
+    char line[192];
+    const int n = std::snprintf(line, sizeof(line),
+        "%04u-%02u-%02u %02u:%02u:%02u.%03u dev=%c %-13s pos=%lld:%02lld.%03lld media=%lld ch=%s value=%.3f%s\n",
+        (unsigned)lt.tm_year + 1900, (unsigned)lt.tm_mon + 1, (unsigned)lt.tm_mday,
+        (unsigned)lt.tm_hour, (unsigned)lt.tm_min, (unsigned)lt.tm_sec, ms,
+        e.dev ? 'B' : 'A', kGlitchNames[e.kind],
+        (long long)(posMs / 60000), (long long)(posMs / 1000 % 60), (long long)(posMs % 1000),
+        (long long)e.media, ch, e.value, unit);
+    if (n <= 0) return;
+    g.glitchLog.write(line, std::min<int>(n, (int)sizeof(line) - 1));
+    g.glitchLog.flush();
+    g.glitchLogSize += (uint64_t)n;
+    if (g.glitchLogSize < kGlitchLogBytes) return;
+
+    // ротация: одна предыдущая копия, чтобы лог не рос бесконечно
+    g.glitchLog.close();
+    const std::filesystem::path cur(g.glitchLogPath);
+    std::filesystem::path old = cur;
+    old += L".1";
+    std::error_code ec;
+    std::filesystem::remove(old, ec);
+    std::filesystem::rename(cur, old, ec);
+    g.glitchLog.open(cur, std::ios::binary | std::ios::trunc);
+    g.glitchLogSize = 0;
+}
+
+static void glitch_feed(int dev, const TapBlock& b)
+{
+    GlitchState& gs = dev ? g.glitchB : g.glitchA;
+    if (b.drops != gs.dropsSeen) {
+        gs.dropsSeen = b.drops;
+        gs.det.resync();
+    }
+    const int64_t t0 = steady_now_ns();
+    g.glitchOut.clear();
+    gs.det.feed(b.pcm, b.frames, b.ch, b.media, b.pad, b.quiet, g.glitchOut);
+    const int64_t t1 = steady_now_ns();
+    gs.usAcc += ((float)(t1 - t0) / 1000.0f - gs.usAcc) * 0.05f;
+    gs.usAvg.store(gs.usAcc, std::memory_order_relaxed);
+    if (g.glitchOut.empty()) return;
+
+    // медиа-кадр -> настенные часы: блок ушёл на устройство в b.tNs
+    const int64_t wallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    const int64_t wallBlock = wallNow - (t1 - b.tNs) / 1000000;
+    std::lock_guard<std::mutex> lk(g.glitchMtx);
+    for (const GlitchDetector::Event& ev : g.glitchOut) {
+        gs.count[ev.kind].fetch_add(1, std::memory_order_relaxed);
+        DualOutGlitch& e = g.glitchRing[g.glitchSeq % kGlitchRing];
+        e.seq    = ++g.glitchSeq;
+        e.dev    = dev;
+        e.kind   = (int)ev.kind;
+        e.ch     = ev.ch;
+        e.value  = ev.value;
+        e.media  = ev.media;
+        e.wallMs = wallBlock + (ev.media - b.media) * 1000 / (int64_t)(g.sr ? g.sr : 48000);
+        glitch_log_line(e);
+    }
+}
+
+// НОВОЕ: остановка устройств на простое. Порядок как у Деккера: флаг
+// suspended ставим ДО последней проверки рингов, write() пишет в ринг ДО
+// проверки флага — хотя бы одна сторона увидит другую.
+static void idle_suspend()
+{
+    std::lock_guard<std::mutex> lk(g.suspendMtx);
+    if (g.suspended.load() || !g.running.load()) return;
+    g.suspended.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ma_pcm_rb_available_read(&g.rbA) || ma_pcm_rb_available_read(&g.rbB) ||
+        g.spA.pending.load() || g.spB.pending.load()) {
+        g.suspended.store(false);
+        return;
+    }
+    ma_device_stop(&g.devA);
+    ma_device_stop(&g.devB);
+    g.suspendStartNs = steady_now_ns();
+    g.suspends.fetch_add(1, std::memory_order_relaxed);
+    std::cerr << "[DualOutEngine] idle, devices suspended\n";
+}
+
+static void idle_resume()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!g.suspended.load()) return;
+    std::lock_guard<std::mutex> lk(g.suspendMtx);
+    if (!g.suspended.load()) return;
+    const int64_t t0 = steady_now_ns();
+    const bool ok = ma_device_start(&g.devA) == MA_SUCCESS && ma_device_start(&g.devB) == MA_SUCCESS;
+    const int64_t t1 = steady_now_ns();
+    if (!ok) std::cerr << "[DualOutEngine] resume after idle failed\n";
+
+    // колбэков, которых не было, и их цена по среднему "рабочему" колбэку
+    const double idleUs = (double)(t0 - g.suspendStartNs) / 1000.0;
+    for (const DevMeter* m : { &g.mtA, &g.mtB }) {
+        const float period = m->periodUs.load(std::memory_order_relaxed);
+        if (period <= 0.0f) continue;
+        const uint64_t n = (uint64_t)(idleUs / period);
+        g.wakeupsAvoided.fetch_add(n, std::memory_order_relaxed);
+        g.suspendSavedNs.fetch_add((uint64_t)((double)n * m->activeUsAvg.load(std::memory_order_relaxed) * 1000.0),
+                                   std::memory_order_relaxed);
+    }
+    g.lastResumeMs.store((int)((t1 - t0) / 1000000), std::memory_order_relaxed);
+    g.resumes.fetch_add(1, std::memory_order_relaxed);
+    g.suspended.store(false);
+}
+
+// Оба устройства молчат дольше idleSuspendMs и данных не ждём — останавливаем
+static void idle_check(int64_t now)
+{
+    const int ms = g.idleSuspendMs.load(std::memory_order_relaxed);
+    if (ms <= 0 || g.suspended.load(std::memory_order_relaxed)) return;
+    if (!g.mtA.idle.load(std::memory_order_acquire) || !g.mtB.idle.load(std::memory_order_acquire)) return;
+    const int64_t since = std::max(g.mtA.idleSinceNs.load(std::memory_order_relaxed),
+                                   g.mtB.idleSinceNs.load(std::memory_order_relaxed));
+    if (now - since < (int64_t)ms * 1000000) return;
+    idle_suspend();
+}
+
+static void analysis_loop()
+{
+    while (g.analysisRun.load(std::memory_order_acquire)) {
+        bool any = false;
+        const bool glitchOn = g.glitchOn.load(std::memory_order_relaxed);
+        if (g.glitchResetReq.exchange(false, std::memory_order_acquire)) {
+            for (GlitchState* gs : { &g.glitchA, &g.glitchB }) gs->det.reset(g.sr);
+        }
+        for (int dev = 0; dev < 2; ++dev) {
+            TapQueue& q = dev ? g.tapB : g.tapA;
+            DevMeter& m = dev ? g.mtB : g.mtA;
+            while (const TapBlock* b = q.peek()) {
+                while (!meter_try(m, b->pcm, b->frames, b->ch)) std::this_thread::yield();
+                if (dev == 0) spectrum_feed(*b);
+                if (glitchOn) glitch_feed(dev, *b);
+                q.drop();
+                any = true;
+            }
+        }
+        while (const TapBlock* b = g.onsetQ.peek()) {
+            const uint32_t gen = g.onsetGen.load(std::memory_order_acquire);
+            if (gen != g.onsetGenSeen) {
+                g.onsetGenSeen = gen;
+                g.onset.reset(g.sr);
+            }
+            if (b->gen == gen) onset_feed(*b);
+            g.onsetQ.drop();
+            any = true;
+        }
+        // своя частота обновления телеметрии, ~60 Гц
+        const int64_t now = steady_now_ns();
+        if (now - g.tmLastNs >= 16000000) {
+            g.tmLastNs = now;
+            telemetry_publish(true);
+        }
+        idle_check(now);
+        if (!any) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+static void dev_callback(ma_device* d, void* out, const void*, ma_uint32 frameCount)
+{
+    const bool isA = (d == &g.devA);
+    DevMeter& m = isA ? g.mtA : g.mtB;
+    // на выходе звучит то, что лимитер принял latency() кадров назад
+    const int64_t media = (isA ? g.clkA : g.clkB).mediaPos.load(std::memory_order_relaxed) -
+                          (int64_t)(isA ? g.prmA : g.prmB).lim.latency();
+
+    const int64_t t0 = steady_now_ns();
+    bool idle = false;
+    const ma_uint32 pad = dev_render(d, out, frameCount, idle);
+    const int64_t t1 = steady_now_ns();
+    const int16_t* pcm = static_cast<const int16_t*>(out);
+    const bool tapped = g.tapOn.load(std::memory_order_relaxed);
+
+    // НОВОЕ: простой — на выходе заведомо нули, метрам и тапу смотреть не на что
+    if (idle != m.idle.load(std::memory_order_relaxed)) {
+        if (idle) m.idleSinceNs.store(t0, std::memory_order_relaxed);
+        else      m.clearReq.store(true, std::memory_order_relaxed);
+        m.idle.store(idle, std::memory_order_release);
+    }
+    if (idle) {
+    } else if (tapped) {
+        const bool quiet = g.buffering.load(std::memory_order_relaxed) ||
+                           !g.watermarksArmed.load(std::memory_order_relaxed);
+        tap_push(isA ? g.tapA : g.tapB, m.tapDrops, pcm, frameCount, media, t0, 0, pad, quiet);
+    } else {
+        meter_try(m, pcm, frameCount, g.ch);
+    }
+    const int64_t t2 = steady_now_ns();
+
+    // НОВОЕ: цена колбэка против его бюджета (длительности блока);
+    // с тапом в неё входит только копия блока, без тапа — сами метры
+    const float cbUs  = (float)(t2 - t0) / 1000.0f;
+    const float tapUs = tapped ? (float)(t2 - t1) / 1000.0f : 0.0f;
+    m.cbUsAcc  += (cbUs - m.cbUsAcc) * 0.05f;
+    m.tapUsAcc += (tapUs - m.tapUsAcc) * 0.05f;
+    m.cbUsAvg.store(m.cbUsAcc, std::memory_order_relaxed);
+    m.tapUsAvg.store(m.tapUsAcc, std::memory_order_relaxed);
+    m.wakeups.fetch_add(1, std::memory_order_relaxed);
+    if (idle) {
+        // сэкономлено относительно колбэка с полной обработкой
+        m.idleWakeups.fetch_add(1, std::memory_order_relaxed);
+        if (m.activeUsAcc > cbUs) {
+            m.savedNs.fetch_add((uint64_t)((m.activeUsAcc - cbUs) * 1000.0f), std::memory_order_relaxed);
+        }
+    } else {
+        m.activeUsAcc += (cbUs - m.activeUsAcc) * 0.05f;
+        m.activeUsAvg.store(m.activeUsAcc, std::memory_order_relaxed);
+    }
+    if (cbUs > m.cbUsMax.load(std::memory_order_relaxed)) {
+        m.cbUsMax.store(cbUs, std::memory_order_relaxed);
+    }
+    m.periodUs.store((float)frameCount * 1e6f / (float)g.sr, std::memory_order_relaxed);
+}
 
 
 static bool find_device_id_by_name(const std::wstring& wantedW, ma_context* ctx, ma_device_id* outId, std::string* resolved)
@@ -215,6 +1470,19 @@ bool DualOutEngine::init(const std::wstring& devAName,
     g.gainA      = 1.0f;
     g.gainB      = 1.0f;
     g.masterGain = 1.0f;
+    // trim (нормализация) переживает переоткрытие устройств — его ставит плеер
+    for (DevParams* pr : { &g.prmA, &g.prmB }) {
+        pr->queue.clear();
+        pr->pendingCount = 0;
+        pr->gain = pr->gainTarget = g.trimGain; pr->gainStep = 0.0f; pr->gainLeft = 0;
+        pr->swap = pr->swapTarget = 0.0f; pr->swapStep = 0.0f; pr->swapLeft = 0;
+        pr->duck = pr->duckTarget = 1.0f; pr->duckStep = 0.0f; pr->duckLeft = 0;
+        pr->delayCur = pr->delayTarget = 0;
+        pr->delayShiftReady = false;
+        pr->holdFrames = 0;
+        pr->lim.reset(g.sr, g.ch);
+        pr->fbuf.assign((size_t)Limiter::kMaxBlock * g.ch, 0.0f);
+    }
 
 
     if (ma_context_init(nullptr, 0, nullptr, &g.ctx) != MA_SUCCESS) {
@@ -290,18 +1558,110 @@ if (ma_pcm_rb_init(ma_format_s16, fmt.ch, capacityFrames, nullptr, nullptr, &g.r
 
 g.rbCapacityFrames = capacityFrames;
 
+    // НОВОЕ: splice-буферы: до 500 мс нового аудио, кроссфейд до 100 мс
+    g.spliceCapFrames = g.sr / 2;
+    g.spliceMaxXfade  = g.sr / 10;
+    g.spliceIdx = 0;
+    g.spliceFrames = 0;
+    g.spliceXfadeFrames = 0;
+    for (auto& b : g.spliceBuf) b.assign((size_t)g.spliceCapFrames * g.ch, 0);
+    for (DevSplice* sp : { &g.spA, &g.spB }) {
+        sp->pending.store(false);
+        sp->cancel.store(false);
+        sp->ackNs.store(0);
+        sp->src = nullptr;
+        sp->srcPos = sp->srcFrames = 0;
+        sp->fadeOut.assign((size_t)g.spliceMaxXfade * g.ch, 0);
+        sp->xfadeLen = sp->xfadeDone = 0;
+    }
+
+    g.watermarksArmed.store(false);
+    g.buffering.store(false);
+    g.stalls.store(0);
+    g.lastStallMs.store(0);
+    g.totalStallMs.store(0);
+    g.bufMutedA = g.bufMutedB = false;
+    g.bufFadeInA = g.bufFadeInB = 0;
+
+    g.eosArmed.store(false);
+    g.eosDoneA.store(false);
+    g.eosDoneB.store(false);
+    g.eosReached.store(false);
+
     g.framesSubmitted   = 0;
+    g.ringBytesIn.store(0);
     g.dropA             = 0;
     g.dropB             = 0;
     g.lastStats         = std::chrono::steady_clock::time_point{};
     g.loggedCallbackA.store(false);
     g.loggedCallbackB.store(false);
 
-    // НОВОЕ: сбрасываем уровни
-    g.lastRmsL.store(0.0f, std::memory_order_relaxed);
-    g.lastRmsR.store(0.0f, std::memory_order_relaxed);
-    g.lastPeakL.store(0.0f, std::memory_order_relaxed);
-    g.lastPeakR.store(0.0f, std::memory_order_relaxed);
+    // НОВОЕ: сбрасываем метры (колбэки ещё не идут)
+    for (DevMeter* m : { &g.mtA, &g.mtB }) {
+        for (uint32_t c = 0; c < kDualOutMeterMaxCh; ++c) {
+            m->ms[c] = m->ppm[c] = m->hold[c] = m->holdAge[c] = 0.0f;
+            m->outRms[c].store(0.0f);
+            m->outPeak[c].store(0.0f);
+            m->outHold[c].store(0.0f);
+            m->clips[c].store(0);
+        }
+        m->cbUsAcc = m->meterUsAcc = m->tapUsAcc = 0.0f;
+        m->tapUsAvg.store(0.0f);
+        m->tapDrops.store(0);
+        m->busy.store(false);
+        m->channels.store(0);
+        m->cbUsAvg.store(0.0f);
+        m->cbUsMax.store(0.0f);
+        m->meterUsAvg.store(0.0f);
+        m->periodUs.store(0.0f);
+        m->resetReq.store(false);
+        m->limGrDb.store(0.0f);
+        m->limGrMaxDb.store(0.0f);
+        m->idle.store(false);
+        m->idleSinceNs.store(0);
+        m->clearReq.store(false);
+        m->wakeups.store(0);
+        m->idleWakeups.store(0);
+        m->savedNs.store(0);
+        m->activeUsAcc = 0.0f;
+        m->activeUsAvg.store(0.0f);
+    }
+    g.suspended.store(false);
+    g.suspendStartNs = 0;
+    g.suspends.store(0);
+    g.resumes.store(0);
+    g.lastResumeMs.store(0);
+    g.wakeupsAvoided.store(0);
+    g.suspendSavedNs.store(0);
+    g.tapA.clear();
+    g.tapB.clear();
+    spectrum_setup();
+    g.onsetQ.clear();
+    g.onset.reset(g.sr);
+    g.onsetDrops.store(0);
+    g.onsetGen.store(0);
+    g.onsetGenSeen = 0;
+    g.onsetCount.store(0);
+    g.tempoBpm.store(0.0f);
+    g.tempoConf.store(0.0f);
+    for (GlitchState* gs : { &g.glitchA, &g.glitchB }) {
+        gs->dropsSeen = 0;
+        gs->usAcc = 0.0f;
+        gs->usAvg.store(0.0f);
+    }
+    g.glitchResetReq.store(true);
+
+    for (DevClock* clk : { &g.clkA, &g.clkB }) {
+        clk->writePos.store(0);
+        clk->readPos.store(0);
+        clk->mediaPos.store(0);
+        clk->flushReq.store(false);
+        clk->queued.store(0);
+        clk->nextMedia = -1;
+        clk->stamps.clear();
+    }
+    g.transFromA.store(0); g.transToA.store(0);
+    g.transFromB.store(0); g.transToB.store(0);
 
     // --- Праймим буферы нулями ---
    {
@@ -314,6 +1674,7 @@ g.rbCapacityFrames = capacityFrames;
         ma_uint32 n = ma_min(capA, prime);
         if (pA && n) std::memset(pA, 0, n * bpf);
         ma_pcm_rb_commit_write(&g.rbA, n);
+        g.clkA.writePos.store(n);
     }
 
     // B
@@ -322,6 +1683,7 @@ g.rbCapacityFrames = capacityFrames;
         ma_uint32 n = ma_min(capB, prime);
         if (pB && n) std::memset(pB, 0, n * bpf);
         ma_pcm_rb_commit_write(&g.rbB, n);
+        g.clkB.writePos.store(n);
     }
 }
 
@@ -332,6 +1694,10 @@ g.rbCapacityFrames = capacityFrames;
 
     // СТАЛО
     g.running = true;
+    telemetry_open();
+    g.tmLastNs = 0;
+    g.analysisRun = true;
+    g.analysisThr = std::thread(analysis_loop);
     std::cerr << "[DualOutEngine] started A=[" << (aFound ? aResolved : "default")
             << "] B=[" << (bFound ? bResolved : "default")
             << "] @" << fmt.sr << "Hz ch=" << fmt.ch << "\n";
@@ -340,47 +1706,85 @@ g.rbCapacityFrames = capacityFrames;
 
 }
 
-bool DualOutEngine::write(const void* data, size_t frames, int64_t)
+// Метка часов — только если кусок не продолжает предыдущий (разрыв pts)
+static void stamp_write(DevClock& clk, int64_t media)
 {
-    if (!g.running) return false;
+    if (media < 0) return;
+    if (clk.nextMedia >= 0 && std::llabs(media - clk.nextMedia) <= 2) return;
+    clk.stamps.push(MediaStamp{ clk.writePos.load(std::memory_order_relaxed), media });
+}
 
-    const ma_uint32 inFrames = (ma_uint32)frames;        // входные кадры
-    const ma_uint32 bpf      = g.ch * sizeof(int16_t);   // bytes per frame
-    const uint8_t* srcBytes  = static_cast<const uint8_t*>(data);
+static void commit_write(DevClock& clk, int64_t media, ma_uint32 frames, ma_uint32 wrote)
+{
+    clk.writePos.fetch_add(wrote, std::memory_order_relaxed);
+    // часть потеряли — следующий write обязательно ставит свою метку
+    clk.nextMedia = (media >= 0 && wrote == frames) ? media + frames : -1;
+}
 
-    // --- Пишем в A ---
-    ma_uint32 remainingA = inFrames;
-    ma_uint32 wroteA = 0;
-    while (remainingA > 0) {
-        void* p = nullptr;
-        ma_uint32 capFrames = remainingA;
-        if (ma_pcm_rb_acquire_write(&g.rbA, &capFrames, &p) != MA_SUCCESS || capFrames == 0) {
-            break;  // буфер переполнен
+// Куски подряд в кольцо; вернёт, сколько кадров влезло (остальное — потери)
+static ma_uint32 ring_writev(ma_pcm_rb* rb, const DualOutSpan* spans, size_t count, ma_uint32 bpf)
+{
+    ma_uint32 wrote = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const uint8_t* src = static_cast<const uint8_t*>(spans[i].data);
+        ma_uint32 remaining = (ma_uint32)spans[i].frames;
+        while (remaining > 0) {
+            void* p = nullptr;
+            ma_uint32 capFrames = remaining;
+            if (ma_pcm_rb_acquire_write(rb, &capFrames, &p) != MA_SUCCESS || capFrames == 0) {
+                return wrote;  // буфер переполнен
+            }
+            std::memcpy(p, src, capFrames * bpf);
+            ma_pcm_rb_commit_write(rb, capFrames);
+            src       += capFrames * bpf;
+            wrote     += capFrames;
+            remaining -= capFrames;
         }
-        std::memcpy(p, srcBytes + wroteA * bpf, capFrames * bpf);
-        ma_pcm_rb_commit_write(&g.rbA, capFrames);
-        wroteA     += capFrames;
-        remainingA -= capFrames;
     }
+    return wrote;
+}
 
-    // --- Пишем в B ---
-    ma_uint32 remainingB = inFrames;
-    ma_uint32 wroteB = 0;
-    while (remainingB > 0) {
-        void* p = nullptr;
-        ma_uint32 capFrames = remainingB;
-        if (ma_pcm_rb_acquire_write(&g.rbB, &capFrames, &p) != MA_SUCCESS || capFrames == 0) {
-            break;  // буфер переполнен
-        }
-        std::memcpy(p, srcBytes + wroteB * bpf, capFrames * bpf);
-        ma_pcm_rb_commit_write(&g.rbB, capFrames);
-        wroteB     += capFrames;
-        remainingB -= capFrames;
-    }
+bool DualOutEngine::write(const void* data, size_t frames, int64_t pts100ns)
+{
+    const DualOutSpan span{ data, frames };
+    return writev(&span, 1, pts100ns);
+}
+
+bool DualOutEngine::writev(const DualOutSpan* spans, size_t count, int64_t pts100ns)
+{
+    if (!g.running) return false;
+
+    ma_uint32 inFrames = 0;                              // входные кадры
+    for (size_t i = 0; i < count; ++i) inFrames += (ma_uint32)spans[i].frames;
+    const ma_uint32 bpf      = g.ch * sizeof(int16_t);   // bytes per frame
+
+    // новые данные после EOS-маркера — конец потока отменяется
+    if (g.eosArmed.load(std::memory_order_relaxed)) clearEos();
+
+    // НОВОЕ: медиа-кадр начала этого куска (для часов устройств)
+    const int64_t media = pts100ns >= 0 ? pts100ns * (int64_t)g.sr / 10000000 : -1;
+    stamp_write(g.clkA, media);
+    stamp_write(g.clkB, media);
+
+    const ma_uint32 wroteA = ring_writev(&g.rbA, spans, count, bpf);
+    const ma_uint32 wroteB = ring_writev(&g.rbB, spans, count, bpf);
 
     g.framesSubmitted += inFrames;
+    g.ringBytesIn.fetch_add((uint64_t)(wroteA + wroteB) * bpf, std::memory_order_relaxed);
     if (wroteA < inFrames) g.dropA += (inFrames - wroteA);
     if (wroteB < inFrames) g.dropB += (inFrames - wroteB);
+    commit_write(g.clkA, media, inFrames, wroteA);
+    commit_write(g.clkB, media, inFrames, wroteB);
+    idle_resume();   // устройства стояли на простое — запускаем
+    if (media >= 0 && wroteA) {
+        const uint32_t gen = g.onsetGen.load(std::memory_order_acquire);
+        ma_uint32 off = 0;
+        for (size_t i = 0; i < count && off < wroteA; ++i) {
+            const ma_uint32 n = ma_min((ma_uint32)spans[i].frames, wroteA - off);
+            tap_push(g.onsetQ, g.onsetDrops, static_cast<const int16_t*>(spans[i].data), n, media + off, 0, gen);
+            off += n;
+        }
+    }
 
     auto now = std::chrono::steady_clock::now();
     if (g.lastStats == std::chrono::steady_clock::time_point{}) {
@@ -421,14 +1825,36 @@ bool DualOutEngine::write(const void* data, size_t frames, int64_t)
 }
 
 
+bool DualOutEngine::isRunning() const {
+    return g.running.load();
+}
+
+uint64_t DualOutEngine::ringBytesWritten() const {
+    return g.ringBytesIn.load(std::memory_order_relaxed);
+}
+
+size_t DualOutEngine::writableFrames() const {
+    if (!g.running.load()) return 0;
+    return std::min(ma_pcm_rb_available_write(&g.rbA), ma_pcm_rb_available_write(&g.rbB));
+}
+
 void DualOutEngine::drain(){ std::this_thread::sleep_for(std::chrono::milliseconds(50)); }
 
 // СТАЛО
 void DualOutEngine::stop()
 {
     if(g.running.exchange(false)){
-        ma_device_uninit(&g.devA);
-        ma_device_uninit(&g.devB);
+        // анализ (и idle_suspend в нём) — до uninit: он сам зовёт ma_device_stop
+        g.analysisRun = false;
+        if (g.analysisThr.joinable()) g.analysisThr.join();
+        {
+            // idle_resume из write() не должен стартовать устройство во время uninit
+            std::lock_guard<std::mutex> lk(g.suspendMtx);
+            g.suspended.store(false);
+            ma_device_uninit(&g.devA);
+            ma_device_uninit(&g.devB);
+        }
+        telemetry_publish(false);
         ma_pcm_rb_uninit(&g.rbA);
         ma_pcm_rb_uninit(&g.rbB);
         ma_context_uninit(&g.ctx);
@@ -437,30 +1863,303 @@ void DualOutEngine::stop()
 }
 
 
+// НОВОЕ: команда в оба колбэка (запись в очереди — под мьютексом управления,
+// колбэк читает без блокировок)
+static void push_params(const ParamCmd& a, const ParamCmd& b)
+{
+    std::lock_guard<std::mutex> lk(g.paramMtx);
+    if (!g.prmA.queue.push(a) || !g.prmB.queue.push(b)) {
+        std::cerr << "[DualOutEngine] param queue full, change dropped\n";
+    }
+}
+
+// Громкость в колбэки: A/B * master * нормализация. Только под paramMtx.
+static void push_gain_locked(int64_t atMediaFrame)
+{
+    ParamCmd a;
+    a.kind       = ParamKind::Gain;
+    a.rampFrames = g.paramRampFrames.load(std::memory_order_relaxed);
+    a.atMedia    = atMediaFrame;
+    ParamCmd b = a;
+    a.value = g.gainA * g.masterGain * g.trimGain;
+    b.value = g.gainB * g.masterGain * g.trimGain;
+    if (!g.prmA.queue.push(a) || !g.prmB.queue.push(b)) {
+        std::cerr << "[DualOutEngine] param queue full, change dropped\n";
+    }
+}
+
 // НОВОЕ: установка громкости в dB + master 0..1
-void DualOutEngine::setGainDb(float aDb, float bDb, float masterLinear) {
+void DualOutEngine::setGainDb(float aDb, float bDb, float masterLinear, int64_t atMediaFrame) {
     auto dbToLin = [](float db) -> float {
         return std::pow(10.0f, db / 20.0f);
     };
 
+    std::lock_guard<std::mutex> lk(g.paramMtx);
     g.gainA = dbToLin(aDb);
     g.gainB = dbToLin(bDb);
     g.masterGain = std::clamp(masterLinear, 0.0f, 1.0f);
+    push_gain_locked(atMediaFrame);
+}
+
+// НОВОЕ: нормализация громкости — отдельный множитель поверх setGainDb,
+// пользовательская громкость его не сбрасывает
+void DualOutEngine::setTrimDb(float db) {
+    std::lock_guard<std::mutex> lk(g.paramMtx);
+    g.trimGain = std::pow(10.0f, std::clamp(db, -40.0f, 20.0f) / 20.0f);
+    push_gain_locked(-1);
+}
+
+// НОВОЕ: задержка выхода. Рост — вставляем тишину, уменьшение — пропускаем кадры;
+// сам сдвиг делается в тишине между рампами вниз и вверх.
+void DualOutEngine::setDelayMs(int aMs, int bMs, int64_t atMediaFrame) {
+    const uint32_t sr = g.sr ? g.sr : 48000;
+    ParamCmd a;
+    a.kind       = ParamKind::Delay;
+    a.rampFrames = g.paramRampFrames.load(std::memory_order_relaxed);
+    a.atMedia    = atMediaFrame;
+    ParamCmd b = a;
+    a.delayFrames = (int32_t)((int64_t)std::max(0, aMs) * sr / 1000);
+    b.delayFrames = (int32_t)((int64_t)std::max(0, bMs) * sr / 1000);
+    push_params(a, b);
 }
 
-// НОВОЕ: пока задержку не используем — заглушка
-void DualOutEngine::setDelayMs(int, int) {
-    // можно реализовать позже, сейчас просто чтобы был body
+// НОВОЕ: лимитер выхода. Выключен — перегрузка режется насыщением, как раньше
+void DualOutEngine::setLimiter(bool on, float ceilingDbTp) {
+    ceilingDbTp = std::min(0.0f, std::max(-12.0f, ceilingDbTp));
+    g.limiterCeil.store(std::pow(10.0f, ceilingDbTp / 20.0f) * 32768.0f, std::memory_order_relaxed);
+    g.limiterOn.store(on, std::memory_order_relaxed);
+}
+
+// НОВОЕ: остановка устройств после ms простоя (0 — не останавливать)
+void DualOutEngine::setIdleSuspendMs(int ms) {
+    g.idleSuspendMs.store(std::max(0, ms), std::memory_order_relaxed);
+    if (ms <= 0 && g.running.load()) idle_resume();
+}
+
+bool DualOutEngine::getIdleStats(DualOutIdleStats& out) const {
+    out = DualOutIdleStats{};
+    if (!g.running.load(std::memory_order_relaxed)) return false;
+    out.idleA     = g.mtA.idle.load(std::memory_order_relaxed);
+    out.idleB     = g.mtB.idle.load(std::memory_order_relaxed);
+    out.suspended = g.suspended.load(std::memory_order_relaxed);
+    uint64_t savedNs = g.suspendSavedNs.load(std::memory_order_relaxed);
+    for (const DevMeter* m : { &g.mtA, &g.mtB }) {
+        out.wakeups     += m->wakeups.load(std::memory_order_relaxed);
+        out.idleWakeups += m->idleWakeups.load(std::memory_order_relaxed);
+        savedNs         += m->savedNs.load(std::memory_order_relaxed);
+    }
+    out.wakeupsAvoided = g.wakeupsAvoided.load(std::memory_order_relaxed);
+    out.suspends       = g.suspends.load(std::memory_order_relaxed);
+    out.resumes        = g.resumes.load(std::memory_order_relaxed);
+    out.lastResumeMs   = g.lastResumeMs.load(std::memory_order_relaxed);
+    out.cpuSavedMs     = (double)savedNs / 1e6;
+    return true;
+}
+
+void DualOutEngine::setParamRampMs(int ms) {
+    const uint32_t sr = g.sr ? g.sr : 48000;
+    g.paramRampFrames.store((uint32_t)std::max(0, ms) * sr / 1000, std::memory_order_relaxed);
 }
 
 // НОВОЕ: очистка очередей (для seek)
 void DualOutEngine::flush() {
     if (!g.running.load()) return;
-    ma_pcm_rb_reset(&g.rbA);
-    ma_pcm_rb_reset(&g.rbB);
+    cancelSplice();
+    g.spA.cancel.store(true, std::memory_order_release);
+    g.spB.cancel.store(true, std::memory_order_release);
+    g.clkA.nextMedia = -1;
+    g.clkB.nextMedia = -1;
+
+    // Очередь выбрасывают сами колбэки (ринг остаётся один-писатель/один-читатель);
+    // ждём не дольше пары периодов
+    g.clkA.flushReq.store(true, std::memory_order_release);
+    g.clkB.flushReq.store(true, std::memory_order_release);
+    g.onsetGen.fetch_add(1, std::memory_order_acq_rel);
+    // на простое колбэки не идут — ждать нечего
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::milliseconds(g.suspended.load() ? 0 : 100);
+    while ((g.clkA.flushReq.load() || g.clkB.flushReq.load()) &&
+           std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // Колбэк не ответил — чистим сами, но только на стоящем устройстве:
+    // иначе ринг читают двое. Идущее (медленный колбэк) сначала
+    // останавливаем — ma_device_stop дожидается конца колбэка — и запускаем
+    // снова. Под suspendMtx: простой не трогает устройства, пока чистим.
+    std::lock_guard<std::mutex> lk(g.suspendMtx);
+    for (DevClock* clk : { &g.clkA, &g.clkB }) {
+        if (!clk->flushReq.load()) continue;
+        ma_device* dev = (clk == &g.clkA) ? &g.devA : &g.devB;
+        const bool started = ma_device_is_started(dev);
+        if (started) ma_device_stop(dev);
+        // колбэк мог успеть сам, пока останавливали
+        if (clk->flushReq.load()) {
+            ma_pcm_rb* rb = (clk == &g.clkA) ? &g.rbA : &g.rbB;
+            ma_pcm_rb_reset(rb);
+            clk->readPos.store(clk->writePos.load());
+            clk->stamps.clear();
+            release_pending_params((clk == &g.clkA) ? g.prmA : g.prmB);
+            clk->flushReq.store(false);
+        }
+        if (started && ma_device_start(dev) != MA_SUCCESS) {
+            std::cerr << "[DualOutEngine] flush: device restart failed\n";
+        }
+    }
+}
+
+// НОВОЕ: splice для seek с кроссфейдом
+bool DualOutEngine::splice(const void* data, size_t frames, int64_t pts100ns, int xfadeMs) {
+    if (!g.running.load() || !data || frames == 0) return false;
+    // предыдущий splice ещё не подхвачен обоими устройствами
+    if (splicePending()) return false;
+
+    // Пишем в буфер, который сейчас никто не читает: колбэки, подхватившие
+    // прошлый splice, уже бросили позапрошлый буфер.
+    const uint32_t idx = g.spliceIdx ^ 1u;
+    const uint32_t n   = (uint32_t)std::min<size_t>(frames, g.spliceCapFrames);
+    std::memcpy(g.spliceBuf[idx].data(), data, (size_t)n * g.ch * sizeof(int16_t));
+
+    uint32_t xfade = (uint32_t)std::max(0, xfadeMs) * g.sr / 1000;
+    g.spliceXfadeFrames = std::min(xfade, g.spliceMaxXfade);
+    g.spliceFrames = n;
+    g.spliceIdx    = idx;
+    g.spliceMedia  = pts100ns >= 0 ? pts100ns * (int64_t)g.sr / 10000000 : 0;
+    // первый write после splice всегда ставит метку часов
+    g.clkA.nextMedia = -1;
+    g.clkB.nextMedia = -1;
+
+    g.spA.pending.store(true, std::memory_order_release);
+    g.spB.pending.store(true, std::memory_order_release);
+    idle_resume();
+    // старое аудио уйдёт в fade-out — его атаки больше не интересны
+    const uint32_t gen = g.onsetGen.fetch_add(1, std::memory_order_acq_rel) + 1;
+    tap_push(g.onsetQ, g.onsetDrops, static_cast<const int16_t*>(data), n, g.spliceMedia, 0, gen);
+    return true;
 }
-void DualOutEngine::setSwapLR(bool v) {
-    g.swapLR.store(v, std::memory_order_relaxed);
+
+bool DualOutEngine::splicePending() const {
+    return g.spA.pending.load(std::memory_order_acquire) ||
+           g.spB.pending.load(std::memory_order_acquire);
+}
+
+bool DualOutEngine::cancelSplice() {
+    bool expected = true;
+    bool a = g.spA.pending.compare_exchange_strong(expected, false, std::memory_order_acq_rel);
+    expected = true;
+    bool b = g.spB.pending.compare_exchange_strong(expected, false, std::memory_order_acq_rel);
+    return a || b;
+}
+
+size_t DualOutEngine::spliceCapacityFrames() const {
+    return g.spliceCapFrames;
+}
+
+int64_t DualOutEngine::lastSpliceAudibleNs() const {
+    return std::max(g.spA.ackNs.load(std::memory_order_relaxed),
+                    g.spB.ackNs.load(std::memory_order_relaxed));
+}
+void DualOutEngine::setSwapLR(bool v, int64_t atMediaFrame) {
+    ParamCmd c;
+    c.kind       = ParamKind::Swap;
+    c.value      = v ? 1.0f : 0.0f;
+    c.rampFrames = g.paramRampFrames.load(std::memory_order_relaxed);
+    c.atMedia    = atMediaFrame;
+    push_params(c, c);
+}
+
+int64_t DualOutEngine::mediaFrameA() const {
+    return g.clkA.mediaPos.load(std::memory_order_relaxed);
+}
+
+int64_t DualOutEngine::mediaFrameB() const {
+    return g.clkB.mediaPos.load(std::memory_order_relaxed);
+}
+
+DualOutCursor DualOutEngine::writeCursor() const {
+    DualOutCursor c;
+    c.a = g.clkA.writePos.load(std::memory_order_relaxed);
+    c.b = g.clkB.writePos.load(std::memory_order_relaxed);
+    return c;
+}
+
+bool DualOutEngine::cursorPlayed(const DualOutCursor& c) const {
+    return g.clkA.readPos.load(std::memory_order_relaxed) >= c.a &&
+           g.clkB.readPos.load(std::memory_order_relaxed) >= c.b;
+}
+
+void DualOutEngine::markTransition(const DualOutCursor& from, const DualOutCursor& to) {
+    // to — первым: пока пишем, старый отрезок не станет длиннее
+    g.transToA.store(0, std::memory_order_relaxed);
+    g.transToB.store(0, std::memory_order_relaxed);
+    g.transFromA.store(from.a, std::memory_order_relaxed);
+    g.transFromB.store(from.b, std::memory_order_relaxed);
+    g.transToA.store(to.a, std::memory_order_release);
+    g.transToB.store(to.b, std::memory_order_release);
+}
+
+float DualOutEngine::transitionProgress(int dev) const {
+    const bool isA = dev == 0;
+    const uint64_t to   = (isA ? g.transToA : g.transToB).load(std::memory_order_acquire);
+    const uint64_t from = (isA ? g.transFromA : g.transFromB).load(std::memory_order_relaxed);
+    const uint64_t rp   = (isA ? g.clkA : g.clkB).readPos.load(std::memory_order_relaxed);
+    if (to <= from || rp < from || rp >= to) return -1.0f;
+    return (float)(rp - from) / (float)(to - from);
+}
+
+// НОВОЕ: EOS-маркер
+void DualOutEngine::markEos() {
+    g.eosReached.store(false, std::memory_order_relaxed);
+    g.eosDoneA.store(false, std::memory_order_relaxed);
+    g.eosDoneB.store(false, std::memory_order_relaxed);
+    g.eosArmed.store(true, std::memory_order_release);
+}
+
+void DualOutEngine::clearEos() {
+    g.eosArmed.store(false, std::memory_order_release);
+    g.eosDoneA.store(false, std::memory_order_relaxed);
+    g.eosDoneB.store(false, std::memory_order_relaxed);
+    g.eosReached.store(false, std::memory_order_relaxed);
+}
+
+bool DualOutEngine::eosReached() const {
+    return g.eosArmed.load(std::memory_order_acquire) &&
+           g.eosReached.load(std::memory_order_acquire);
+}
+
+// НОВОЕ: watermarks
+void DualOutEngine::setWatermarksMs(int lowMs, int highMs) {
+    const uint32_t sr = g.sr ? g.sr : 48000;
+    const uint32_t cap = g.rbCapacityFrames ? g.rbCapacityFrames : sr * 2;
+    uint32_t low  = (uint32_t)std::max(0, lowMs)  * sr / 1000;
+    uint32_t high = (uint32_t)std::max(0, highMs) * sr / 1000;
+    high = std::min(high, cap);
+    low  = std::min(low, high);
+    g.lowWaterFrames.store(low, std::memory_order_relaxed);
+    g.highWaterFrames.store(high, std::memory_order_relaxed);
+}
+
+void DualOutEngine::armWatermarks(bool on) {
+    g.watermarksArmed.store(on, std::memory_order_relaxed);
+}
+
+void DualOutEngine::getBufferingStats(DualOutBufferingStats& out) const {
+    out.buffering      = g.running.load() && g.buffering.load();
+    out.stalls         = g.stalls.load(std::memory_order_relaxed);
+    out.lastStallMs    = g.lastStallMs.load(std::memory_order_relaxed);
+    out.totalStallMs   = g.totalStallMs.load(std::memory_order_relaxed);
+    out.currentStallMs = out.buffering
+        ? (int)((steady_now_ns() - g.stallStartNs.load(std::memory_order_relaxed)) / 1000000) : 0;
+
+    const uint32_t high = g.highWaterFrames.load(std::memory_order_relaxed);
+    const uint32_t ref  = high ? high : g.rbCapacityFrames;
+    if (!g.running.load() || ref == 0) {
+        out.fillPct = 0;
+        return;
+    }
+    const ma_uint32 qA = ma_pcm_rb_available_read(&g.rbA);
+    const ma_uint32 qB = ma_pcm_rb_available_read(&g.rbB);
+    out.fillPct = (int)std::min<uint64_t>(100, (uint64_t)std::min(qA, qB) * 100 / ref);
 }
 
 int DualOutEngine::queueMsA() const {
@@ -484,17 +2183,166 @@ int DualOutEngine::driftMsAB() const {
     return qa - qb;
 }
 
-// НОВОЕ: отдать последние уровни (0..1), если движок запущен
+// НОВОЕ: отдать последние уровни (0..1), если движок запущен.
+// Старый интерфейс: первые два канала устройства A.
 bool DualOutEngine::getLevels(float& rmsL, float& rmsR, float& peakL, float& peakR) const {
     if (!g.running.load(std::memory_order_relaxed)) {
         rmsL = rmsR = peakL = peakR = 0.0f;
         return false;
     }
-    rmsL  = g.lastRmsL.load(std::memory_order_relaxed);
-    rmsR  = g.lastRmsR.load(std::memory_order_relaxed);
-    peakL = g.lastPeakL.load(std::memory_order_relaxed);
-    peakR = g.lastPeakR.load(std::memory_order_relaxed);
+    if (g.mtA.idle.load(std::memory_order_relaxed)) {
+        rmsL = rmsR = peakL = peakR = 0.0f;
+        return true;
+    }
+    const uint32_t r = g.mtA.channels.load(std::memory_order_relaxed) > 1 ? 1 : 0;
+    rmsL  = g.mtA.outRms[0].load(std::memory_order_relaxed);
+    rmsR  = g.mtA.outRms[r].load(std::memory_order_relaxed);
+    peakL = g.mtA.outPeak[0].load(std::memory_order_relaxed);
+    peakR = g.mtA.outPeak[r].load(std::memory_order_relaxed);
+    return true;
+}
+
+bool DualOutEngine::getMeters(int dev, DualOutDeviceMeters& out) const {
+    out = DualOutDeviceMeters{};
+    if (!g.running.load(std::memory_order_relaxed) || (dev != 0 && dev != 1)) {
+        return false;
+    }
+    const DevMeter& m = dev == 0 ? g.mtA : g.mtB;
+    out.channels = m.channels.load(std::memory_order_relaxed);
+    // в простое метры не обновляются — отдаём тишину, а не последний уровень
+    const bool idle = m.idle.load(std::memory_order_relaxed);
+    for (uint32_t c = 0; c < out.channels; ++c) {
+        out.ch[c].rms   = idle ? 0.0f : m.outRms[c].load(std::memory_order_relaxed);
+        out.ch[c].peak  = idle ? 0.0f : m.outPeak[c].load(std::memory_order_relaxed);
+        out.ch[c].hold  = idle ? 0.0f : m.outHold[c].load(std::memory_order_relaxed);
+        out.ch[c].clips = m.clips[c].load(std::memory_order_relaxed);
+    }
+    out.cbUsAvg    = m.cbUsAvg.load(std::memory_order_relaxed);
+    out.cbUsMax    = m.cbUsMax.load(std::memory_order_relaxed);
+    out.meterUsAvg = m.meterUsAvg.load(std::memory_order_relaxed);
+    out.periodUs   = m.periodUs.load(std::memory_order_relaxed);
+    out.tapUsAvg   = m.tapUsAvg.load(std::memory_order_relaxed);
+    out.tapDrops   = m.tapDrops.load(std::memory_order_relaxed);
+    out.tapped     = g.tapOn.load(std::memory_order_relaxed);
+    out.limiterDb    = m.limGrDb.load(std::memory_order_relaxed);
+    out.limiterMaxDb = m.limGrMaxDb.load(std::memory_order_relaxed);
+    out.limiterOn    = g.limiterOn.load(std::memory_order_relaxed);
     return true;
 }
 
+bool DualOutEngine::getSpectrum(DualOutSpectrum& out) const {
+    if (!g.running.load(std::memory_order_relaxed)) {
+        out = DualOutSpectrum{};
+        return false;
+    }
+    std::lock_guard<std::mutex> lk(g.spec.mtx);
+    out = g.spec.out;
+    return true;
+}
+
+void DualOutEngine::setOnsetSink(std::function<void(const DualOutOnset&)> sink) {
+    std::lock_guard<std::mutex> lk(g.onsetMtx);
+    g.onsetSink = std::move(sink);
+}
+
+void DualOutEngine::setPlayerState(int state) {
+    g.playerState.store(state, std::memory_order_relaxed);
+}
+
+std::wstring DualOutEngine::telemetryName() const {
+    return g.tmName;
+}
+
+void DualOutEngine::setOutputLatencyMs(int extraMs) {
+    g.extraLatencyMs.store(std::max(0, extraMs), std::memory_order_relaxed);
+}
+
+int DualOutEngine::outputLatencyMs() const {
+    if (!g.running.load(std::memory_order_relaxed)) return 0;
+    return (int)(output_latency_ns() / 1000000);
+}
+
+bool DualOutEngine::getTempo(float& bpm, float& confidence, uint64_t& onsets) const {
+    bpm        = g.tempoBpm.load(std::memory_order_relaxed);
+    confidence = g.tempoConf.load(std::memory_order_relaxed);
+    onsets     = g.onsetCount.load(std::memory_order_relaxed);
+    return g.running.load(std::memory_order_relaxed);
+}
+
+// НОВОЕ: метры в фоновом потоке (по умолчанию) или прямо в колбэке —
+// чтобы сравнить цену колбэка с тапом и без
+void DualOutEngine::setAnalysisTap(bool on) {
+    g.tapOn.store(on, std::memory_order_relaxed);
+}
+
+void DualOutEngine::resetMeters() {
+    for (DevMeter* m : { &g.mtA, &g.mtB }) {
+        for (uint32_t c = 0; c < kDualOutMeterMaxCh; ++c) {
+            m->clips[c].store(0, std::memory_order_relaxed);
+        }
+        m->cbUsMax.store(0.0f, std::memory_order_relaxed);
+        m->limGrMaxDb.store(0.0f, std::memory_order_relaxed);
+        m->resetReq.store(true, std::memory_order_release);   // hold сбросит колбэк
+    }
+    for (GlitchState* gs : { &g.glitchA, &g.glitchB }) {
+        for (auto& c : gs->count) c.store(0, std::memory_order_relaxed);
+    }
+    std::lock_guard<std::mutex> lk(g.spec.mtx);
+    g.spec.out.usMax = 0.0f;
+}
+
+// НОВОЕ: детектор артефактов; при включении история детекторов сбрасывается
+void DualOutEngine::setGlitchDetect(bool on) {
+    if (on && !g.glitchOn.load(std::memory_order_relaxed)) {
+        g.glitchResetReq.store(true, std::memory_order_release);
+    }
+    g.glitchOn.store(on, std::memory_order_relaxed);
+}
+
+void DualOutEngine::setGlitchLog(const std::wstring& path) {
+    std::lock_guard<std::mutex> lk(g.glitchMtx);
+    if (g.glitchLog.is_open()) g.glitchLog.close();
+    g.glitchLogPath = path;
+    g.glitchLogSize = 0;
+    if (path.empty()) return;
+    const std::filesystem::path p(path);
+    std::error_code ec;
+    const uintmax_t have = std::filesystem::file_size(p, ec);
+    g.glitchLog.open(p, std::ios::binary | std::ios::app);
+    if (!g.glitchLog) {
+        std::cerr << "[DualOutEngine] cannot open glitch log\n";
+        return;
+    }
+    g.glitchLogSize = ec ? 0 : (uint64_t)have;
+    char head[96];
+    const int n = std::snprintf(head, sizeof(head), "# session pid=%lu sr=%u ch=%u\n",
+                                process_id(), g.sr, g.ch);
+    if (n > 0) {
+        g.glitchLog.write(head, n);
+        g.glitchLog.flush();
+        g.glitchLogSize += (uint64_t)n;
+    }
+}
+
+bool DualOutEngine::getGlitchStats(int dev, DualOutGlitchStats& out) const {
+    if (dev < 0 || dev > 1) return false;
+    const GlitchState& gs = dev ? g.glitchB : g.glitchA;
+    out.enabled         = g.glitchOn.load(std::memory_order_relaxed) && g.tapOn.load(std::memory_order_relaxed);
+    out.discontinuities = gs.count[GlitchDetector::Discontinuity].load(std::memory_order_relaxed);
+    out.gaps            = gs.count[GlitchDetector::Gap].load(std::memory_order_relaxed);
+    out.clipBursts      = gs.count[GlitchDetector::ClipBurst].load(std::memory_order_relaxed);
+    out.underruns       = gs.count[GlitchDetector::Underrun].load(std::memory_order_relaxed);
+    out.usAvg           = gs.usAvg.load(std::memory_order_relaxed);
+    return true;
+}
+
+// События с seq > afterSeq, что ещё лежат в кольце (последние kGlitchRing)
+void DualOutEngine::getGlitches(uint64_t afterSeq, std::vector<DualOutGlitch>& out) const {
+    std::lock_guard<std::mutex> lk(g.glitchMtx);
+    const uint64_t first = std::max<uint64_t>(afterSeq + 1, g.glitchSeq > kGlitchRing ? g.glitchSeq - kGlitchRing + 1 : 1);
+    for (uint64_t s = first; s <= g.glitchSeq; ++s) {
+        out.push_back(g.glitchRing[(s - 1) % kGlitchRing]);
+    }
+}
+
 
@@ -1,28 +1,221 @@
 #pragma once
 #include <string>
 #include <cstdint>
+#include <functional>
+#include <vector>
 
 struct DualOutFormat { uint32_t sr, ch, bps; };
 
+// НОВОЕ: состояние буферизации (watermarks)
+struct DualOutBufferingStats {
+  bool     buffering;       // сейчас выход заглушён и ждём high watermark
+  int      fillPct;         // заполнение относительно high watermark, 0..100
+  uint32_t stalls;          // сколько раз падали ниже low
+  int      currentStallMs;  // длительность текущей остановки (0, если играем)
+  int      lastStallMs;
+  int64_t  totalStallMs;
+};
+
+// НОВОЕ: метры выхода (0..1, после gain/swap), по каждому каналу
+constexpr uint32_t kDualOutMeterMaxCh = 8;
+struct DualOutChannelMeter {
+  float    rms;    // VU: среднеквадратичное, интеграция ~300 мс
+  float    peak;   // PPM: мгновенная атака, спад 20 дБ за 1.7 с
+  float    hold;   // пик с удержанием 1.5 с
+  uint32_t clips;  // сэмплов на полной шкале с последнего resetMeters()
+};
+struct DualOutDeviceMeters {
+  uint32_t channels;
+  DualOutChannelMeter ch[kDualOutMeterMaxCh];
+  float cbUsAvg;     // время колбэка, мкс (скользящее среднее)
+  float cbUsMax;     // максимум с последнего resetMeters()
+  float meterUsAvg;  // цена метров на блок (в колбэке или в потоке анализа)
+  float periodUs;    // бюджет колбэка — длительность блока
+  float tapUsAvg;    // из времени колбэка — копия блока в анализ-тап
+  uint32_t tapDrops; // блоков, не влезших в тап (поток анализа не успевал)
+  bool  tapped;      // метры считаются в фоновом потоке, а не в колбэке
+  float limiterDb;    // НОВОЕ: ослабление лимитера в последнем блоке, дБ (<= 0)
+  float limiterMaxDb; // максимум ослабления с последнего resetMeters()
+  bool  limiterOn;
+};
+
+// НОВОЕ: спектр выхода A — лог-полосы, 60 кадров в секунду
+constexpr uint32_t kDualOutSpectrumBands = 32;
+struct DualOutSpectrum {
+  float    bandsDb[kDualOutSpectrumBands];  // энергия полосы, дБFS (снизу -120)
+  float    bandHz[kDualOutSpectrumBands];   // центр полосы, Гц
+  int64_t  media;   // медиа-кадр конца окна анализа
+  uint64_t frames;  // сколько кадров анализа посчитано
+  float    usAvg;   // цена одного кадра анализа (окно + БПФ + полосы), мкс
+  float    usMax;   // максимум с последнего resetMeters()
+};
+
+// НОВОЕ: атака (onset), найденная по записанному аудио до того, как оно
+// прозвучало. Время — по часам воспроизведения A, с задержкой устройства.
+struct DualOutOnset {
+  int64_t media;         // медиа-кадр атаки
+  int64_t presentNs;     // steady_clock: когда атака прозвучит на A (оценка)
+  int     inMs;          // сколько мс до этого на момент события (<0 — уже прозвучала)
+  float   strength;      // 0..1
+  float   bpm;           // текущая оценка темпа (0 — ещё нет)
+  float   bpmConfidence; // 0..1
+};
+
+// НОВОЕ: детектор артефактов выхода ("треск"): разрывы сигнала, провалы
+// тишины посреди звука, серии клипа, недоборы очереди. Считается в потоке
+// анализа по тапу, по каждому устройству отдельно.
+enum DualOutGlitchKind {
+  DUALOUT_GLITCH_DISCONTINUITY = 0,
+  DUALOUT_GLITCH_GAP,
+  DUALOUT_GLITCH_CLIP_BURST,
+  DUALOUT_GLITCH_UNDERRUN
+};
+struct DualOutGlitch {
+  uint64_t seq;     // сквозной номер события (с 1)
+  int      dev;     // 0 = A, 1 = B
+  int      kind;    // DualOutGlitchKind
+  int      ch;      // канал, -1 — устройство целиком
+  float    value;   // разрыв: скачок, доля FS; провал/недобор: мс; клип: сэмплов подряд
+  int64_t  media;   // медиа-кадр начала события
+  int64_t  wallMs;  // system_clock, мс от эпохи — когда ушло на устройство
+};
+struct DualOutGlitchStats {
+  bool     enabled;          // детектор включён и тап работает
+  uint32_t discontinuities;
+  uint32_t gaps;
+  uint32_t clipBursts;
+  uint32_t underruns;
+  float    usAvg;            // цена детектора на блок тапа, мкс
+};
+
+// НОВОЕ: простой выходов (с init())
+struct DualOutIdleStats {
+  bool     idleA, idleB;     // тишина > 1 с: колбэк отдаёт нули без обработки
+  bool     suspended;        // устройства остановлены до следующего write()
+  uint64_t wakeups;          // колбэков A+B
+  uint64_t idleWakeups;      // из них в простое
+  uint64_t wakeupsAvoided;   // колбэков, которых не было из-за остановки
+  uint32_t suspends, resumes;
+  int      lastResumeMs;     // сколько занял последний запуск устройств
+  double   cpuSavedMs;       // оценка: против колбэка с полной обработкой
+};
+
+// НОВОЕ: кусок для writev() — кадры s16 interleaved в формате движка
+struct DualOutSpan {
+  const void* data;
+  size_t      frames;
+};
+
+// НОВОЕ: место на ленте движка — сколько кадров положено в кольцо каждого
+// устройства с init()
+struct DualOutCursor {
+  uint64_t a = 0, b = 0;
+};
+
 class DualOutEngine {
 public:
   bool init(const std::wstring& devA, const std::wstring& devB, DualOutFormat fmt, bool exclusive=false);
   bool write(const void* pcmInterleaved, size_t frames, int64_t pts100ns);
+  // НОВОЕ: write() из нескольких кусков подряд (pts — начало первого), каждый
+  // копируется прямо в кольца, без склейки в промежуточный буфер
+  bool writev(const DualOutSpan* spans, size_t count, int64_t pts100ns);
+  uint64_t ringBytesWritten() const;  // байт, скопированных write()/writev() в кольца A+B с init()
+  bool isRunning() const;
+  size_t writableFrames() const; // сколько кадров write() примет без потерь (min по A/B)
 
-  void setDelayMs(int a, int b);
-  void setGainDb(float a, float b, float master);
+  // Параметры уходят в колбэки через lock-free очередь и применяются
+  // плавно (рампа setParamRampMs). atMediaFrame >= 0 — применить, когда
+  // зазвучит этот медиа-кадр (кадры на частоте движка, по pts из write()).
+  void setDelayMs(int a, int b, int64_t atMediaFrame = -1);
+  void setGainDb(float a, float b, float master, int64_t atMediaFrame = -1);
+  void setTrimDb(float db); // НОВОЕ: нормализация громкости, умножается на setGainDb
+  // НОВОЕ: look-ahead лимитер по true-peak на каждом выходе (по умолчанию
+  // включён, -1 dBTP). Работает, пока итоговый gain > 1; задержка ~1 мс
+  // входит в outputLatencyMs().
+  void setLimiter(bool on, float ceilingDbTp = -1.0f);
+  void setParamRampMs(int ms);
+  // НОВОЕ: после ms тишины на обоих выходах (и пустых очередях) устройства
+  // останавливаются; write()/splice() запускают их снова. 0 — не останавливать.
+  void setIdleSuspendMs(int ms);
+  bool getIdleStats(DualOutIdleStats& out) const;
 
   void drain();
   void stop();
   void flush(); // НОВОЕ
 
+  // НОВОЕ: бесшовная подмена очереди (seek без провала).
+  // Старое аудио продолжает играть, пока колбэки A/B не подхватят новый
+  // кусок: тогда хвост старого уходит в fade-out, остаток очереди
+  // выбрасывается, а новый кусок (до spliceCapacityFrames) звучит с fade-in.
+  // Пока splicePending() == true, write() звать нельзя.
+  bool splice(const void* pcmInterleaved, size_t frames, int64_t pts100ns, int xfadeMs);
+  bool splicePending() const;
+  bool cancelSplice();                 // true, если колбэки ещё не подхватили
+  size_t spliceCapacityFrames() const;
+  int64_t lastSpliceAudibleNs() const; // steady_clock, когда новое аудио пошло на оба устройства
+
+  // НОВОЕ: маркер конца потока. markEos() ставится после последнего write();
+  // eosReached() станет true, когда последний кадр уйдёт на оба устройства.
+  // Любой новый write() или clearEos() маркер снимает.
+  void markEos();
+  void clearEos();
+  bool eosReached() const;
+
+  // НОВОЕ: watermarks. Если очередь любого устройства падает ниже low,
+  // оба выхода плавно глушатся (данные не тратятся), пока обе очереди не
+  // наберут high. Работает только пока armWatermarks(true) — т.е. пока
+  // плеер реально кормит движок (не в паузе и не после EOS).
+  void setWatermarksMs(int lowMs, int highMs);
+  void armWatermarks(bool on);
+  void getBufferingStats(DualOutBufferingStats& out) const;
+
   int queueMsA() const;
   int queueMsB() const;
   int driftMsAB() const;
 
+  // НОВОЕ: медиа-позиция того, что сейчас уходит на устройство (кадры)
+  int64_t mediaFrameA() const;
+  int64_t mediaFrameB() const;
+
+  // НОВОЕ: лента движка. writeCursor() — куда ляжет следующий write();
+  // cursorPlayed(c) — оба устройства уже забрали всё, что было до c (flush и
+  // splice выбрасывают очередь — метки в ней тоже считаются пройденными).
+  DualOutCursor writeCursor() const;
+  bool cursorPlayed(const DualOutCursor& c) const;
+  // НОВОЕ: переход между элементами (кроссфейд плеера) на ленте, [from, to).
+  // transitionProgress(dev) — доля уже прозвучавшего на устройстве (0 = A,
+  // 1 = B), -1 — сейчас звучит не переход. Новый переход заменяет старый.
+  void markTransition(const DualOutCursor& from, const DualOutCursor& to);
+  float transitionProgress(int dev) const;
+
   // НОВОЕ: получить последние уровни (нормированные 0..1)
   bool getLevels(float& rmsL, float& rmsR, float& peakL, float& peakR) const;
+  // НОВОЕ: метры устройства (0 = A, 1 = B) по всем каналам + цена колбэка
+  bool getMeters(int dev, DualOutDeviceMeters& out) const;
+  void resetMeters(); // счётчики клипов, peak hold, максимум колбэка
+  void setAnalysisTap(bool on); // анализ в фоне через тап (по умолчанию) или в колбэке
+  bool getSpectrum(DualOutSpectrum& out) const; // считается в потоке анализа, только с тапом
+
+  // НОВОЕ: атаки и темп. sink зовётся из потока анализа (не из колбэка).
+  void setOnsetSink(std::function<void(const DualOutOnset&)> sink);
+  void setOutputLatencyMs(int extraMs); // добавка к задержке A, которую не видно драйверу (Bluetooth)
+  int  outputLatencyMs() const;         // буфер устройства A + добавка
+  bool getTempo(float& bpm, float& confidence, uint64_t& onsets) const;
+
+  // НОВОЕ: детектор артефактов (по умолчанию выключен). События копятся в
+  // кольце в памяти и, если задан путь, в текстовом логе с ротацией
+  // (path -> path.1 после 1 МБ) — его прикладывают к баг-репортам.
+  void setGlitchDetect(bool on);
+  void setGlitchLog(const std::wstring& path);  // пусто — без файла
+  bool getGlitchStats(int dev, DualOutGlitchStats& out) const;
+  void getGlitches(uint64_t afterSeq, std::vector<DualOutGlitch>& out) const;
+
+  // НОВОЕ: телеметрия в общей памяти (dualout_telemetry.h), ~60 Гц.
+  // Состояние плеера (DUALOUT_TM_*) сообщает плеер; buffering/ended движок
+  // подставляет сам.
+  void setPlayerState(int state);
+  std::wstring telemetryName() const;   // пусто, если mapping не создан
 
   // === NEW: reverse stereo channels ===
-  void setSwapLR(bool v);
+  void setSwapLR(bool v, int64_t atMediaFrame = -1);
 };
@@ -0,0 +1,71 @@
+#include "Fft.h"
+#include <cmath>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define DUALOUT_FFT_SSE 1
+#endif
+
+Fft::Fft(uint32_t n) : n_(n), rev_(n), twRe_(n > 1 ? n - 1 : 1), twIm_(n > 1 ? n - 1 : 1)
+{
+    uint32_t bits = 0;
+    while ((1u << bits) < n) ++bits;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; ++b) r |= ((i >> b) & 1u) << (bits - 1 - b);
+        rev_[i] = r;
+    }
+    const double pi = 3.14159265358979323846;
+    for (uint32_t half = 1; half < n; half <<= 1) {
+        for (uint32_t j = 0; j < half; ++j) {
+            const double a = -pi * (double)j / (double)half;
+            twRe_[half - 1 + j] = (float)std::cos(a);
+            twIm_[half - 1 + j] = (float)std::sin(a);
+        }
+    }
+}
+
+void Fft::forward(float* re, float* im) const
+{
+    for (uint32_t i = 0; i < n_; ++i) {
+        const uint32_t j = rev_[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (uint32_t half = 1; half < n_; half <<= 1) {
+        const float* wr = &twRe_[half - 1];
+        const float* wi = &twIm_[half - 1];
+        for (uint32_t k = 0; k < n_; k += 2 * half) {
+            float* ar = re + k;
+            float* ai = im + k;
+            float* br = re + k + half;
+            float* bi = im + k + half;
+            uint32_t j = 0;
+#ifdef DUALOUT_FFT_SSE
+            for (; j + 4 <= half; j += 4) {
+                const __m128 xwr = _mm_loadu_ps(wr + j), xwi = _mm_loadu_ps(wi + j);
+                const __m128 xbr = _mm_loadu_ps(br + j), xbi = _mm_loadu_ps(bi + j);
+                const __m128 xar = _mm_loadu_ps(ar + j), xai = _mm_loadu_ps(ai + j);
+                const __m128 tr = _mm_sub_ps(_mm_mul_ps(xwr, xbr), _mm_mul_ps(xwi, xbi));
+                const __m128 ti = _mm_add_ps(_mm_mul_ps(xwr, xbi), _mm_mul_ps(xwi, xbr));
+                _mm_storeu_ps(br + j, _mm_sub_ps(xar, tr));
+                _mm_storeu_ps(bi + j, _mm_sub_ps(xai, ti));
+                _mm_storeu_ps(ar + j, _mm_add_ps(xar, tr));
+                _mm_storeu_ps(ai + j, _mm_add_ps(xai, ti));
+            }
+#endif
+            for (; j < half; ++j) {
+                const float tr = wr[j] * br[j] - wi[j] * bi[j];
+                const float ti = wr[j] * bi[j] + wi[j] * br[j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Комплексное БПФ radix-2 на месте (re/im отдельными массивами).
+// Бабочки с шагом >= 4 идут по 4 через SSE, если он есть; иначе скаляр.
+// Таблицы считаются один раз в конструкторе — forward() не аллоцирует.
+class Fft {
+public:
+    explicit Fft(uint32_t n = 2048);   // n — степень двойки
+    uint32_t size() const { return n_; }
+    void forward(float* re, float* im) const;
+
+private:
+    uint32_t n_;
+    std::vector<uint32_t> rev_;
+    std::vector<float> twRe_, twIm_;   // по стадиям: [half-1 .. 2*half-2]
+};
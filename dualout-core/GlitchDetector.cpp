@@ -0,0 +1,163 @@
+#include "GlitchDetector.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+static constexpr float    kDiscRatio   = 6.0f;     // во сколько раз выше обычной ошибки предсказания
+static constexpr float    kDiscFloor   = 0.02f;    // и не меньше ~-34 дБFS
+static constexpr float    kEnvK        = 1.0f / 256.0f;
+static constexpr float    kLpcMu       = 0.3f;     // шаг NLMS
+static constexpr float    kWarmSec     = 0.050f;   // прогрев после сброса — разрывы не ищем
+static constexpr uint32_t kPostN       = 64;       // окно подтверждения после выброса, сэмплов
+static constexpr float    kPostRatio   = 3.0f;     // остаток в окне не выше 3x прежнего — разрыв
+static constexpr float    kDiscHoldSec = 0.020f;   // не чаще одного разрыва на канал за 20 мс
+static constexpr uint32_t kClipRun     = 3;        // сэмплов на полной шкале подряд
+static constexpr int      kSilentLsb   = 2;        // |x| <= 2 — цифровая тишина (с учётом дизера)
+static constexpr uint32_t kLoud        = 1036;     // -30 дБFS: "громко" до и после провала
+static constexpr float    kGapMinSec   = 0.001f;
+static constexpr float    kGapMaxSec   = 0.500f;   // длиннее — пауза в материале, не сбой
+static constexpr float    kGapPostSec  = 0.002f;
+
+void GlitchDetector::reset(uint32_t sr)
+{
+    sr_ = sr ? sr : 48000;
+    levelFall_ = std::pow(0.1f, 1.0f / (0.010f * (float)sr_));
+    for (ChState& s : st_) s = ChState{};
+    level_ = 0.0f;
+    urFrames_ = 0;
+    resync();
+}
+
+void GlitchDetector::resync()
+{
+    primed_ = 0;
+    for (ChState& s : st_) {
+        s.clipRun = 0;
+        s.cand = false;
+    }
+    silentRun_ = 0;
+    gapArmed_ = gapTainted_ = false;
+    postLeft_ = 0;
+}
+
+void GlitchDetector::end_underrun(std::vector<Event>& out)
+{
+    out.push_back({ Underrun, urMedia_, -1, (float)urFrames_ * 1000.0f / (float)sr_ });
+    urFrames_ = 0;
+}
+
+void GlitchDetector::feed(const int16_t* pcm, uint32_t frames, uint32_t ch, int64_t media,
+                          uint32_t pad, bool quiet, std::vector<Event>& out)
+{
+    const uint32_t nch = std::min(ch, kMaxCh);
+    if (frames == 0 || nch == 0) return;
+    pad = std::min(pad, frames);
+    const uint32_t real = frames - pad;
+
+    // эпизод недобора закрывается, как только снова пошли данные
+    if (urFrames_ && real) end_underrun(out);
+    if (pad) {
+        if (!urFrames_) urMedia_ = media + real;
+        urFrames_ += pad;
+    }
+
+    const uint32_t discHold = (uint32_t)(kDiscHoldSec * sr_);
+    const uint32_t warm     = (uint32_t)(kWarmSec * sr_);
+    const uint32_t gapMin   = (uint32_t)(kGapMinSec * sr_);
+    const uint32_t gapMax   = (uint32_t)(kGapMaxSec * sr_);
+    const uint32_t gapPost  = std::max(1u, (uint32_t)(kGapPostSec * sr_));
+
+    for (uint32_t i = 0; i < frames; ++i) {
+        const int16_t* f = pcm + (size_t)i * ch;
+        const int64_t  m = media + i;
+        const bool isPad = i >= real;
+        int frameAbs = 0;
+
+        for (uint32_t c = 0; c < nch; ++c) {
+            ChState& s = st_[c];
+            const int v = f[c];
+            const int a = v < 0 ? -v : v;
+            frameAbs = std::max(frameAbs, a);
+
+            if (a >= 32767) {
+                if (s.clipRun++ == 0) s.clipMedia = m;
+            } else {
+                if (s.clipRun >= kClipRun) out.push_back({ ClipBurst, s.clipMedia, (int32_t)c, (float)s.clipRun });
+                s.clipRun = 0;
+            }
+
+            const float x = (float)v * (1.0f / 32768.0f);
+            if (!isPad) {
+                float pred = 0.0f, energy = 1e-6f;
+                for (uint32_t k = 0; k < kLpcOrder; ++k) {
+                    pred   += s.w[k] * s.h[k];
+                    energy += s.h[k] * s.h[k];
+                }
+                const float e   = x - pred;
+                const float ae  = std::fabs(e);
+                const float thr = kDiscRatio * s.env + kDiscFloor;
+                if (s.cand) {
+                    if (s.candSkip) {
+                        --s.candSkip;       // пока в истории предсказателя сам скачок
+                    } else {
+                        s.candSum += ae;
+                        if (++s.candN == kPostN) {
+                            if (s.candSum / kPostN < kPostRatio * s.candEnv + 0.25f * kDiscFloor) {
+                                out.push_back({ Discontinuity, s.candMedia, (int32_t)c, s.candValue });
+                            }
+                            s.cand = false;
+                        }
+                    }
+                }
+                if (s.discHold) {
+                    --s.discHold;
+                } else if (primed_ >= warm && ae > thr) {
+                    s.cand      = true;
+                    s.candMedia = m;
+                    s.candValue = ae;
+                    s.candEnv   = s.env;
+                    s.candSum   = 0.0f;
+                    s.candSkip  = kLpcOrder;
+                    s.candN     = 0;
+                    s.discHold  = discHold;
+                }
+                // выброс не должен раскачать предсказатель и поднять порог
+                const float ec = std::max(-thr, std::min(thr, e));
+                const float k  = kLpcMu * ec / energy;
+                for (uint32_t j = 0; j < kLpcOrder; ++j) s.w[j] += k * s.h[j];
+                s.env += (std::min(ae, thr) - s.env) * kEnvK;
+            }
+            std::memmove(s.h + 1, s.h, (kLpcOrder - 1) * sizeof(float));
+            s.h[0] = x;
+        }
+        // край недобора — это underrun, а не разрыв: историю начинаем заново
+        if (isPad) primed_ = 0;
+        else if (primed_ < warm) ++primed_;
+
+        if (postLeft_) {
+            postPeak_ = std::max(postPeak_, (uint32_t)frameAbs);
+            if (--postLeft_ == 0 && postPeak_ >= kLoud) {
+                out.push_back({ Gap, pendingMedia_, -1, (float)pendingRun_ * 1000.0f / (float)sr_ });
+            }
+        }
+        if (frameAbs <= kSilentLsb) {
+            if (silentRun_ == 0) {
+                silentMedia_ = m;
+                gapArmed_    = level_ >= (float)kLoud;
+                gapTainted_  = false;
+            }
+            ++silentRun_;
+            if (isPad || quiet) gapTainted_ = true;
+        } else {
+            if (silentRun_ >= gapMin && silentRun_ <= gapMax && gapArmed_ && !gapTainted_) {
+                pendingRun_   = silentRun_;
+                pendingMedia_ = silentMedia_;
+                postLeft_     = gapPost;
+                postPeak_     = (uint32_t)frameAbs;
+            }
+            silentRun_ = 0;
+        }
+        level_ = std::max((float)frameAbs, level_ * levelFall_);
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Детектор артефактов на выходе одного устройства ("треск" из жалоб):
+// разрывы сигнала, провалы цифровой тишины посреди звука, серии клипа и
+// недоборы очереди (underrun). Чистый DSP без потоков — кормится готовыми
+// блоками s16 из анализ-тапа, события возвращает в медиа-кадрах.
+class GlitchDetector {
+public:
+    enum Kind { Discontinuity = 0, Gap, ClipBurst, Underrun, KindCount };
+
+    struct Event {
+        Kind     kind;
+        int64_t  media;   // медиа-кадр начала события
+        int32_t  ch;      // канал (-1 — все каналы / устройство целиком)
+        float    value;   // Discontinuity: скачок, доля FS; Gap/Underrun: мс; ClipBurst: сэмплов подряд
+    };
+
+    void reset(uint32_t sr);
+    // Потеря непрерывности (выброшенный блок тапа): незавершённые события
+    // забываем, следующий сэмпл не сравниваем с предыдущим
+    void resync();
+    // pad — кадров недобора в конце блока (колбэк добил тишиной, пока плеер
+    // кормит); quiet — тишина в блоке намеренная (буферизация, пауза)
+    void feed(const int16_t* pcm, uint32_t frames, uint32_t ch, int64_t media,
+              uint32_t pad, bool quiet, std::vector<Event>& out);
+
+private:
+    static constexpr uint32_t kMaxCh    = 8;
+    static constexpr uint32_t kLpcOrder = 16;
+
+    // Разрыв ищем по ошибке линейного предсказания (NLMS): предсказатель
+    // "съедает" тональную часть и ВЧ музыки, а ступенька/выпавшие сэмплы
+    // дают в остатке одиночный выброс намного выше его обычного уровня.
+    struct ChState {
+        float    w[kLpcOrder]{};     // коэффициенты предсказателя
+        float    h[kLpcOrder]{};     // последние сэмплы, h[0] — самый свежий
+        float    env = 0.0f;         // среднее |остатка| — обычная ошибка предсказания
+        uint32_t clipRun = 0;
+        int64_t  clipMedia = 0;
+        uint32_t discHold = 0;       // сэмплов до следующего возможного разрыва
+        // кандидат в разрыв: подтверждается, если остаток сразу вернулся к
+        // прежнему уровню (у настоящей атаки — барабана и т.п. — он остаётся высоким)
+        bool     cand = false;
+        int64_t  candMedia = 0;
+        float    candValue = 0.0f, candEnv = 0.0f, candSum = 0.0f;
+        uint32_t candSkip = 0, candN = 0;
+    };
+
+    void end_underrun(std::vector<Event>& out);
+
+    uint32_t sr_ = 48000;
+    ChState  st_[kMaxCh];
+    uint32_t primed_ = 0;            // сэмплов истории после сброса (прогрев предсказателя)
+
+    // провал тишины: начинается после громкого звука, подтверждается,
+    // если за ним сразу снова громко
+    float    level_ = 0.0f;          // пиковая огибающая кадра, спад ~20 дБ за 10 мс
+    float    levelFall_ = 1.0f;
+    uint32_t silentRun_ = 0;
+    int64_t  silentMedia_ = 0;
+    bool     gapArmed_ = false;      // перед тишиной было громко
+    bool     gapTainted_ = false;    // в тишину попал недобор или намеренная пауза
+    uint32_t postLeft_ = 0;          // кадров после провала, в которых ждём звук
+    uint32_t postPeak_ = 0;
+    uint32_t pendingRun_ = 0;
+    int64_t  pendingMedia_ = 0;
+
+    uint32_t urFrames_ = 0;          // текущий эпизод недобора
+    int64_t  urMedia_ = 0;
+};
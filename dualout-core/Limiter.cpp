@@ -0,0 +1,185 @@
+#include "Limiter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DUALOUT_LIMITER_SSE 1
+#endif
+
+static constexpr float kLookSec    = 0.001f;
+static constexpr float kReleaseSec = 0.080f;
+
+void SlidingMin::reset(uint32_t win)
+{
+    win_ = win ? win : 1;
+    val_.assign(win_, 1.0f);
+    idx_.assign(win_, 0);
+    head_ = count_ = 0;
+    t_ = 0;
+}
+
+float SlidingMin::push(float v)
+{
+    // сначала освобождаем место: иначе при росте v на каждом шаге очередь
+    // доходит до win записей и новая затирает голову
+    while (count_ && idx_[head_] + win_ <= t_) {
+        head_ = (head_ + 1) % win_;
+        --count_;
+    }
+    while (count_ && val_[(head_ + count_ - 1) % win_] >= v) --count_;
+    const uint32_t slot = (head_ + count_) % win_;
+    val_[slot] = v;
+    idx_[slot] = t_++;
+    ++count_;
+    return val_[head_];
+}
+
+void Limiter::reset(uint32_t sr, uint32_t ch)
+{
+    sr_ = sr ? sr : 48000;
+    ch_ = ch ? ch : 2;
+    look_  = std::max(8u, (uint32_t)(kLookSec * sr_));
+    // пик, найденный интерполятором в кадре n, относится к сэмплам n-6..n-5:
+    // сигнал задерживаем так, чтобы он вышел в конце окна сглаживания
+    delay_ = look_ - 1 + kLag;
+    relK_  = 1.0f - std::exp(-1.0f / (kReleaseSec * (float)sr_));
+
+    // полифазный ФНЧ для true-peak (как в LoudnessMeter): sinc с окном Ханна
+    const double pi  = 3.14159265358979323846;
+    const double len = kOver * kTaps;
+    for (uint32_t p = 0; p < kOver; ++p) {
+        double sum = 0.0;
+        for (uint32_t k = 0; k < kTaps; ++k) {
+            const double n = p + (double)k * kOver;
+            const double x = (n - (len - 1) / 2.0) / kOver;
+            const double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(pi * x) / (pi * x);
+            const double win  = 0.5 - 0.5 * std::cos(2.0 * pi * (n + 0.5) / len);
+            fir_[p][k] = (float)(sinc * win);
+            sum += sinc * win;
+        }
+        for (uint32_t k = 0; k < kTaps; ++k) fir_[p][k] = (float)(fir_[p][k] / sum);
+    }
+
+    line_.assign((size_t)(delay_ + kMaxBlock) * ch_, 0.0f);
+    hist_.assign((size_t)(kTaps - 1 + kMaxBlock) * ch_, 0.0f);
+    peak_.assign(kMaxBlock, 0.0f);
+    gain_.assign(kMaxBlock, 1.0f);
+
+    min_.reset(look_ + 2);   // окно минимума чуть длиннее — запас на разброс фаз
+    rel_ = 1.0f;
+    box_.assign(look_, 1.0f);
+    boxPos_ = 0;
+    boxSum_ = (double)look_;
+    blockMin_ = 1.0f;
+}
+
+void Limiter::settle()
+{
+    if (rel_ >= 1.0f && min_.empty() && blockMin_ >= 1.0f) return;
+    min_.clear();
+    rel_ = 1.0f;
+    std::fill(box_.begin(), box_.end(), 1.0f);
+    boxSum_ = (double)look_;
+    blockMin_ = 1.0f;
+}
+
+// true-peak кадра: максимум по каналам из 4 промежуточных точек и сэмпла
+// в центре интерполятора. SSE считает 4 соседних кадра за раз.
+void Limiter::detect_peaks(const float* x, uint32_t frames)
+{
+    const uint32_t hl = kTaps - 1 + kMaxBlock;
+    std::fill(peak_.begin(), peak_.begin() + frames, 0.0f);
+    for (uint32_t c = 0; c < ch_; ++c) {
+        float* h = &hist_[(size_t)c * hl];
+        for (uint32_t i = 0; i < frames; ++i) h[kTaps - 1 + i] = x[(size_t)i * ch_ + c];
+
+        uint32_t i = 0;
+#ifdef DUALOUT_LIMITER_SSE
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        for (; i + 4 <= frames; i += 4) {
+            const float* base = h + kTaps - 1 + i;   // base[0] — кадр i
+            __m128 pk = _mm_and_ps(_mm_loadu_ps(base - kLag), absMask);
+            for (uint32_t p = 0; p < kOver; ++p) {
+                __m128 acc = _mm_setzero_ps();
+                for (uint32_t k = 0; k < kTaps; ++k) {
+                    acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(fir_[p][k]), _mm_loadu_ps(base - k)));
+                }
+                pk = _mm_max_ps(pk, _mm_and_ps(acc, absMask));
+            }
+            _mm_storeu_ps(&peak_[i], _mm_max_ps(pk, _mm_loadu_ps(&peak_[i])));
+        }
+#endif
+        for (; i < frames; ++i) {
+            const float* base = h + kTaps - 1 + i;
+            float pk = std::fabs(base[-(int)kLag]);
+            for (uint32_t p = 0; p < kOver; ++p) {
+                float y = 0.0f;
+                for (uint32_t k = 0; k < kTaps; ++k) y += fir_[p][k] * base[-(int)k];
+                pk = std::max(pk, std::fabs(y));
+            }
+            peak_[i] = std::max(peak_[i], pk);
+        }
+        std::memmove(h, h + frames, (kTaps - 1) * sizeof(float));
+    }
+}
+
+void Limiter::process(float* x, uint32_t frames, bool detect, float ceiling)
+{
+    if (frames == 0) return;
+    frames = std::min(frames, kMaxBlock);
+    const size_t n = (size_t)frames * ch_;
+
+    if (detect) {
+        detect_peaks(x, frames);
+    } else {
+        // история интерполятора должна оставаться непрерывной
+        const uint32_t hl = kTaps - 1 + kMaxBlock;
+        for (uint32_t c = 0; c < ch_; ++c) {
+            float* h = &hist_[(size_t)c * hl];
+            const uint32_t keep = std::min(frames, kTaps - 1);
+            std::memmove(h, h + keep, (kTaps - 1 - keep) * sizeof(float));
+            for (uint32_t i = 0; i < keep; ++i) h[kTaps - 1 - keep + i] = x[(size_t)(frames - keep + i) * ch_ + c];
+        }
+    }
+
+    // требуемое усиление -> минимум по окну упреждения -> release -> среднее
+    float bmin = 1.0f;
+    for (uint32_t i = 0; i < frames; ++i) {
+        const float need = (detect && peak_[i] > ceiling) ? ceiling / peak_[i] : 1.0f;
+        const float m = min_.push(need);
+
+        rel_ = std::min(m, rel_ + (1.0f - rel_) * relK_);
+        boxSum_ += (double)rel_ - (double)box_[boxPos_];
+        box_[boxPos_] = rel_;
+        if (++boxPos_ == look_) boxPos_ = 0;
+        const float gn = std::min(1.0f, (float)(boxSum_ / (double)look_));
+        gain_[i] = gn;
+        bmin = std::min(bmin, gn);
+    }
+    // сумма в double всё равно плывёт — пересчитываем, когда всё отпущено
+    if (rel_ >= 1.0f && bmin >= 1.0f) boxSum_ = (double)look_;
+    blockMin_ = bmin;
+
+    // задержка: новый блок за хвостом линии, выход — с начала
+    const size_t dl = (size_t)delay_ * ch_;
+    std::memcpy(&line_[dl], x, n * sizeof(float));
+    const float* src = line_.data();
+
+    if (bmin >= 1.0f) {
+        std::memcpy(x, src, n * sizeof(float));
+    } else {
+        size_t i = 0;
+#ifdef DUALOUT_LIMITER_SSE
+        if (ch_ == 2) {
+            for (; i + 4 <= n; i += 4) {
+                const __m128 g2 = _mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(&gain_[i / 2]));
+                _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(src + i), _mm_unpacklo_ps(g2, g2)));
+            }
+        }
+#endif
+        for (; i < n; ++i) x[i] = src[i] * gain_[i / ch_];
+    }
+    std::memmove(line_.data(), &line_[n], dl * sizeof(float));
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Скользящий минимум последних win значений (монотонная очередь по кольцу
+// на win слотов). push() сначала выбрасывает вышедшее из окна, потом
+// добавляет — в кольце никогда не больше win записей.
+class SlidingMin {
+public:
+    void reset(uint32_t win);
+    void clear() { head_ = count_ = 0; }
+    bool empty() const { return count_ == 0; }
+    float push(float v);   // минимум окна вместе с v
+
+private:
+    std::vector<float>    val_;
+    std::vector<uint64_t> idx_;
+    uint32_t win_ = 1, head_ = 0, count_ = 0;
+    uint64_t t_ = 0;
+};
+
+// Look-ahead лимитер выхода по true-peak. Уровень меряется с 4x
+// передискретизацией (межсэмпловые пики), усиление заранее уводится вниз
+// за время упреждения и плавно отпускается — вместо жёсткого клипа на
+// ±32767 после положительного gain. Сигнал задерживается на latency()
+// кадров. Чистый DSP без потоков и без аллокаций в process().
+class Limiter {
+public:
+    static constexpr uint32_t kMaxBlock = 512;   // кадров за один process()
+
+    void reset(uint32_t sr, uint32_t ch);
+    // x — interleaved float в шкале s16 (±32768), frames <= kMaxBlock.
+    // detect=false — перегрузки быть не может (gain <= 1): уровень не
+    // меряем, усиление отпускается к 1. ceiling — потолок true-peak, линейно.
+    void process(float* x, uint32_t frames, bool detect, float ceiling);
+
+    // Вход был тишиной дольше latency(): линия задержки пуста, process()
+    // можно не звать. Усиление сразу отпускаем, чтобы новый звук не начался
+    // с остатка старого ослабления.
+    void settle();
+
+    uint32_t latency() const { return delay_; }
+    float    minGain() const { return blockMin_; }   // минимум усиления за последний process()
+
+private:
+    static constexpr uint32_t kOver = 4;    // фазы передискретизации
+    static constexpr uint32_t kTaps = 12;   // отводов на фазу
+    static constexpr uint32_t kLag  = 6;    // задержка интерполятора, кадров
+
+    void detect_peaks(const float* x, uint32_t frames);
+
+    uint32_t sr_ = 48000, ch_ = 2;
+    uint32_t look_ = 48;                    // упреждение, кадров (1 мс)
+    uint32_t delay_ = 0;
+    float    relK_ = 0.0f;
+    float    fir_[kOver][kTaps]{};
+
+    std::vector<float> line_;               // задержка сигнала: (delay_ + kMaxBlock) * ch
+    std::vector<float> hist_;               // по каналам: kTaps-1 истории + kMaxBlock
+    std::vector<float> peak_;               // true-peak кадра
+    std::vector<float> gain_;               // итоговое усиление кадра
+
+    SlidingMin min_;                        // минимум требуемого усиления
+    // сглаживание: release, затем скользящее среднее длиной look_
+    float    rel_ = 1.0f;
+    std::vector<float> box_;
+    uint32_t boxPos_ = 0;
+    double   boxSum_ = 0.0;
+    float    blockMin_ = 1.0f;
+};
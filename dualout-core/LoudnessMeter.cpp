@@ -0,0 +1,130 @@
+#include "LoudnessMeter.h"
+#include <algorithm>
+#include <cmath>
+
+static constexpr double kPi = 3.14159265358979323846;
+
+void LoudnessMeter::reset(uint32_t sr, uint32_t ch)
+{
+    sr_ = sr ? sr : 48000;
+    ch_ = ch ? ch : 2;
+
+    // K-фильтр для произвольной частоты (коэффициенты BS.1770 пересчитаны
+    // через билинейное преобразование, как в libebur128)
+    {
+        const double f0 = 1681.974450955533, G = 3.999843853973347, Q = 0.7071752369554196;
+        const double K  = std::tan(kPi * f0 / sr_);
+        const double Vh = std::pow(10.0, G / 20.0);
+        const double Vb = std::pow(Vh, 0.4996667741545416);
+        const double a0 = 1.0 + K / Q + K * K;
+        shelf_ = { (Vh + Vb * K / Q + K * K) / a0, 2.0 * (K * K - Vh) / a0,
+                   (Vh - Vb * K / Q + K * K) / a0, 2.0 * (K * K - 1.0) / a0,
+                   (1.0 - K / Q + K * K) / a0 };
+    }
+    {
+        const double f0 = 38.13547087602444, Q = 0.5003270373238773;
+        const double K  = std::tan(kPi * f0 / sr_);
+        const double a0 = 1.0 + K / Q + K * K;
+        highpass_ = { 1.0, -2.0, 1.0, 2.0 * (K * K - 1.0) / a0, (1.0 - K / Q + K * K) / a0 };
+    }
+
+    // веса каналов: LFE не считается, тылы +1.5 дБ (раскладки 5.0/5.1)
+    weight_.assign(ch_, 1.0);
+    if (ch_ == 6) { weight_[3] = 0.0; weight_[4] = weight_[5] = 1.41; }
+    else if (ch_ == 5) { weight_[3] = weight_[4] = 1.41; }
+
+    // полифазный ФНЧ для true-peak: sinc с окном Ханна, каждая фаза нормирована
+    const double len = kOver * kTaps;
+    for (uint32_t p = 0; p < kOver; ++p) {
+        double sum = 0.0;
+        for (uint32_t k = 0; k < kTaps; ++k) {
+            const double n = p + (double)k * kOver;
+            const double x = (n - (len - 1) / 2.0) / kOver;
+            const double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+            const double win  = 0.5 - 0.5 * std::cos(2.0 * kPi * (n + 0.5) / len);
+            fir_[p][k] = (float)(sinc * win);
+            sum += sinc * win;
+        }
+        for (uint32_t k = 0; k < kTaps; ++k) fir_[p][k] = (float)(fir_[p][k] / sum);
+    }
+
+    st_.assign(ch_, ChanState{});
+    subLen_ = sr_ / 10;
+    subPos_ = 0;
+    subAcc_ = 0.0;
+    subCount_ = 0;
+    std::fill(std::begin(sub_), std::end(sub_), 0.0);
+    blocks_.clear();
+    frames_ = 0;
+    peak_ = 0.0f;
+}
+
+void LoudnessMeter::feed(const int16_t* pcm, uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; ++i) {
+        const int16_t* f = pcm + (size_t)i * ch_;
+        double acc = 0.0;
+        for (uint32_t c = 0; c < ch_; ++c) {
+            ChanState& s = st_[c];
+            const float xf = (float)f[c] * (1.0f / 32768.0f);
+
+            // true-peak: исходный сэмпл и 3 промежуточных
+            s.hist[s.pos] = xf;
+            for (uint32_t p = 0; p < kOver; ++p) {
+                float y = 0.0f;
+                for (uint32_t k = 0; k < kTaps; ++k) y += fir_[p][k] * s.hist[(s.pos + kTaps - k) % kTaps];
+                peak_ = std::max(peak_, std::fabs(y));
+            }
+            peak_ = std::max(peak_, std::fabs(xf));
+            s.pos = (s.pos + 1) % kTaps;
+
+            if (weight_[c] == 0.0) continue;
+            // K-фильтр: полка + ФВЧ (transposed direct form II)
+            double x = xf;
+            const Biquad* bq[2] = { &shelf_, &highpass_ };
+            for (int k = 0; k < 2; ++k) {
+                const Biquad& q = *bq[k];
+                const double y = q.b0 * x + s.z1[k];
+                s.z1[k] = q.b1 * x - q.a1 * y + s.z2[k];
+                s.z2[k] = q.b2 * x - q.a2 * y;
+                x = y;
+            }
+            acc += weight_[c] * x * x;
+        }
+        subAcc_ += acc;
+        if (++subPos_ >= subLen_) {
+            sub_[subCount_ % 4] = subAcc_;
+            ++subCount_;
+            if (subCount_ >= 4) {
+                blocks_.push_back((sub_[0] + sub_[1] + sub_[2] + sub_[3]) / (4.0 * subLen_));
+            }
+            subAcc_ = 0.0;
+            subPos_ = 0;
+        }
+    }
+    frames_ += frames;
+}
+
+double LoudnessMeter::integratedLufs() const
+{
+    auto lufs = [](double z) { return -0.691 + 10.0 * std::log10(std::max(z, 1e-20)); };
+    double sum = 0.0;
+    size_t n = 0;
+    for (double z : blocks_) {
+        if (lufs(z) > -70.0) { sum += z; ++n; }
+    }
+    if (!n) return -70.0;
+    const double gate = lufs(sum / n) - 10.0;
+    sum = 0.0;
+    n = 0;
+    for (double z : blocks_) {
+        const double l = lufs(z);
+        if (l > -70.0 && l > gate) { sum += z; ++n; }
+    }
+    return n ? lufs(sum / n) : -70.0;
+}
+
+double LoudnessMeter::truePeakDb() const
+{
+    return 20.0 * std::log10(std::max((double)peak_, 1e-6));
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Интегральная громкость по EBU R128 / ITU-R BS.1770-4 (K-фильтр, блоки
+// 400 мс с шагом 100 мс, абсолютный гейт -70 LUFS и относительный -10 LU)
+// и true-peak через 4x передискретизацию. Чистый DSP, без потоков.
+class LoudnessMeter {
+public:
+    void reset(uint32_t sr, uint32_t ch);
+    void feed(const int16_t* pcm, uint32_t frames);   // interleaved s16
+
+    double integratedLufs() const;   // -70, если всё под гейтом
+    double truePeakDb() const;       // dBTP
+    double seconds() const { return sr_ ? (double)frames_ / sr_ : 0.0; }
+
+private:
+    struct Biquad { double b0, b1, b2, a1, a2; };
+    struct ChanState { double z1[2]{}, z2[2]{}; float hist[12]{}; uint32_t pos = 0; };
+
+    static constexpr uint32_t kOver = 4;    // фазы передискретизации
+    static constexpr uint32_t kTaps = 12;   // отводов на фазу
+
+    uint32_t sr_ = 0, ch_ = 0;
+    Biquad shelf_{}, highpass_{};
+    std::vector<double> weight_;
+    std::vector<ChanState> st_;
+    float fir_[kOver][kTaps]{};
+
+    uint32_t subLen_ = 0, subPos_ = 0;     // 100 мс подблоки
+    double   subAcc_ = 0.0;
+    double   sub_[4]{};
+    uint64_t subCount_ = 0;
+    std::vector<double> blocks_;           // средний квадрат каждого 400 мс блока
+    uint64_t frames_ = 0;
+    float    peak_ = 0.0f;
+};
@@ -0,0 +1,147 @@
+#include "OnsetTracker.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+static constexpr float kCompress   = 100.0f;  // лог-сжатие модуля спектра
+static constexpr float kThreshMul  = 1.5f;
+static constexpr float kThreshRel  = 0.05f;   // доля от (медленно спадающего) максимума
+static constexpr float kMinGapSec  = 0.100f;
+static constexpr float kBpmMin     = 60.0f;
+static constexpr float kBpmMax     = 200.0f;
+static constexpr float kBpmPrior   = 120.0f;
+
+OnsetTracker::OnsetTracker()
+{
+    reset(48000);
+}
+
+void OnsetTracker::reset(uint32_t sr)
+{
+    sr_ = sr ? sr : 48000;
+    const double pi = 3.14159265358979323846;
+    window_.resize(kN);
+    for (uint32_t i = 0; i < kN; ++i) window_[i] = (float)(0.5 - 0.5 * std::cos(2.0 * pi * i / kN));
+    re_.assign(kN, 0.0f);
+    im_.assign(kN, 0.0f);
+    clear_state();
+}
+
+void OnsetTracker::clear_state()
+{
+    hist_.assign(kN, 0.0f);
+    prevMag_.assign(kN / 2, 0.0f);
+    odf_.assign(kOdfLen, 0.0f);
+    histPos_ = sinceHop_ = 0;
+    nextMedia_ = -1;
+    frames_ = 0;
+    f0_ = f1_ = 0.0f;
+    media1_ = 0;
+    lastOnset_ = -1;
+    fluxMax_ = 0.0f;
+    bpm_ = conf_ = 0.0f;
+}
+
+void OnsetTracker::feed(const float* mono, uint32_t n, int64_t media, std::vector<Onset>& out)
+{
+    if (nextMedia_ >= 0 && std::llabs(media - nextMedia_) > 2) clear_state();
+    nextMedia_ = media + n;
+    for (uint32_t i = 0; i < n; ++i) {
+        hist_[histPos_] = mono[i];
+        histPos_ = (histPos_ + 1) & (kN - 1);
+        if (++sinceHop_ >= kHop) {
+            sinceHop_ = 0;
+            frame(media + i + 1, out);
+        }
+    }
+}
+
+void OnsetTracker::frame(int64_t endMedia, std::vector<Onset>& out)
+{
+    for (uint32_t k = 0; k < kN; ++k) {
+        re_[k] = hist_[(histPos_ + k) & (kN - 1)] * window_[k];
+        im_[k] = 0.0f;
+    }
+    fft_.forward(re_.data(), im_.data());
+
+    // flux: сумма положительных приростов лог-модуля по бинам
+    const float norm = 4.0f / (float)kN;
+    float flux = 0.0f;
+    for (uint32_t b = 1; b < kN / 2; ++b) {
+        const float mag = std::log1p(kCompress * norm * std::sqrt(re_[b] * re_[b] + im_[b] * im_[b]));
+        flux += std::max(0.0f, mag - prevMag_[b]);
+        prevMag_[b] = mag;
+    }
+    if (frames_ == 0) flux = 0.0f;   // первый кадр сравнивать не с чем
+
+    // порог — по прошлым кадрам, без взгляда вперёд
+    float mean = 0.0f;
+    const uint32_t have = (uint32_t)std::min<uint64_t>(frames_, kMeanLen);
+    for (uint32_t i = 1; i <= have; ++i) mean += odf_[(frames_ - i) % kOdfLen];
+    mean = have ? mean / (float)have : 0.0f;
+    odf_[frames_ % kOdfLen] = flux;
+    ++frames_;
+    fluxMax_ = std::max(flux, fluxMax_ * 0.999f);
+
+    // пик на предыдущем кадре: выше соседей и выше порога
+    const float thresh = mean * kThreshMul + fluxMax_ * kThreshRel;
+    const int64_t minGap = (int64_t)(kMinGapSec * sr_);
+    if (frames_ >= 3 && f1_ > f0_ && f1_ >= flux && f1_ > thresh &&
+        (lastOnset_ < 0 || media1_ - lastOnset_ >= minGap)) {
+        Onset o;
+        o.media    = media1_;
+        o.strength = fluxMax_ > 0.0f ? std::min(1.0f, (f1_ - mean) / fluxMax_) : 0.0f;
+        out.push_back(o);
+        lastOnset_ = media1_;
+    }
+    f0_ = f1_;
+    f1_ = flux;
+    media1_ = endMedia - kN / 2;
+
+    if (frames_ % 94 == 0 && frames_ >= kOdfLen / 2) estimate_tempo();   // ~раз в секунду
+}
+
+// Автокорреляция функции атак по лагам 60..200 BPM с мягким приоритетом
+// около 120 BPM; уточнение параболой по соседним лагам
+void OnsetTracker::estimate_tempo()
+{
+    const uint32_t len = (uint32_t)std::min<uint64_t>(frames_, kOdfLen);
+    std::vector<float> x(len);
+    float mean = 0.0f;
+    for (uint32_t i = 0; i < len; ++i) {
+        x[i] = odf_[(frames_ - len + i) % kOdfLen];
+        mean += x[i];
+    }
+    mean /= (float)len;
+    float energy = 0.0f;
+    for (float& v : x) { v -= mean; energy += v * v; }
+    if (energy <= 1e-9f) return;
+
+    const float fps = (float)sr_ / (float)kHop;
+    const uint32_t lagMin = (uint32_t)std::floor(60.0f * fps / kBpmMax);
+    const uint32_t lagMax = std::min<uint32_t>((uint32_t)std::ceil(60.0f * fps / kBpmMin), len / 2);
+    if (lagMax <= lagMin + 2) return;
+
+    std::vector<float> acf(lagMax + 2, 0.0f);
+    for (uint32_t lag = lagMin - 1; lag <= lagMax + 1 && lag < len; ++lag) {
+        float s = 0.0f;
+        for (uint32_t i = lag; i < len; ++i) s += x[i] * x[i - lag];
+        acf[lag] = s / (float)(len - lag);
+    }
+    uint32_t best = 0;
+    float bestScore = 0.0f;
+    for (uint32_t lag = lagMin; lag <= lagMax; ++lag) {
+        const float bpm = 60.0f * fps / (float)lag;
+        const float oct = std::log2(bpm / kBpmPrior);
+        const float score = acf[lag] * std::exp(-0.5f * oct * oct);
+        if (score > bestScore) { bestScore = score; best = lag; }
+    }
+    if (!best) return;
+
+    float lag = (float)best;
+    const float a = acf[best - 1], b = acf[best], c = acf[best + 1];
+    const float den = a - 2.0f * b + c;
+    if (den < 0.0f) lag += 0.5f * (a - c) / den;
+    bpm_  = 60.0f * fps / lag;
+    conf_ = std::clamp(b / (energy / (float)len), 0.0f, 1.0f);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Fft.h"
+
+// Детектор атак (spectral flux по лог-сжатому спектру) и оценка темпа
+// (автокорреляция функции атак). Чистый DSP без потоков: кормится моно
+// сэмплами с медиа-позицией, атаки возвращает в медиа-кадрах.
+class OnsetTracker {
+public:
+    struct Onset {
+        int64_t media;     // медиа-кадр атаки (центр окна анализа)
+        float   strength;  // 0..1
+    };
+
+    OnsetTracker();
+    void reset(uint32_t sr);
+    // media — медиа-кадр первого сэмпла; разрыв позиции сбрасывает состояние
+    void feed(const float* mono, uint32_t n, int64_t media, std::vector<Onset>& out);
+
+    float bpm() const { return bpm_; }
+    float confidence() const { return conf_; }
+
+private:
+    void frame(int64_t endMedia, std::vector<Onset>& out);
+    void estimate_tempo();
+    void clear_state();
+
+    static constexpr uint32_t kN       = 1024;
+    static constexpr uint32_t kHop     = 512;
+    static constexpr uint32_t kMeanLen = 32;    // ~340 мс на 48 кГц — локальный порог
+    static constexpr uint32_t kOdfLen  = 512;   // ~5.5 с — окно для темпа
+
+    Fft fft_{kN};
+    uint32_t sr_ = 48000;
+    std::vector<float> window_, hist_, re_, im_, prevMag_, odf_;
+    uint32_t histPos_ = 0, sinceHop_ = 0;
+    int64_t  nextMedia_ = -1;
+    uint64_t frames_ = 0;        // кадров анализа с последнего сброса
+    float    f0_ = 0.0f, f1_ = 0.0f;
+    int64_t  media1_ = 0;        // медиа-кадр кандидата f1_
+    int64_t  lastOnset_ = -1;
+    float    fluxMax_ = 0.0f;
+    float    bpm_ = 0.0f, conf_ = 0.0f;
+};
@@ -0,0 +1,110 @@
+/* Телеметрия DualOut в общей памяти: фиксированная раскладка, seqlock.
+ *
+ * Движок создаёт именованный mapping "Local\DualOutTelemetry.<pid>" и
+ * обновляет блок ~60 раз в секунду из потока анализа. Клиент открывает его
+ * один раз (OpenFileMappingW + MapViewOfFile), дальше читает без системных
+ * вызовов: dualout_tm_read() копирует снимок, повторяя попытку, если попал
+ * на запись.
+ *
+ * Только Windows: в других ОС движок блок не создаёт, DLL не собирается.
+ *
+ * Заголовок на чистом C — для FFI (Dart, C#, Python ctypes). Раскладка
+ * меняется только вместе с DUALOUT_TM_VERSION.
+ */
+#ifndef DUALOUT_TELEMETRY_H
+#define DUALOUT_TELEMETRY_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DUALOUT_TM_MAGIC    0x544C4F44u   /* 'DOLT' */
+#define DUALOUT_TM_VERSION  1u
+#define DUALOUT_TM_MAX_CH   8
+#define DUALOUT_TM_BANDS    32
+#define DUALOUT_TM_NAME_FMT L"Local\\DualOutTelemetry.%lu"
+
+enum dualout_tm_state {
+  DUALOUT_TM_STOPPED   = 0,
+  DUALOUT_TM_PAUSED    = 1,
+  DUALOUT_TM_PLAYING   = 2,
+  DUALOUT_TM_BUFFERING = 3,
+  DUALOUT_TM_ENDED     = 4
+};
+
+typedef struct dualout_tm_device {
+  float    rms[DUALOUT_TM_MAX_CH];    /* VU, 0..1 */
+  float    peak[DUALOUT_TM_MAX_CH];   /* PPM, 0..1 */
+  float    hold[DUALOUT_TM_MAX_CH];   /* peak hold, 0..1 */
+  uint32_t clips[DUALOUT_TM_MAX_CH];
+  int64_t  media_frame;               /* что сейчас уходит на устройство */
+  int32_t  queue_ms;
+  float    cb_us;                     /* средняя цена колбэка */
+} dualout_tm_device;
+
+typedef struct dualout_telemetry {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;            /* sizeof(dualout_telemetry) у писателя */
+  volatile uint32_t seq;    /* нечётный — идёт запись */
+  uint64_t updates;
+  int64_t  update_ns;       /* steady_clock писателя */
+  uint32_t sample_rate;
+  uint32_t channels;
+  int32_t  state;           /* dualout_tm_state */
+  int32_t  drift_ms_ab;     /* очередь A минус очередь B */
+  int64_t  pos_ms;          /* медиа-позиция, звучащая на A */
+  int32_t  latency_ms;      /* буфер устройства A + добавка пользователя */
+  int32_t  stalls;
+  dualout_tm_device dev[2];
+  float    bands_db[DUALOUT_TM_BANDS];
+  float    bpm;
+  float    bpm_conf;
+} dualout_telemetry;
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#if defined(_M_ARM64) || defined(_M_ARM)
+#define DUALOUT_TM_ACQUIRE() __dmb(_ARM64_BARRIER_ISH)
+#else
+#define DUALOUT_TM_ACQUIRE() _ReadWriteBarrier()   /* x86: загрузки не переупорядочиваются */
+#endif
+#else
+#define DUALOUT_TM_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#endif
+
+/* Снимок блока. 0 — успешно, -1 — блок не инициализирован или другой версии,
+ * -2 — писатель не отпустил блок за max_tries попыток. */
+static inline int dualout_tm_read(const dualout_telemetry* shm, dualout_telemetry* out, int max_tries)
+{
+  int i;
+  if (!shm || shm->magic != DUALOUT_TM_MAGIC || shm->version != DUALOUT_TM_VERSION) return -1;
+  for (i = 0; i < max_tries; ++i) {
+    const uint32_t s1 = shm->seq;
+    DUALOUT_TM_ACQUIRE();
+    if (s1 & 1u) continue;
+    memcpy(out, (const void*)shm, sizeof(*out));
+    DUALOUT_TM_ACQUIRE();
+    if (shm->seq == s1) return 0;
+  }
+  return -2;
+}
+
+/* Готовые функции для FFI живут в telemetry_reader.cpp (DLL dualout-telemetry) */
+#ifdef _WIN32
+#define DUALOUT_TM_API __declspec(dllexport)
+#else
+#define DUALOUT_TM_API
+#endif
+DUALOUT_TM_API const dualout_telemetry* dualout_tm_open(uint32_t pid);
+DUALOUT_TM_API int  dualout_tm_snapshot(const dualout_telemetry* shm, dualout_telemetry* out);
+DUALOUT_TM_API void dualout_tm_close(const dualout_telemetry* shm);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DUALOUT_TELEMETRY_H */
@@ -0,0 +1,31 @@
+// Читатель телеметрии для FFI: открыть mapping процесса dualout-video по pid,
+// дальше снимки без системных вызовов.
+#define NOMINMAX
+#include "dualout_telemetry.h"
+#include <windows.h>
+#include <cwchar>
+
+extern "C" {
+
+const dualout_telemetry* dualout_tm_open(uint32_t pid)
+{
+    wchar_t name[64];
+    std::swprintf(name, 64, DUALOUT_TM_NAME_FMT, (unsigned long)pid);
+    HANDLE h = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+    if (!h) return nullptr;
+    void* p = MapViewOfFile(h, FILE_MAP_READ, 0, 0, sizeof(dualout_telemetry));
+    CloseHandle(h);   // view держит mapping сам
+    return static_cast<const dualout_telemetry*>(p);
+}
+
+int dualout_tm_snapshot(const dualout_telemetry* shm, dualout_telemetry* out)
+{
+    return dualout_tm_read(shm, out, 64);
+}
+
+void dualout_tm_close(const dualout_telemetry* shm)
+{
+    if (shm) UnmapViewOfFile(shm);
+}
+
+}
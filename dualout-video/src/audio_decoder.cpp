@@ -0,0 +1,80 @@
+#include "audio_decoder.h"
+#include "ma_audio_decoder.h"
+#ifdef _WIN32
+#include "mf_audio_reader.h"
+#include "mf_utils.h"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+void audio_decoder_thread_init(){
+#ifdef _WIN32
+  struct ThreadMf {
+    std::unique_ptr<ComInit> com;
+    std::unique_ptr<MFInit>  mf;
+    ThreadMf(){
+      try {
+        com = std::make_unique<ComInit>();
+        mf  = std::make_unique<MFInit>();
+      } catch (const std::exception&) {
+        std::cerr << "[AudioDecoder] COM/MF init failed on this thread" << std::endl;
+      }
+    }
+  };
+  thread_local ThreadMf t;
+  (void)t;
+#endif
+}
+
+std::unique_ptr<AudioDecoder> open_audio_decoder(const std::wstring& url, uint32_t sr, uint32_t ch){
+  const char* want = std::getenv("DUALOUT_DECODER");
+  if (want && !*want) want = nullptr;
+
+#ifdef _WIN32
+  if (!want || std::strcmp(want, "mf") == 0) {
+    auto mf = std::make_unique<MfPcmStream>();
+    if (mf->open(url, sr, ch)) return mf;
+  }
+#endif
+  if (!want || std::strcmp(want, "miniaudio") == 0) {
+    auto ma = std::make_unique<MaPcmStream>();
+    if (ma->open(url, sr, ch)) return ma;
+  }
+  std::cerr << "[AudioDecoder] no decoder could open the file" << (want ? " (DUALOUT_DECODER=" : "")
+            << (want ? want : "") << (want ? ")" : "") << std::endl;
+  return nullptr;
+}
+
+bool stream_audio_pcm(const std::wstring& url, const PcmSink& sink,
+                      PcmDesc* outFmt, std::atomic_bool* stopFlag,
+                      uint32_t sr, uint32_t ch){
+  std::unique_ptr<AudioDecoder> stream = open_audio_decoder(url, sr, ch);
+  if(!stream) return false;
+  if(outFmt) *outFmt = stream->format();
+
+  constexpr size_t kBlock = 4096;
+  std::vector<int16_t> buf;
+  while(true){
+    if(stopFlag && stopFlag->load()) return true;
+    const PcmDesc f = stream->format();
+    buf.resize(kBlock * f.ch);
+    int64_t ts = 0;
+    const size_t frames = stream->read(buf.data(), kBlock, &ts);
+    if(frames == 0) return !stream->failed();
+
+    // отдаём блок по мере того, как приёмник освобождает место
+    size_t done = 0;
+    while(done < frames){
+      if(stopFlag && stopFlag->load()) return true;
+      const int64_t pts = ts + (int64_t)done * 10000000 / (f.sr ? f.sr : 48000);
+      const size_t n = sink(buf.data() + done * f.ch, frames - done, pts);
+      done += (std::min)(n, frames - done);
+      if(n == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct PcmDesc { uint32_t sr, ch, bps; };
+struct SeekIndex;
+
+// Приёмник с обратным давлением: берёт сколько может и возвращает число
+// принятых кадров. 0 — места нет, поток подождёт и предложит остаток снова.
+using PcmSink = std::function<size_t(const void* data, size_t frames, int64_t pts100ns)>;
+
+// Pull-декодер аудио для конвейера воспроизведения: файл -> interleaved s16
+// на заданной частоте/каналах (что получилось на самом деле — format()).
+// Один поток за раз: open() может быть в одном, чтение — в другом.
+class AudioDecoder {
+public:
+  virtual ~AudioDecoder() = default;
+
+  virtual bool open(const std::wstring& url, uint32_t sr = 48000, uint32_t ch = 2) = 0;
+  virtual void close() = 0;
+  virtual const PcmDesc& format() const = 0;
+  virtual const char* name() const = 0;   // "mf", "miniaudio" — для логов и статуса
+
+  // До maxFrames кадров в память вызывающего (format().ch сэмплов на кадр),
+  // pts — начало куска. 0 — конец потока (eof()) или ошибка (failed()).
+  virtual size_t read(int16_t* dst, size_t maxFrames, int64_t* pts100ns) = 0;
+  virtual bool seek_100ns(int64_t pos) = 0;
+  virtual int64_t duration_100ns() const = 0;   // 0 — неизвестна
+
+  virtual bool eof() const = 0;
+  virtual bool failed() const = 0;
+
+  // НОВОЕ: учёт копий с open(): сколько байт декодер записал/скопировал сам
+  // и сколько копий сэкономил, читая буферы источника по частям
+  virtual uint64_t bytes_copied() const { return 0; }
+  virtual uint64_t bytes_copy_avoided() const { return 0; }
+
+  // НОВОЕ: индекс точек seek (seek_index.h); зовётся из потока чтения между
+  // read(). Декодеры, которые и так ищут точно, его игнорируют.
+  virtual void set_seek_index(std::shared_ptr<const SeekIndex> idx) { (void)idx; }
+
+  // НОВОЕ: точный seek. seek_100ns() может встать раньше цели (на начало
+  // пакета); next_pts() — pts кадра, который отдаст следующий read() (-1 —
+  // неизвестно), skip() выбрасывает до frames кадров без конвертации в s16 и
+  // возвращает, сколько выбросил (меньше — конец потока).
+  virtual int64_t next_pts() { return -1; }
+  virtual size_t skip(size_t frames) { (void)frames; return 0; }
+};
+
+// НОВОЕ: COM/MF для декодеров живут на поток, а не на объект: декодер
+// открывают в одном потоке, а читают и разрушают в другом. Поток, который
+// открывает или читает декодеры, зовёт это в начале; инициализация держится
+// до выхода потока, повторные вызовы ничего не делают. Вне Windows — пусто.
+void audio_decoder_thread_init();
+
+// Первый декодер, который открыл url: на Windows Media Foundation, потом
+// miniaudio (WAV/FLAC/MP3); на остальных платформах — только miniaudio.
+// DUALOUT_DECODER=mf|miniaudio в окружении — только указанный.
+std::unique_ptr<AudioDecoder> open_audio_decoder(const std::wstring& url, uint32_t sr = 48000, uint32_t ch = 2);
+
+// Декодирует url целиком в sink, соблюдая его обратное давление.
+bool stream_audio_pcm(const std::wstring& url, const PcmSink& sink,
+                      PcmDesc* outFmt=nullptr, std::atomic_bool* stopFlag=nullptr,
+                      uint32_t sr=48000, uint32_t ch=2);
@@ -1,4 +1,5 @@
 #include "dualout_bridge.h"
+#include <algorithm>
 
 bool DualOutBridge::openDevices(const std::wstring& a, const std::wstring& b, const PcmDesc& f){
   fmt = f;
@@ -8,10 +9,14 @@ bool DualOutBridge::openDevices(const std::wstring& a, const std::wstring& b, co
 
 bool DualOutBridge::playUrl(const std::wstring& url){
   stop.store(false);
-  return mf_stream_audio_pcm(url,
-    [this](const void* data, size_t frames, int64_t pts){
-      eng.write(data, frames, pts);
-    }, &fmt, &stop);
+  // поток декодирует в формате устройств и пишет ровно столько, сколько влезает в ринги
+  return stream_audio_pcm(url,
+    [this](const void* data, size_t frames, int64_t pts) -> size_t {
+      if(!eng.isRunning()){ stop.store(true); return 0; }
+      const size_t n = (std::min)(frames, eng.writableFrames());
+      if(n == 0 || !eng.write(data, n, pts)) return 0;
+      return n;
+    }, nullptr, &stop, fmt.sr, fmt.ch);
 }
 
 void DualOutBridge::stopAll(){
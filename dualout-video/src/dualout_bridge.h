@@ -2,7 +2,7 @@
 #include <string>
 #include <atomic>
 #include "DualOutEngine.h"
-#include "mf_audio_reader.h"
+#include "audio_decoder.h"
 
 struct DualOutBridge {
   DualOutEngine eng;
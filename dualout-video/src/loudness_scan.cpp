@@ -0,0 +1,159 @@
+#include "loudness_scan.h"
+#include "media_cache.h"
+#include "audio_decoder.h"
+#include "LoudnessMeter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+static constexpr size_t kScanBlock = 4096;   // кадров за read()
+
+LoudnessScanner::LoudnessScanner() = default;
+
+LoudnessScanner::~LoudnessScanner(){
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_.store(true);
+    queue_.clear();
+  }
+  cv_.notify_all();
+  if (th_.joinable()) th_.join();
+}
+
+void LoudnessScanner::set_done(DoneFn fn){
+  std::lock_guard<std::mutex> lk(mtx_);
+  done_ = std::move(fn);
+}
+
+// Формат: size \t mtime \t lufs \t tp \t seconds \t путь (UTF-8). Позже записанная
+// строка для того же пути перекрывает раннюю.
+void LoudnessScanner::load_cache(){
+  if (cacheLoaded_) return;
+  cacheLoaded_ = true;
+  cacheFile_ = cache_file(L"loudness.cache");
+  std::ifstream f{std::filesystem::path(cacheFile_)};
+  std::string line;
+  while (std::getline(f, line)) {
+    std::istringstream is(line);
+    Entry e{};
+    std::string path;
+    if (!(is >> e.size >> e.mtime >> e.info.lufs >> e.info.truePeakDb >> e.info.seconds)) continue;
+    is.ignore(1);
+    std::getline(is, path);
+    if (path.empty()) continue;
+    e.info.cached = true;
+    cache_[wide_from_utf8(path)] = e;
+  }
+}
+
+void LoudnessScanner::append_cache(const std::wstring& path, const Entry& e){
+  std::ofstream f{std::filesystem::path(cacheFile_), std::ios::app};
+  if (!f) {
+    std::cerr << "[Loudness] cannot write cache" << std::endl;
+    return;
+  }
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "%llu\t%llu\t%.2f\t%.2f\t%.1f\t",
+                (unsigned long long)e.size, (unsigned long long)e.mtime,
+                e.info.lufs, e.info.truePeakDb, e.info.seconds);
+  f << buf << utf8_from_wide(path) << "\n";
+}
+
+bool LoudnessScanner::lookup(const std::wstring& path, LoudnessInfo& out){
+  FileIdentity id;
+  if (!file_identity(path, id)) return false;
+  std::lock_guard<std::mutex> lk(mtx_);
+  load_cache();
+  auto it = cache_.find(path);
+  if (it == cache_.end() || it->second.size != id.size || it->second.mtime != id.mtime) return false;
+  out = it->second.info;
+  return true;
+}
+
+void LoudnessScanner::request(const std::wstring& path){
+  FileIdentity id;
+  if (!file_identity(path, id)) return;   // не файл (поток) — не сканируем
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (path == current_) return;
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), path), queue_.end());
+    queue_.push_front(path);              // открытый сейчас файл — первым
+    if (!th_.joinable()) th_ = std::thread(&LoudnessScanner::worker_loop, this);
+  }
+  cv_.notify_one();
+}
+
+bool LoudnessScanner::busy(const std::wstring& path) const{
+  std::lock_guard<std::mutex> lk(mtx_);
+  return path == current_ || std::find(queue_.begin(), queue_.end(), path) != queue_.end();
+}
+
+void LoudnessScanner::worker_loop(){
+  // фоновый режим: ниже приоритет CPU и I/O, чем у воспроизведения
+  set_background_priority(true);
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (!stop_.load()) {
+    cv_.wait(lk, [this]{ return stop_.load() || !queue_.empty(); });
+    if (stop_.load()) break;
+    const std::wstring path = queue_.front();
+    queue_.pop_front();
+    current_ = path;
+    lk.unlock();
+
+    FileIdentity id;
+    LoudnessInfo info;
+    const bool ok = file_identity(path, id) && scan(path, info);
+
+    lk.lock();
+    current_.clear();
+    progress_.store(-1);
+    if (!ok) continue;
+    load_cache();
+    Entry e{id.size, id.mtime, info};
+    cache_[path] = e;
+    append_cache(path, e);
+    DoneFn done = done_;
+    lk.unlock();
+    if (done) done(path, info);
+    lk.lock();
+  }
+  set_background_priority(false);
+}
+
+bool LoudnessScanner::scan(const std::wstring& path, LoudnessInfo& out){
+  const auto t0 = std::chrono::steady_clock::now();
+  std::unique_ptr<AudioDecoder> src = open_audio_decoder(path, 48000, 2);
+  if (!src) {
+    std::cerr << "[Loudness] open failed" << std::endl;
+    return false;
+  }
+  const PcmDesc fmt = src->format();
+  const int64_t dur = src->duration_100ns();
+  LoudnessMeter meter;
+  meter.reset(fmt.sr, fmt.ch);
+  progress_.store(0);
+
+  std::vector<int16_t> buf((size_t)kScanBlock * fmt.ch);
+  int64_t pts = 0;
+  while (!stop_.load()) {
+    const size_t frames = src->read(buf.data(), kScanBlock, &pts);
+    if (frames == 0) break;
+    meter.feed(buf.data(), (uint32_t)frames);
+    if (dur > 0 && pts >= 0) progress_.store((int)std::min<int64_t>(99, pts * 100 / dur));
+  }
+  if (stop_.load() || src->failed()) return false;
+
+  out.lufs        = meter.integratedLufs();
+  out.truePeakDb  = meter.truePeakDb();
+  out.seconds     = meter.seconds();
+  out.scanSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  out.cached      = false;
+  std::cerr << "[Loudness] " << out.lufs << " LUFS, " << out.truePeakDb << " dBTP, "
+            << out.seconds << " s in " << out.scanSeconds << " s" << std::endl;
+  return true;
+}
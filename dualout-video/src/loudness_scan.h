@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+// Результат скана громкости одного файла
+struct LoudnessInfo {
+  double lufs        = -70.0;   // интегральная громкость, LUFS
+  double truePeakDb  = -120.0;  // dBTP
+  double seconds     = 0.0;     // длительность просканированного аудио
+  double scanSeconds = 0.0;     // сколько занял скан (0 — из кэша)
+  bool   cached      = false;
+};
+
+// Фоновый скан EBU R128 + true-peak. Свой декодер (open_audio_decoder) и свой поток
+// с фоновым приоритетом — путь воспроизведения не трогаем. Результаты
+// кэшируются в %LOCALAPPDATA%\DualOut\loudness.cache по пути+размеру+mtime.
+class LoudnessScanner {
+public:
+  using DoneFn = std::function<void(const std::wstring& path, const LoudnessInfo& info)>;
+
+  LoudnessScanner();
+  ~LoudnessScanner();
+
+  bool lookup(const std::wstring& path, LoudnessInfo& out);  // только кэш
+  void request(const std::wstring& path);   // встаёт в начало очереди
+  void set_done(DoneFn fn);                 // зовётся из потока скана
+
+  int progress_pct() const { return progress_.load(); }     // -1 — простой
+  bool busy(const std::wstring& path) const;
+
+private:
+  struct Entry { uint64_t size, mtime; LoudnessInfo info; };
+
+  void worker_loop();
+  bool scan(const std::wstring& path, LoudnessInfo& out);
+  void load_cache();
+  void append_cache(const std::wstring& path, const Entry& e);
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::wstring> queue_;
+  std::wstring current_;
+  std::map<std::wstring, Entry> cache_;
+  std::wstring cacheFile_;
+  bool cacheLoaded_ = false;
+  DoneFn done_;
+  std::thread th_;
+  std::atomic_bool stop_{false};
+  std::atomic<int> progress_{-1};
+};
@@ -0,0 +1,97 @@
+#include "ma_audio_decoder.h"
+#include "miniaudio.h"   // реализация собрана в dualout-core
+#include "pcm_convert.h"
+#include <algorithm>
+#include <iostream>
+
+MaPcmStream::MaPcmStream() = default;
+MaPcmStream::~MaPcmStream(){ close(); }
+
+bool MaPcmStream::open(const std::wstring& url, uint32_t sr, uint32_t ch){
+  close();
+  auto dec = std::make_unique<ma_decoder>();
+  ma_decoder_config cfg = ma_decoder_config_init(ma_format_s16, ch, sr);
+  // сведение в s16 — как у MfPcmStream: с TPDF-дизером, если включён
+  cfg.ditherMode = pcm_dither() ? ma_dither_mode_triangle : ma_dither_mode_none;
+  const ma_result r = ma_decoder_init_file_w(url.c_str(), &cfg, dec.get());
+  if (r != MA_SUCCESS) {
+    std::cerr << "[MaPcmStream] open failed: " << ma_result_description(r) << std::endl;
+    failed_ = true;
+    return false;
+  }
+  dec_ = std::move(dec);
+
+  ma_format f = ma_format_unknown;
+  ma_uint32 outCh = ch, outSr = sr;
+  ma_decoder_get_data_format(dec_.get(), &f, &outCh, &outSr, nullptr, 0);
+  fmt_ = PcmDesc{outSr ? outSr : sr, outCh ? outCh : ch, 16};
+
+  // для MP3 без таблицы кадров длина считается проходом по файлу — один раз
+  ma_uint64 len = 0;
+  if (ma_decoder_get_length_in_pcm_frames(dec_.get(), &len) == MA_SUCCESS) {
+    duration_ = (int64_t)(len * 10000000 / fmt_.sr);
+  }
+  return true;
+}
+
+void MaPcmStream::close(){
+  if (dec_) {
+    ma_decoder_uninit(dec_.get());
+    dec_.reset();
+  }
+  duration_ = 0;
+  eof_ = false;
+  failed_ = false;
+  copied_ = 0;
+}
+
+size_t MaPcmStream::read(int16_t* dst, size_t maxFrames, int64_t* pts100ns){
+  if (!dec_ || eof_ || failed_ || maxFrames == 0) return 0;
+  ma_uint64 cursor = 0;
+  ma_decoder_get_cursor_in_pcm_frames(dec_.get(), &cursor);
+  ma_uint64 got = 0;
+  const ma_result r = ma_decoder_read_pcm_frames(dec_.get(), dst, maxFrames, &got);
+  if (r == MA_AT_END || (r == MA_SUCCESS && got == 0)) {
+    eof_ = true;
+  } else if (r != MA_SUCCESS) {
+    std::cerr << "[MaPcmStream] read failed: " << ma_result_description(r) << std::endl;
+    failed_ = true;
+  }
+  if (pts100ns) *pts100ns = (int64_t)(cursor * 10000000 / fmt_.sr);
+  copied_ += got * fmt_.ch * sizeof(int16_t);   // ma_decoder пишет сразу в dst
+  return (size_t)got;
+}
+
+int64_t MaPcmStream::next_pts(){
+  ma_uint64 cursor = 0;
+  if (!dec_ || ma_decoder_get_cursor_in_pcm_frames(dec_.get(), &cursor) != MA_SUCCESS) return -1;
+  return (int64_t)(cursor * 10000000 / fmt_.sr);
+}
+
+// Без ресэмплера ma_decoder пропускает кадры без буфера вывода, минуя
+// конвертер. С ресэмплером так нельзя: без вывода он сбивает фазу (до
+// полкадра), поэтому читаем в черновой буфер.
+size_t MaPcmStream::skip(size_t frames){
+  if (!dec_ || eof_ || failed_ || frames == 0) return 0;
+  const bool direct = !dec_->converter.hasResampler;
+  if (!direct) scratch_.resize(1024 * fmt_.ch);
+  size_t done = 0;
+  while (done < frames) {
+    const size_t want = direct ? frames - done : (std::min)(frames - done, (size_t)1024);
+    ma_uint64 got = 0;
+    const ma_result r = ma_decoder_read_pcm_frames(dec_.get(), direct ? nullptr : scratch_.data(), want, &got);
+    done += (size_t)got;
+    if (r == MA_AT_END || (r == MA_SUCCESS && got == 0)) { eof_ = true; break; }
+    if (r != MA_SUCCESS) { failed_ = true; break; }
+  }
+  return done;
+}
+
+bool MaPcmStream::seek_100ns(int64_t pos){
+  if (!dec_) return false;
+  const ma_uint64 frame = (ma_uint64)(pos > 0 ? pos : 0) * fmt_.sr / 10000000;
+  if (ma_decoder_seek_to_pcm_frame(dec_.get(), frame) != MA_SUCCESS) return false;
+  eof_ = false;
+  failed_ = false;
+  return true;
+}
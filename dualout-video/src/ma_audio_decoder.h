@@ -0,0 +1,39 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "audio_decoder.h"
+
+struct ma_decoder;
+
+// Декодер на встроенных в miniaudio.h dr_wav/dr_flac/dr_mp3 — без Media
+// Foundation, работает везде, где собирается движок. Частоту и каналы
+// приводит сам ma_decoder (линейный ресэмплер).
+class MaPcmStream : public AudioDecoder {
+public:
+  MaPcmStream();
+  ~MaPcmStream() override;
+
+  bool open(const std::wstring& url, uint32_t sr = 48000, uint32_t ch = 2) override;
+  void close() override;
+  const PcmDesc& format() const override { return fmt_; }
+  const char* name() const override { return "miniaudio"; }
+
+  size_t read(int16_t* dst, size_t maxFrames, int64_t* pts100ns) override;
+  bool seek_100ns(int64_t pos) override;
+  int64_t duration_100ns() const override { return duration_; }
+
+  bool eof() const override { return eof_; }
+  bool failed() const override { return failed_; }
+  uint64_t bytes_copied() const override { return copied_; }
+  int64_t next_pts() override;
+  size_t skip(size_t frames) override;
+
+private:
+  std::unique_ptr<ma_decoder> dec_;
+  std::vector<int16_t> scratch_;   // skip() при ресэмплинге
+  PcmDesc fmt_{48000, 2, 16};
+  int64_t duration_ = 0;
+  bool eof_ = false;
+  bool failed_ = false;
+  uint64_t copied_ = 0;
+};
@@ -8,23 +8,32 @@
 #include <cmath>
 #include <chrono>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdio>
 
 #include "dualout_bridge.h"
 #include "player_core.h"
+#include "waveform.h"
+#include "media_cache.h"
+#include "dualout_telemetry.h"
+#include "pcm_convert.h"
+#include "pcm_cache.h"
+#ifdef _WIN32
 #include <windows.h>
+static unsigned long process_id(){ return GetCurrentProcessId(); }
+#else
+#include <unistd.h>
+static unsigned long process_id(){ return (unsigned long)getpid(); }
+#endif
 
 
 // trim
 static inline void ltrim(std::string& s){ s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char c){return !std::isspace(c);})); }
 static inline void rtrim(std::string& s){ s.erase(std::find_if(s.rbegin(), s.rend(), [](unsigned char c){return !std::isspace(c);}).base(), s.end()); }
 static inline void trim(std::string& s){ ltrim(s); rtrim(s); }
-static std::wstring wfromu8(const std::string& s){
-    int n = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
-    if(n<=0) return L"";
-    std::wstring w(n, L'\0');
-    MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
-    return w;
-}
+static std::wstring wfromu8(const std::string& s){ return wide_from_utf8(s); }
 
 static std::unordered_map<std::string,std::string> parse_kv_line(const std::string& line){
     std::unordered_map<std::string,std::string> kv;
@@ -53,18 +62,76 @@ static std::unordered_map<std::string,std::string> parse_kv_line(const std::stri
 
 static inline int dualout_core_list_devices_json(char*, int){ return 0; }
 
+// НОВОЕ: асинхронные события (eos и т.п.) идут в stdout отдельной строкой.
+// Ответ на команду печатается под g_outMtx целиком, поэтому события копим
+// в очереди и печатаем из своего потока — без перемешивания строк и без
+// риска зависнуть, если рабочий поток плеера шлёт событие во время stop.
+static std::mutex g_outMtx;
+static std::mutex g_evMtx;
+static std::condition_variable g_evCv;
+static std::deque<std::string> g_events;
+static bool g_evStop = false;
+
+static void post_event(const std::string& json){
+    {
+        std::lock_guard<std::mutex> lk(g_evMtx);
+        g_events.push_back(json);
+    }
+    g_evCv.notify_one();
+}
+
+static void event_pump(){
+    std::unique_lock<std::mutex> lk(g_evMtx);
+    while (true) {
+        g_evCv.wait(lk, []{ return g_evStop || !g_events.empty(); });
+        if (g_events.empty()) break;
+        std::string line = std::move(g_events.front());
+        g_events.pop_front();
+        lk.unlock();
+        {
+            std::lock_guard<std::mutex> out(g_outMtx);
+            std::cout << line << "\n" << std::flush;
+        }
+        lk.lock();
+    }
+}
+
 
 int main(){
     DualOutBridge bridge;
     PlayerCore player;
 
+    std::thread evThread(event_pump);
+    player.set_event_sink(post_event);
+
     std::wstring devA=L"", devB=L"";
     PcmDesc fmt{48000,2,16};
+    std::wstring curUrl;
+
+    // НОВОЕ: waveform под полосой перемотки — строится в фоне, прогресс событиями
+    WaveformService wave;
+    wave.set_progress([](const std::wstring&, int pct){
+        post_event("{\"event\":\"waveform_progress\",\"pct\":" + std::to_string(pct) + "}");
+    });
+    wave.set_error([](const std::wstring&){
+        post_event(R"({"event":"waveform_error"})");
+    });
+
+    // НОВОЕ: атаки приходят заранее — UI ставит эффект на in_ms
+    bridge.eng.setOnsetSink([&fmt](const DualOutOnset& o){
+        char buf[192];
+        std::snprintf(buf, sizeof(buf),
+                      "{\"event\":\"onset\",\"pos_ms\":%lld,\"in_ms\":%d,\"strength\":%.2f,\"bpm\":%.1f,\"bpm_conf\":%.2f}",
+                      (long long)(o.media * 1000 / (fmt.sr ? fmt.sr : 48000)), o.inMs,
+                      o.strength, o.bpm, o.bpmConfidence);
+        post_event(buf);
+    });
 
     std::string line;
     while(std::getline(std::cin, line)){
         trim(line);
         if(line.empty()) continue;
+        std::lock_guard<std::mutex> outLk(g_outMtx);
 
         auto kv = parse_kv_line(line);
         auto itCmd = kv.find("cmd");
@@ -90,8 +157,25 @@ int main(){
         else if(cmd=="open"){
             std::wstring url = wfromu8(kv.count("url")? kv["url"] : "");
             bool ok = player.open(url, &bridge);
+            if (ok) curUrl = url;
+            std::cout << (ok? R"({"ok":true})" : R"({"ok":false})") << "\n";
+        }
+        // НОВОЕ: плейлист — следующий файл звучит сразу за текущим, без паузы
+        else if(cmd=="enqueue"){
+            std::wstring url = wfromu8(kv.count("url")? kv["url"] : "");
+            bool ok = !url.empty() && player.enqueue(url);
             std::cout << (ok? R"({"ok":true})" : R"({"ok":false})") << "\n";
         }
+        else if(cmd=="clear_queue"){
+            player.clear_queue();
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: кроссфейд между элементами плейлиста, 0 — встык
+        else if(cmd=="set_crossfade"){
+            int ms = kv.count("ms")? std::stoi(kv["ms"]) : 0;
+            player.set_crossfade(ms);
+            std::cout << R"({"ok":true})" << "\n";
+        }
         else if(cmd=="play"){
             std::cout << (player.play()? R"({"ok":true})" : R"({"ok":false})") << "\n";
         }
@@ -100,7 +184,22 @@ int main(){
         }
         else if(cmd=="seek"){
             long long ms = kv.count("ms")? std::stoll(kv["ms"]) : 0;
-            std::cout << (player.seek_ms(ms)? R"({"ok":true})" : R"({"ok":false})") << "\n";
+            // mode=flush — старое поведение (сброс очереди), по умолчанию кроссфейд
+            bool crossfade = !(kv.count("mode") && kv["mode"] == "flush");
+            std::cout << (player.seek_ms(ms, crossfade)? R"({"ok":true})" : R"({"ok":false})") << "\n";
+        }
+        else if (cmd == "set_watermarks") {
+            int lowMs  = kv.count("low_ms")  ? std::stoi(kv["low_ms"])  : 40;
+            int highMs = kv.count("high_ms") ? std::stoi(kv["high_ms"]) : 150;
+            player.set_watermarks(lowMs, highMs);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: окно декодированного PCM для быстрого seek (для следующего open)
+        else if (cmd == "set_seek_window") {
+            int behindMs = kv.count("behind_ms") ? std::stoi(kv["behind_ms"]) : 10000;
+            int aheadMs  = kv.count("ahead_ms")  ? std::stoi(kv["ahead_ms"])  : 6000;
+            player.set_seek_window(behindMs, aheadMs);
+            std::cout << R"({"ok":true})" << "\n";
         }
         else if (cmd == "set_volume") {
             // a_db / b_db оставляем на будущее, пока можно всегда 0
@@ -108,7 +207,76 @@ int main(){
             float bDb    = kv.count("b_db")    ? std::stof(kv["b_db"])    : 0.0f;
             float master = kv.count("master")  ? std::stof(kv["master"])  : 1.0f;
 
-            bridge.eng.setGainDb(aDb, bDb, master);
+            // at_ms — применить, когда зазвучит эта медиа-позиция
+            long long at = kv.count("at_ms") ? std::stoll(kv["at_ms"]) * fmt.sr / 1000 : -1;
+
+            bridge.eng.setGainDb(aDb, bDb, master, at);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        else if (cmd == "set_delay") {
+            int aMs = kv.count("a_ms") ? std::stoi(kv["a_ms"]) : 0;
+            int bMs = kv.count("b_ms") ? std::stoi(kv["b_ms"]) : 0;
+            long long at = kv.count("at_ms") ? std::stoll(kv["at_ms"]) * fmt.sr / 1000 : -1;
+            bridge.eng.setDelayMs(aMs, bMs, at);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: лимитер вместо клипа при усилении (ceiling — потолок, dBTP)
+        else if (cmd == "set_limiter") {
+            bool on = true;
+            if (kv.count("on")) {
+                std::string v = kv["on"];
+                std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+                on = (v == "1" || v == "true" || v == "yes");
+            }
+            float ceiling = kv.count("ceiling") ? std::stof(kv["ceiling"]) : -1.0f;
+            bridge.eng.setLimiter(on, ceiling);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: дисковый кэш декодированного PCM (для следующего open)
+        else if (cmd == "set_pcm_cache") {
+            std::string v = kv.count("on") ? kv["on"] : "1";
+            std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+            const uint64_t maxMb = kv.count("max_mb") ? std::stoull(kv["max_mb"]) : 0;
+            pcm_cache_configure(v == "1" || v == "true" || v == "yes", maxMb << 20);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: TPDF-дизер при сведении декодеров в s16 (для следующего open)
+        else if (cmd == "set_dither") {
+            std::string v = kv.count("on") ? kv["on"] : "1";
+            std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+            pcm_set_dither(v == "1" || v == "true" || v == "yes");
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // сверка SIMD-ядер конверсии со скалярными + ГБ/с
+        else if (cmd == "pcm_selftest") {
+            const size_t n = kv.count("samples") ? (size_t)std::stoul(kv["samples"]) : (size_t)1 << 20;
+            std::cout << pcm_selftest_json(n) << "\n";
+        }
+        // НОВОЕ: остановка устройств на простое
+        else if (cmd == "set_idle") {
+            bridge.eng.setIdleSuspendMs(kv.count("suspend_ms") ? std::stoi(kv["suspend_ms"]) : 0);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        else if (cmd == "idle") {
+            DualOutIdleStats st{};
+            if (!bridge.eng.getIdleStats(st)) {
+                std::cout << R"({"ok":false,"err":"not_running"})" << "\n";
+            } else {
+                char buf[512];
+                std::snprintf(buf, sizeof(buf),
+                    "{\"ok\":true,\"idle_a\":%s,\"idle_b\":%s,\"suspended\":%s,"
+                    "\"wakeups\":%llu,\"idle_wakeups\":%llu,\"wakeups_avoided\":%llu,"
+                    "\"suspends\":%u,\"resumes\":%u,\"last_resume_ms\":%d,\"cpu_saved_ms\":%.1f}",
+                    st.idleA ? "true" : "false", st.idleB ? "true" : "false",
+                    st.suspended ? "true" : "false",
+                    (unsigned long long)st.wakeups, (unsigned long long)st.idleWakeups,
+                    (unsigned long long)st.wakeupsAvoided, st.suspends, st.resumes,
+                    st.lastResumeMs, st.cpuSavedMs);
+                std::cout << buf << "\n";
+            }
+        }
+        else if (cmd == "set_ramp") {
+            bridge.eng.setParamRampMs(kv.count("ms") ? std::stoi(kv["ms"]) : 20);
             std::cout << R"({"ok":true})" << "\n";
         }
         // НОВОЕ: тестовый тон
@@ -138,6 +306,7 @@ int main(){
                 std::cout << (ok ? R"({"ok":true})" : R"({"ok":false})") << "\n";
             }
         }
+#ifdef _WIN32
         else if(cmd=="set_hwnd"){
             auto s = kv.count("hwnd") ? kv["hwnd"] : "";
             auto parseHWND = [](const std::string& t)->HWND{
@@ -161,6 +330,7 @@ int main(){
                 std::cout << std::dec;
             }
         }
+#endif
                else if (cmd == "set_swap") {
             bool v = false;
             if (kv.count("v")) {
@@ -168,7 +338,8 @@ int main(){
                 std::transform(s.begin(), s.end(), s.begin(), ::tolower);
                 v = (s == "1" || s == "true" || s == "yes");
             }
-            bridge.eng.setSwapLR(v);
+            long long at = kv.count("at_ms") ? std::stoll(kv["at_ms"]) * fmt.sr / 1000 : -1;
+            bridge.eng.setSwapLR(v, at);
             std::cout << R"({"ok":true})" << "\n";
         }
 
@@ -192,9 +363,192 @@ int main(){
                     << ",\"rmsR\":"  << rmsR
                     << ",\"peakL\":" << peakL
                     << ",\"peakR\":" << peakR
-                    << "}\n";
+                    << ",\"outputs\":[";
+                // НОВОЕ: метры по обоим устройствам и всем каналам
+                for (int dev = 0; dev < 2; ++dev) {
+                    DualOutDeviceMeters m{};
+                    bridge.eng.getMeters(dev, m);
+                    std::cout << (dev ? "," : "") << "{\"dev\":\"" << (dev ? "B" : "A") << "\",\"ch\":[";
+                    for (uint32_t c = 0; c < m.channels; ++c) {
+                        std::cout << (c ? "," : "")
+                                  << "{\"rms\":"   << m.ch[c].rms
+                                  << ",\"peak\":"  << m.ch[c].peak
+                                  << ",\"hold\":"  << m.ch[c].hold
+                                  << ",\"clips\":" << m.ch[c].clips << "}";
+                    }
+                    std::cout << "],\"cb_us\":"   << m.cbUsAvg
+                              << ",\"cb_us_max\":" << m.cbUsMax
+                              << ",\"meter_us\":"  << m.meterUsAvg
+                              << ",\"tap\":"       << (m.tapped ? "true" : "false")
+                              << ",\"tap_us\":"    << m.tapUsAvg
+                              << ",\"tap_drops\":" << m.tapDrops
+                              << ",\"budget_us\":" << m.periodUs
+                              << ",\"limiter\":"    << (m.limiterOn ? "true" : "false")
+                              << ",\"gr_db\":"      << m.limiterDb
+                              << ",\"gr_max_db\":"  << m.limiterMaxDb << "}";
+                }
+                std::cout << "]}\n";
+            }
+        }
+        // НОВОЕ: лог-полосы спектра выхода A (для аудио-реакции UI)
+        else if (cmd == "spectrum") {
+            DualOutSpectrum sp{};
+            if (!bridge.eng.getSpectrum(sp)) {
+                std::cout << R"({"ok":false,"err":"no_spectrum"})" << "\n";
+            } else {
+                std::string js = "{\"ok\":true,\"bands\":[";
+                char num[32];
+                for (uint32_t k = 0; k < kDualOutSpectrumBands; ++k) {
+                    std::snprintf(num, sizeof(num), k ? ",%.1f" : "%.1f", sp.bandsDb[k]);
+                    js += num;
+                }
+                js += "],\"hz\":[";
+                for (uint32_t k = 0; k < kDualOutSpectrumBands; ++k) {
+                    std::snprintf(num, sizeof(num), k ? ",%.0f" : "%.0f", sp.bandHz[k]);
+                    js += num;
+                }
+                char tail[160];
+                std::snprintf(tail, sizeof(tail),
+                              "],\"pos_ms\":%lld,\"frames\":%llu,\"us_avg\":%.1f,\"us_max\":%.1f}",
+                              (long long)(sp.media * 1000 / fmt.sr), (unsigned long long)sp.frames,
+                              sp.usAvg, sp.usMax);
+                std::cout << js << tail << "\n";
+            }
+        }
+        else if (cmd == "tempo") {
+            float bpm = 0.0f, conf = 0.0f;
+            uint64_t onsets = 0;
+            bridge.eng.getTempo(bpm, conf, onsets);
+            char buf[160];
+            std::snprintf(buf, sizeof(buf),
+                          "{\"ok\":true,\"bpm\":%.1f,\"confidence\":%.2f,\"onsets\":%llu,\"latency_ms\":%d}",
+                          bpm, conf, (unsigned long long)onsets, bridge.eng.outputLatencyMs());
+            std::cout << buf << "\n";
+        }
+        // НОВОЕ: задержка выхода, которую драйвер не показывает (Bluetooth)
+        else if (cmd == "set_output_latency") {
+            int ms = kv.count("ms") ? std::stoi(kv["ms"]) : 0;
+            bridge.eng.setOutputLatencyMs(ms);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: нормализация громкости по фоновому скану R128
+        else if (cmd == "set_loudness") {
+            float target = kv.count("target") ? std::stof(kv["target"]) : -18.0f;
+            bool on = true;
+            if (kv.count("auto")) {
+                std::string v = kv["auto"];
+                std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+                on = (v == "1" || v == "true" || v == "yes");
+            }
+            player.set_loudness(target, on);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // НОВОЕ: min/max пики диапазона [start_ms, end_ms) в points точек
+        else if (cmd == "waveform") {
+            std::wstring url = kv.count("url") ? wfromu8(kv["url"]) : curUrl;
+            long long startMs = kv.count("start_ms") ? std::stoll(kv["start_ms"]) : 0;
+            long long endMs   = kv.count("end_ms")   ? std::stoll(kv["end_ms"])   : 0;
+            uint32_t points   = kv.count("points")   ? (uint32_t)std::stoul(kv["points"]) : 512;
+            points = (std::min)(points, 4096u);
+            WaveformSlice ws;
+            const auto t0 = std::chrono::steady_clock::now();
+            if (!wave.ensure(url)) {
+                std::cout << (wave.failed(url) ? R"({"ok":false,"err":"decode_failed"})"
+                                               : R"({"ok":false,"err":"not_a_file"})") << "\n";
+            } else if (endMs <= startMs || !wave.slice(url, startMs, endMs, points, ws)) {
+                std::cout << R"({"ok":false,"err":"bad_range"})" << "\n";
+            } else {
+                const long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+                std::string js;
+                js.reserve(points * 16 + 128);
+                char num[96];
+                std::snprintf(num, sizeof(num), "{\"ok\":true,\"pct\":%d,\"complete\":%s,\"frames_per_bin\":%u,\"us\":%lld,\"min\":[",
+                              ws.pct, ws.complete ? "true" : "false", ws.framesPerBin, us);
+                js += num;
+                for (uint32_t i = 0; i < points; ++i) {
+                    std::snprintf(num, sizeof(num), i ? ",%.3f" : "%.3f", ws.mins[i] / 32768.0f);
+                    js += num;
+                }
+                js += "],\"max\":[";
+                for (uint32_t i = 0; i < points; ++i) {
+                    std::snprintf(num, sizeof(num), i ? ",%.3f" : "%.3f", ws.maxs[i] / 32768.0f);
+                    js += num;
+                }
+                std::cout << js << "]}\n";
+            }
+        }
+        // НОВОЕ: где читать телеметрию без опроса (общая память, seqlock)
+        else if (cmd == "telemetry") {
+            const std::wstring name = bridge.eng.telemetryName();
+            if (name.empty()) {
+                std::cout << R"({"ok":false,"err":"no_telemetry"})" << "\n";
+            } else {
+                std::string n8;
+                for (wchar_t c : name) n8 += (c == L'\\') ? std::string("\\\\") : std::string(1, (char)c);
+                std::cout << "{\"ok\":true,\"name\":\"" << n8 << "\",\"pid\":" << process_id()
+                          << ",\"size\":" << sizeof(dualout_telemetry)
+                          << ",\"version\":" << DUALOUT_TM_VERSION << ",\"hz\":60}\n";
             }
         }
+        // НОВОЕ: детектор артефактов выхода; лог — рядом с кэшами, для баг-репортов
+        else if (cmd == "set_glitch") {
+            bool on = true;
+            if (kv.count("on")) {
+                std::string v = kv["on"];
+                std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+                on = (v == "1" || v == "true" || v == "yes");
+            }
+            static bool logSet = false;
+            if (on && !logSet) {
+                bridge.eng.setGlitchLog(cache_file(L"glitches.log"));
+                logSet = true;
+            }
+            bridge.eng.setGlitchDetect(on);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        // счётчики по устройствам + события из кольца с seq > since
+        else if (cmd == "glitches") {
+            static const char* const kinds[] = { "discontinuity", "gap", "clip_burst", "underrun" };
+            uint64_t since = kv.count("since") ? std::stoull(kv["since"]) : 0;
+            std::vector<DualOutGlitch> evs;
+            bridge.eng.getGlitches(since, evs);
+            std::string js = "{\"ok\":true,\"outputs\":[";
+            char buf[256];
+            for (int dev = 0; dev < 2; ++dev) {
+                DualOutGlitchStats st{};
+                bridge.eng.getGlitchStats(dev, st);
+                std::snprintf(buf, sizeof(buf),
+                              "%s{\"dev\":\"%c\",\"enabled\":%s,\"discontinuities\":%u,\"gaps\":%u,\"clip_bursts\":%u,\"underruns\":%u,\"us_avg\":%.1f}",
+                              dev ? "," : "", dev ? 'B' : 'A', st.enabled ? "true" : "false",
+                              st.discontinuities, st.gaps, st.clipBursts, st.underruns, st.usAvg);
+                js += buf;
+            }
+            js += "],\"events\":[";
+            for (size_t i = 0; i < evs.size(); ++i) {
+                const DualOutGlitch& e = evs[i];
+                std::snprintf(buf, sizeof(buf),
+                              "%s{\"seq\":%llu,\"dev\":\"%c\",\"kind\":\"%s\",\"ch\":%d,\"pos_ms\":%lld,\"value\":%.3f,\"wall_ms\":%lld}",
+                              i ? "," : "", (unsigned long long)e.seq, e.dev ? 'B' : 'A', kinds[e.kind], e.ch,
+                              (long long)(e.media * 1000 / (fmt.sr ? fmt.sr : 48000)), e.value, (long long)e.wallMs);
+                js += buf;
+            }
+            std::cout << js << "]}\n";
+        }
+        else if (cmd == "set_tap") {
+            bool on = true;
+            if (kv.count("on")) {
+                std::string v = kv["on"];
+                std::transform(v.begin(), v.end(), v.begin(), ::tolower);
+                on = (v == "1" || v == "true" || v == "yes");
+            }
+            bridge.eng.setAnalysisTap(on);
+            std::cout << R"({"ok":true})" << "\n";
+        }
+        else if (cmd == "reset_meters") {
+            bridge.eng.resetMeters();
+            std::cout << R"({"ok":true})" << "\n";
+        }
 
         else if(cmd=="status"){
             std::cout << player.status_json() << "\n";
@@ -209,5 +563,13 @@ int main(){
         }
 
     }
+
+    player.stop();
+    {
+        std::lock_guard<std::mutex> lk(g_evMtx);
+        g_evStop = true;
+    }
+    g_evCv.notify_one();
+    evThread.join();
     return 0;
 }
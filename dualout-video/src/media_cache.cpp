@@ -0,0 +1,152 @@
+#include "media_cache.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cstdlib>
+#include <system_error>
+#endif
+#include <cstdio>
+#include <filesystem>
+
+#ifdef _WIN32
+bool file_identity(const std::wstring& path, FileIdentity& out){
+  WIN32_FILE_ATTRIBUTE_DATA fa{};
+  if(!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &fa)) return false;
+  out.size  = ((uint64_t)fa.nFileSizeHigh << 32) | fa.nFileSizeLow;
+  out.mtime = ((uint64_t)fa.ftLastWriteTime.dwHighDateTime << 32) | fa.ftLastWriteTime.dwLowDateTime;
+  return true;
+}
+
+std::wstring cache_dir(){
+  wchar_t buf[1024];
+  DWORD n = GetEnvironmentVariableW(L"LOCALAPPDATA", buf, 1024);
+  std::wstring dir;
+  if(n > 0 && n < 1024){
+    dir.assign(buf, n);
+  } else {
+    n = GetTempPathW(1024, buf);
+    if(n == 0 || n >= 1024) return L".";
+    dir.assign(buf, n);
+  }
+  if(!dir.empty() && dir.back() != L'\\' && dir.back() != L'/') dir += L'\\';
+  dir += L"DualOut";
+  CreateDirectoryW(dir.c_str(), nullptr);   // уже есть — не ошибка
+  return dir;
+}
+#else
+bool file_identity(const std::wstring& path, FileIdentity& out){
+  std::error_code ec;
+  const std::filesystem::path p(path);
+  if(!std::filesystem::is_regular_file(p, ec)) return false;
+  const uintmax_t size = std::filesystem::file_size(p, ec);
+  if(ec) return false;
+  const auto t = std::filesystem::last_write_time(p, ec);
+  if(ec) return false;
+  out.size  = (uint64_t)size;
+  out.mtime = (uint64_t)t.time_since_epoch().count();
+  return true;
+}
+
+std::wstring cache_dir(){
+  std::filesystem::path dir;
+  if(const char* x = std::getenv("XDG_CACHE_HOME"); x && *x) dir = x;
+  else if(const char* h = std::getenv("HOME"); h && *h) dir = std::filesystem::path(h) / ".cache";
+  else dir = "/tmp";
+  dir /= "DualOut";
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);   // уже есть — не ошибка
+  return dir.wstring();
+}
+#endif
+
+std::wstring cache_file(const std::wstring& name){
+  return (std::filesystem::path(cache_dir()) / name).wstring();
+}
+
+std::wstring cache_file_name(const std::wstring& path, const FileIdentity& id, const wchar_t* ext){
+  // FNV-1a по пути, размеру и mtime — имя меняется вместе с файлом
+  uint64_t h = 1469598103934665603ull;
+  auto mix = [&h](const void* p, size_t n){
+    const uint8_t* b = static_cast<const uint8_t*>(p);
+    for(size_t i = 0; i < n; ++i){ h ^= b[i]; h *= 1099511628211ull; }
+  };
+  mix(path.data(), path.size() * sizeof(wchar_t));
+  mix(&id.size, sizeof(id.size));
+  mix(&id.mtime, sizeof(id.mtime));
+  wchar_t name[64];
+  std::swprintf(name, 64, L"%016llx%ls", (unsigned long long)h, ext ? ext : L"");
+  return cache_file(name);
+}
+
+#ifdef _WIN32
+std::string utf8_from_wide(const std::wstring& w){
+  if(w.empty()) return {};
+  int n = WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), nullptr, 0, nullptr, nullptr);
+  if(n <= 0) return {};
+  std::string s((size_t)n, '\0');
+  WideCharToMultiByte(CP_UTF8, 0, w.data(), (int)w.size(), s.data(), n, nullptr, nullptr);
+  return s;
+}
+
+std::wstring wide_from_utf8(const std::string& s){
+  if(s.empty()) return {};
+  int n = MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), nullptr, 0);
+  if(n <= 0) return {};
+  std::wstring w((size_t)n, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, s.data(), (int)s.size(), w.data(), n);
+  return w;
+}
+
+void set_background_priority(bool on){
+  SetThreadPriority(GetCurrentThread(), on ? THREAD_MODE_BACKGROUND_BEGIN : THREAD_MODE_BACKGROUND_END);
+}
+#else
+// wchar_t здесь — UTF-32; неверные кодовые точки -> U+FFFD
+std::string utf8_from_wide(const std::wstring& w){
+  std::string s;
+  s.reserve(w.size());
+  for(wchar_t wc : w){
+    uint32_t c = (uint32_t)wc;
+    if(c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) c = 0xFFFD;
+    if(c < 0x80){
+      s += (char)c;
+    } else if(c < 0x800){
+      s += (char)(0xC0 | (c >> 6));
+      s += (char)(0x80 | (c & 0x3F));
+    } else if(c < 0x10000){
+      s += (char)(0xE0 | (c >> 12));
+      s += (char)(0x80 | ((c >> 6) & 0x3F));
+      s += (char)(0x80 | (c & 0x3F));
+    } else {
+      s += (char)(0xF0 | (c >> 18));
+      s += (char)(0x80 | ((c >> 12) & 0x3F));
+      s += (char)(0x80 | ((c >> 6) & 0x3F));
+      s += (char)(0x80 | (c & 0x3F));
+    }
+  }
+  return s;
+}
+
+std::wstring wide_from_utf8(const std::string& s){
+  std::wstring w;
+  w.reserve(s.size());
+  for(size_t i = 0; i < s.size();){
+    const uint8_t b = (uint8_t)s[i];
+    const size_t len = b < 0x80 ? 1 : (b >> 5) == 0x6 ? 2 : (b >> 4) == 0xE ? 3 : (b >> 3) == 0x1E ? 4 : 0;
+    if(len == 0 || i + len > s.size()){ w += (wchar_t)0xFFFD; ++i; continue; }
+    uint32_t c = len == 1 ? b : (uint32_t)(b & (0x7F >> len));
+    bool ok = true;
+    for(size_t k = 1; k < len; ++k){
+      const uint8_t t = (uint8_t)s[i + k];
+      if((t & 0xC0) != 0x80){ ok = false; break; }
+      c = (c << 6) | (t & 0x3F);
+    }
+    if(!ok){ w += (wchar_t)0xFFFD; ++i; continue; }
+    w += (wchar_t)c;
+    i += len;
+  }
+  return w;
+}
+
+void set_background_priority(bool){}
+#endif
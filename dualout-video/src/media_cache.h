@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// Общие помощники для кэшей по медиафайлам (громкость, waveform и т.п.)
+
+// Размер и время изменения файла — ключ кэша. false для не-файлов (URL).
+struct FileIdentity {
+  uint64_t size  = 0;
+  uint64_t mtime = 0;   // FILETIME, 100 нс (не в Windows — тики file_clock)
+};
+bool file_identity(const std::wstring& path, FileIdentity& out);
+
+// %LOCALAPPDATA%\DualOut (создаётся при первом вызове), иначе %TEMP%;
+// не в Windows — $XDG_CACHE_HOME/DualOut, ~/.cache/DualOut или /tmp
+std::wstring cache_dir();
+// Файл name в cache_dir()
+std::wstring cache_file(const std::wstring& name);
+
+// Имя файла кэша для медиафайла: хэш пути + размера + mtime
+std::wstring cache_file_name(const std::wstring& path, const FileIdentity& id, const wchar_t* ext);
+
+std::string utf8_from_wide(const std::wstring& w);
+std::wstring wide_from_utf8(const std::string& s);
+
+// Фоновый приоритет потока (сканы, индексы): ниже CPU и I/O, чем у
+// воспроизведения. Только Windows; в других ОС ничего не делает.
+void set_background_priority(bool on);
@@ -1,6 +1,12 @@
 #include "mf_utils.h"
 #include "mf_audio_reader.h"
+#include "seek_index.h"
 #include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
 #include <wrl/client.h>
 using Microsoft::WRL::ComPtr;
 
@@ -17,40 +23,253 @@ static void setAudioPcm(ComPtr<IMFSourceReader>& r, PcmDesc& fmt){
   MF_THROW(r->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, out.Get()));
 }
 
-bool mf_stream_audio_pcm(const std::wstring& url, const PcmCallback& onPcm,
-                         PcmDesc* outFmt, std::atomic_bool* stopFlag){
-  ComInit com; MFInit mf;
-  ComPtr<IMFAttributes> attr; MF_THROW(MFCreateAttributes(&attr, 2));
-  MF_THROW(attr->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE));
-  MF_THROW(attr->SetUINT32(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE));
+bool mf_query_pcm_format(IMFMediaType* type, PcmSourceFormat& out){
+  if(!type) return false;
+  UINT32 sr = out.sr, ch = out.ch, bps = out.bits;
+  type->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &sr);
+  type->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &ch);
+  type->GetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, &bps);
+  GUID subtype{};
+  type->GetGUID(MF_MT_SUBTYPE, &subtype);
+  out.sr = sr;
+  out.ch = ch;
+  out.bits = bps ? bps : 16;
+  out.isFloat = IsEqualGUID(subtype, MFAudioFormat_Float);
+  return true;
+}
+
+bool mf_build_seek_index(const std::wstring& url, SeekIndex& out, const std::atomic_bool& stop){
+  try {
+    ComInit com;
+    MFInit  mf;
+    ComPtr<IMFAttributes> attr; MF_THROW(MFCreateAttributes(&attr, 1));
+    MF_THROW(attr->SetUINT32(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE));
+    ComPtr<IMFSourceReader> r;
+    MF_THROW(MFCreateSourceReaderFromURL(url.c_str(), attr.Get(), &r));
+    // только аудио и в родном типе: ридер отдаёт пакеты демультиплексора как есть
+    MF_THROW(r->SetStreamSelection((DWORD)MF_SOURCE_READER_ALL_STREAMS, FALSE));
+    MF_THROW(r->SetStreamSelection((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, TRUE));
+    ComPtr<IMFMediaType> native;
+    MF_THROW(r->GetNativeMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &native));
+    MF_THROW(r->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, native.Get()));
+
+    // кодеки с перекрытием окон: первый пакет после seek декодируется неполно
+    GUID subtype{};
+    native->GetGUID(MF_MT_SUBTYPE, &subtype);
+    const bool lapped = IsEqualGUID(subtype, MFAudioFormat_AAC) || IsEqualGUID(subtype, MFAudioFormat_MP3) ||
+                        IsEqualGUID(subtype, MFAudioFormat_MPEG) || IsEqualGUID(subtype, MFAudioFormat_Dolby_AC3) ||
+                        IsEqualGUID(subtype, MFAudioFormat_WMAudioV8) || IsEqualGUID(subtype, MFAudioFormat_WMAudioV9);
+    out.preroll = lapped ? 2 : 0;
+    out.pts.clear();
+
+    while(!stop.load()){
+      DWORD streamIndex=0, flags=0; LONGLONG ts=0; ComPtr<IMFSample> sample;
+      MF_THROW(r->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &streamIndex, &flags, &ts, &sample));
+      if(flags & MF_SOURCE_READERF_ENDOFSTREAM) break;
+      if(!sample) continue;
+      if(out.pts.empty() || ts > out.pts.back()) out.pts.push_back(ts);
+    }
+    return !stop.load() && !out.pts.empty();
+  } catch (const std::exception&) {
+    return false;
+  }
+}
 
-  ComPtr<IMFSourceReader> r;
-  MF_THROW(MFCreateSourceReaderFromURL(url.c_str(), attr.Get(), &r));
+MfPcmStream::MfPcmStream() = default;
+MfPcmStream::~MfPcmStream(){ close(); }
 
-  // запрашиваем нативный тип, чтобы знать что приходит
-  ComPtr<IMFMediaType> native; MF_THROW(r->GetNativeMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &native));
-  UINT32 sr=48000, ch=2, bps=16;
-  native->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &sr);
-  native->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &ch);
-  native->GetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, &bps);
+bool MfPcmStream::open(const std::wstring& url, uint32_t sr, uint32_t ch){
+  close();
+  try {
+    audio_decoder_thread_init();
+    ComPtr<IMFAttributes> attr; MF_THROW(MFCreateAttributes(&attr, 2));
+    MF_THROW(attr->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE));
+    MF_THROW(attr->SetUINT32(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE));
+    if (FAILED(MFCreateSourceReaderFromURL(url.c_str(), attr.Get(), &reader_))) {
+      // часть источников по URL не резолвится, а как файл открывается
+      ComPtr<IMFByteStream> bs;
+      MF_THROW(MFCreateFile(MF_ACCESSMODE_READ, MF_OPENMODE_FAIL_IF_NOT_EXIST, MF_FILEFLAGS_NONE, url.c_str(), &bs));
+      MF_THROW(MFCreateSourceReaderFromByteStream(bs.Get(), attr.Get(), &reader_));
+      std::cerr << "[MfPcmStream] fallback to byte-stream reader" << std::endl;
+    }
 
-  PcmDesc pcm{sr, ch, 16}; // для MVP приводим к 16 бит
-  setAudioPcm(r, pcm);
-  if(outFmt) *outFmt = pcm;
+    // просим сразу формат движка; что реально дали — читаем обратно
+    fmt_ = PcmDesc{sr, ch, 16};
+    setAudioPcm(reader_, fmt_);
+  } catch (const std::exception&) {
+    std::cerr << "[MfPcmStream] Media Foundation reader failed. If this file carries AAC audio "
+              << "(e.g. MOV/MP4) install the Media Feature Pack or register the AAC decoder "
+              << "(CLSID_CMSAACDecMFT)." << std::endl;
+    close();
+    failed_ = true;
+    return false;
+  }
+  return refresh_format();
+}
 
-  while(true){
-    if(stopFlag && stopFlag->load()) return true;
+void MfPcmStream::close(){
+  release_sample();
+  reader_.Reset();
+  index_.reset();
+  eof_ = false;
+  failed_ = false;
+  copied_ = 0;
+  avoided_ = 0;
+}
+
+bool MfPcmStream::refresh_format(){
+  ComPtr<IMFMediaType> current;
+  if(!reader_ || FAILED(reader_->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &current))){
+    failed_ = true;
+    return false;
+  }
+  PcmSourceFormat src{fmt_.sr, fmt_.ch, fmt_.bps, false};
+  mf_query_pcm_format(current.Get(), src);
+  conv_.configure(src);
+  fmt_ = PcmDesc{src.sr, src.ch, 16};
+  return true;
+}
+
+void MfPcmStream::release_sample(){
+  bufs_.clear();
+  bufIdx_ = 0;
+  bufOff_ = 0;
+}
+
+// Следующий сэмпл MF -> bufs_. Буферы берутся как есть; склеиваем, только
+// если граница буфера режет кадр.
+bool MfPcmStream::next_sample(){
+  release_sample();
+  while(reader_ && !eof_ && !failed_){
     DWORD streamIndex=0, flags=0; LONGLONG ts=0; ComPtr<IMFSample> sample;
-    HRESULT hr = r->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &streamIndex, &flags, &ts, &sample);
-    if(FAILED(hr)) return false;
-    if(flags & MF_SOURCE_READERF_ENDOFSTREAM) break;
+    HRESULT hr = reader_->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &streamIndex, &flags, &ts, &sample);
+    if(FAILED(hr)){ failed_ = true; break; }
+    if(flags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED){
+      if(!refresh_format()) break;
+    }
+    if(flags & MF_SOURCE_READERF_ENDOFSTREAM){ eof_ = true; break; }
     if(!sample) continue;
 
-    ComPtr<IMFMediaBuffer> buf; MF_THROW(sample->ConvertToContiguousBuffer(&buf));
-    BYTE* p=nullptr; DWORD cb=0; MF_THROW(buf->Lock(&p, nullptr, &cb));
-    size_t frames = cb / (pcm.ch * (pcm.bps/8));
-    onPcm(p, frames, ts);
+    DWORD count = 0;
+    if(FAILED(sample->GetBufferCount(&count)) || count == 0) continue;
+    const uint32_t bpf = conv_.bytesPerFrame();
+    bool aligned = true;
+    DWORD total = 0;
+    for(DWORD i = 0; i < count; ++i){
+      ComPtr<IMFMediaBuffer> buf; DWORD len = 0;
+      if(FAILED(sample->GetBufferByIndex(i, &buf)) || FAILED(buf->GetCurrentLength(&len))) { aligned = false; break; }
+      if(len % bpf) aligned = false;
+      total += len;
+      bufs_.push_back(buf);
+    }
+    if(!aligned){
+      bufs_.clear();
+      ComPtr<IMFMediaBuffer> buf;
+      if(FAILED(sample->ConvertToContiguousBuffer(&buf))) continue;
+      bufs_.push_back(buf);
+      if(count > 1) copied_ += total;
+    } else if(count > 1){
+      avoided_ += total;   // столько скопировал бы ConvertToContiguousBuffer
+    }
+    pendPts_ = ts;
+    return true;
+  }
+  return false;
+}
+
+size_t MfPcmStream::read(int16_t* dst, size_t maxFrames, int64_t* pts100ns){
+  size_t got = 0;
+  // сэмпл из одних пустых буферов — берём следующий: 0 кадров значит конец
+  while(got == 0){
+    if(bufIdx_ >= bufs_.size() && !next_sample()) return 0;
+    if(pts100ns) *pts100ns = pendPts_;
+    got = read_buffers(dst, maxFrames);
+  }
+  pendPts_ += (int64_t)got * 10000000 / (fmt_.sr ? fmt_.sr : 48000);
+  return got;
+}
+
+size_t MfPcmStream::read_buffers(int16_t* dst, size_t maxFrames){
+  const uint32_t bpf = conv_.bytesPerFrame();
+  size_t got = 0;
+  while(got < maxFrames && bufIdx_ < bufs_.size()){
+    IMFMediaBuffer* buf = bufs_[bufIdx_].Get();
+    BYTE* p=nullptr; DWORD cb=0;
+    if(FAILED(buf->Lock(&p, nullptr, &cb))){ ++bufIdx_; bufOff_ = 0; continue; }
+    const size_t avail = cb > bufOff_ ? (cb - bufOff_) / bpf : 0;
+    const size_t n = (std::min)(avail, maxFrames - got);
+    conv_.convertTo(dst + got * fmt_.ch, p + bufOff_, n);
     buf->Unlock();
+
+    const size_t outBytes = n * fmt_.ch * sizeof(int16_t);
+    copied_ += outBytes;
+    if(conv_.needsConversion()) avoided_ += outBytes;   // раньше: scratch, потом memcpy
+    got += n;
+    bufOff_ += n * bpf;
+    if(n == avail){ ++bufIdx_; bufOff_ = 0; }
+  }
+  if(bufIdx_ >= bufs_.size()) release_sample();
+  return got;
+}
+
+// Кадры текущего сэмпла пропускаются сдвигом по буферам — без Lock и конвертации
+size_t MfPcmStream::skip_frames(size_t frames){
+  const uint32_t bpf = conv_.bytesPerFrame();
+  size_t done = 0;
+  while(done < frames && bufIdx_ < bufs_.size()){
+    DWORD cb = 0;
+    bufs_[bufIdx_]->GetCurrentLength(&cb);
+    const size_t avail = cb > bufOff_ ? (cb - bufOff_) / bpf : 0;
+    const size_t n = (std::min)(avail, frames - done);
+    done += n;
+    bufOff_ += n * bpf;
+    if(n == avail){ ++bufIdx_; bufOff_ = 0; }
+  }
+  if(bufIdx_ >= bufs_.size()) release_sample();
+  return done;
+}
+
+int64_t MfPcmStream::next_pts(){
+  if(bufIdx_ >= bufs_.size() && !next_sample()) return -1;
+  return pendPts_;
+}
+
+size_t MfPcmStream::skip(size_t frames){
+  const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+  size_t done = 0;
+  while(done < frames){
+    if(bufIdx_ >= bufs_.size() && !next_sample()) break;
+    const size_t n = skip_frames(frames - done);
+    pendPts_ += (int64_t)n * 10000000 / sr;
+    done += n;
   }
+  return done;
+}
+
+bool MfPcmStream::seek_100ns(int64_t pos){
+  if(!reader_) return false;
+  release_sample();
+  // по индексу — точно на начало пакета с запасом на прогрев декодера
+  const int64_t point = index_ ? index_->seek_point(pos) : -1;
+  const int64_t to = point >= 0 ? point : pos;
+  PROPVARIANT var{};
+  var.vt = VT_I8;
+  var.hVal.QuadPart = to;
+  HRESULT hr = reader_->SetCurrentPosition(GUID_NULL, var);
+  PropVariantClear(&var);
+  if(FAILED(hr)) return false;
+  eof_ = false;
   return true;
 }
+
+int64_t MfPcmStream::duration_100ns() const{
+  if(!reader_) return 0;
+  PROPVARIANT var{};
+  PropVariantInit(&var);
+  int64_t dur = 0;
+  if(SUCCEEDED(reader_->GetPresentationAttribute(MF_SOURCE_READER_MEDIASOURCE, MF_PD_DURATION, &var))){
+    dur = (int64_t)var.hVal.QuadPart;
+  }
+  PropVariantClear(&var);
+  return dur;
+}
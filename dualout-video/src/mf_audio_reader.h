@@ -3,9 +3,67 @@
 #include <functional>
 #include <cstdint>
 #include <atomic>
+#include <memory>
+#include <vector>
+#include <mfreadwrite.h>
+#include <wrl/client.h>
+#include "pcm_convert.h"
+#include "audio_decoder.h"
 
-struct PcmDesc { uint32_t sr, ch, bps; };
-using PcmCallback = std::function<void(const void* data, size_t frames, int64_t pts100ns)>;
+// Текущий тип ридера -> sr/ch/bits/float (то, что реально придёт в ReadSample)
+bool mf_query_pcm_format(IMFMediaType* type, PcmSourceFormat& out);
 
-bool mf_stream_audio_pcm(const std::wstring& url, const PcmCallback& onPcm,
-                         PcmDesc* outFmt=nullptr, std::atomic_bool* stopFlag=nullptr);
+// НОВОЕ: индекс seek по сжатым пакетам первой аудиодорожки (без декодера).
+// Долго на больших файлах — для фонового потока; stop прерывает.
+bool mf_build_seek_index(const std::wstring& url, SeekIndex& out, const std::atomic_bool& stop);
+
+// Pull-декодер: MF source reader -> interleaved s16 на заданной частоте/каналах.
+// COM/MF — на поток (audio_decoder_thread_init, open() зовёт сам), не на
+// объект; ридер свободно-поточный (MTA).
+class MfPcmStream : public AudioDecoder {
+public:
+  MfPcmStream();
+  ~MfPcmStream() override;
+
+  bool open(const std::wstring& url, uint32_t sr = 48000, uint32_t ch = 2) override;
+  void close() override;
+  const PcmDesc& format() const override { return fmt_; }
+  const char* name() const override { return "mf"; }
+
+  // НОВОЕ: буферы сэмпла MF читаются по очереди и конвертируются прямо в dst —
+  // без ConvertToContiguousBuffer и промежуточного s16. Остаток сэмпла
+  // отдаётся следующим вызовом.
+  size_t read(int16_t* dst, size_t maxFrames, int64_t* pts100ns) override;
+  bool seek_100ns(int64_t pos) override;
+  int64_t duration_100ns() const override;
+
+  bool eof() const override { return eof_; }
+  bool failed() const override { return failed_; }
+  uint64_t bytes_copied() const override { return copied_; }
+  uint64_t bytes_copy_avoided() const override { return avoided_; }
+  // С индексом seek встаёт на начало пакета за прогрев до цели; лишнее до
+  // цели вызывающий выбрасывает через skip() — сдвигом по буферам сэмпла
+  void set_seek_index(std::shared_ptr<const SeekIndex> idx) override { index_ = std::move(idx); }
+  int64_t next_pts() override;
+  size_t skip(size_t frames) override;
+
+private:
+  bool refresh_format();
+  bool next_sample();
+  size_t read_buffers(int16_t* dst, size_t maxFrames);
+  size_t skip_frames(size_t frames);
+  void release_sample();
+
+  Microsoft::WRL::ComPtr<IMFSourceReader> reader_;
+  // недочитанный сэмпл: его буферы, текущий и сколько байт в нём уже отдано
+  std::vector<Microsoft::WRL::ComPtr<IMFMediaBuffer>> bufs_;
+  size_t  bufIdx_ = 0;
+  size_t  bufOff_ = 0;
+  int64_t pendPts_ = 0;
+  PcmS16Converter conv_;
+  PcmDesc fmt_{48000, 2, 16};
+  uint64_t copied_ = 0, avoided_ = 0;
+  std::shared_ptr<const SeekIndex> index_;
+  bool eof_ = false;
+  bool failed_ = false;
+};
@@ -0,0 +1,395 @@
+#include "pcm_cache.h"
+#include "media_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+std::atomic<bool>     g_enabled{false};
+std::atomic<uint64_t> g_maxBytes{4ull << 30};
+
+constexpr char     kMagic[8]  = { 'D','O','P','C','M','0','1','\0' };
+constexpr uint64_t kPageBytes = 4096;
+
+// Самые старые .pcm удаляются, пока новый файл не влезет в лимит
+void evict_for(uint64_t need, const std::wstring& keep){
+  namespace fs = std::filesystem;
+  struct Entry { fs::file_time_type t; uint64_t size; fs::path path; };
+  std::vector<Entry> files;
+  uint64_t total = 0;
+  std::error_code ec;
+  for (fs::directory_iterator it(fs::path(cache_dir()), ec), end; !ec && it != end; it.increment(ec)) {
+    if (it->path().extension() != L".pcm" || it->path() == fs::path(keep)) continue;
+    const uint64_t size = it->file_size(ec);
+    if (ec) { ec.clear(); continue; }
+    files.push_back(Entry{ it->last_write_time(ec), size, it->path() });
+    total += size;
+  }
+  std::sort(files.begin(), files.end(), [](const Entry& a, const Entry& b){ return a.t < b.t; });
+  const uint64_t maxBytes = g_maxBytes.load();
+  for (const Entry& e : files) {
+    if (total + need <= maxBytes) break;
+    if (fs::remove(e.path, ec)) total -= e.size;   // открытый другим — пропускаем
+  }
+}
+} // namespace
+
+void pcm_cache_configure(bool enabled, uint64_t maxBytes){
+  g_enabled.store(enabled);
+  if (maxBytes) g_maxBytes.store(maxBytes);
+}
+
+bool pcm_cache_enabled(){ return g_enabled.load(); }
+
+std::unique_ptr<AudioDecoder> open_cached_audio_decoder(const std::wstring& url, uint32_t sr, uint32_t ch){
+  if (pcm_cache_enabled()) {
+    auto c = std::make_unique<CachedPcmDecoder>();
+    if (c->open(url, sr, ch)) return c;
+  }
+  return open_audio_decoder(url, sr, ch);
+}
+
+// Заголовок файла кэша; за ним uint32_t filled[chunkCount], данные — с dataOffset
+struct CachedPcmDecoder::Header {
+  char     magic[8];
+  uint32_t sr, ch;
+  uint32_t chunkFrames, chunkCount;
+  uint64_t capacityFrames;
+  uint64_t totalFrames;     // точная длина, когда декодер дошёл до конца; 0 — неизвестна
+  int64_t  duration100ns;   // длительность по декодеру на момент создания
+  uint64_t dataOffset;
+  uint64_t reserved;
+};
+
+// Файл, отображённый в память на чтение и запись
+struct CachedPcmDecoder::Mapping {
+  uint8_t* base = nullptr;
+  uint64_t size = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE map  = nullptr;
+#else
+  int fd = -1;
+#endif
+
+  // size == 0 — открыть существующий целиком, иначе создать заново такого размера
+  bool open(const std::wstring& path, uint64_t newSize){
+#ifdef _WIN32
+    file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                       newSize ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER li{};
+    if (newSize) {
+      li.QuadPart = (LONGLONG)newSize;
+      if (!SetFilePointerEx(file, li, nullptr, FILE_BEGIN) || !SetEndOfFile(file)) return false;
+    } else if (!GetFileSizeEx(file, &li)) {
+      return false;
+    }
+    size = (uint64_t)li.QuadPart;
+    if (size == 0) return false;
+    map = CreateFileMappingW(file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+    if (!map) return false;
+    base = static_cast<uint8_t*>(MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+    return base != nullptr;
+#else
+    const std::string p = std::filesystem::path(path).string();
+    fd = ::open(p.c_str(), newSize ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR, 0644);
+    if (fd < 0) return false;
+    if (newSize && ::ftruncate(fd, (off_t)newSize) != 0) return false;
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) return false;
+    size = (uint64_t)st.st_size;
+    void* p2 = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p2 == MAP_FAILED) return false;
+    base = static_cast<uint8_t*>(p2);
+    return true;
+#endif
+  }
+
+  ~Mapping(){
+#ifdef _WIN32
+    if (base) UnmapViewOfFile(base);
+    if (map) CloseHandle(map);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    if (base) ::munmap(base, size);
+    if (fd >= 0) ::close(fd);
+#endif
+  }
+};
+
+CachedPcmDecoder::CachedPcmDecoder() = default;
+CachedPcmDecoder::~CachedPcmDecoder(){ close(); }
+
+bool CachedPcmDecoder::open(const std::wstring& url, uint32_t sr, uint32_t ch){
+  close();
+  FileIdentity id;
+  if (!file_identity(url, id)) return false;   // поток/URL — без кэша
+  url_ = url;
+  wantSr_ = sr;
+  wantCh_ = ch;
+
+  wchar_t ext[32];
+  std::swprintf(ext, 32, L".%ux%u.pcm", sr, ch);
+  const std::wstring file = cache_file_name(url, id, ext);
+
+  if (map_existing(file)) {
+    // декодер не нужен, пока читаем записанное
+    fmt_ = PcmDesc{hdr_->sr, hdr_->ch, 16};
+    duration_ = hdr_->duration100ns;
+    std::error_code ec;
+    std::filesystem::last_write_time(std::filesystem::path(file),
+                                     std::filesystem::file_time_type::clock::now(), ec);   // для вытеснения
+    std::cerr << "[PcmCache] hit " << cached_pct() << "% of " << utf8_from_wide(url) << std::endl;
+    return true;
+  }
+
+  inner_ = open_audio_decoder(url, sr, ch);
+  if (!inner_) return false;
+  fmt_ = inner_->format();
+  duration_ = inner_->duration_100ns();
+  if (fmt_.sr == sr && fmt_.ch == ch && duration_ > 0) {
+    // запас на неточную длительность; дальше ёмкости не пишем
+    const uint64_t capacity = (uint64_t)(duration_ * sr / 10000000) + sr;
+    if (!map_new(file, capacity)) {
+      std::cerr << "[PcmCache] cannot create cache file, playing without it" << std::endl;
+    }
+  }
+  return true;
+}
+
+void CachedPcmDecoder::close(){
+  inner_.reset();
+  seekIndex_.reset();
+  hdr_ = nullptr;
+  filled_ = nullptr;
+  data_ = nullptr;
+  map_.reset();
+  duration_ = 0;
+  pos_ = 0;
+  innerPos_ = -1;
+  copied_ = 0;
+  eof_ = false;
+  failed_ = false;
+  served_.store(0);
+  decoded_.store(0);
+  filledFrames_.store(0);
+}
+
+bool CachedPcmDecoder::map_existing(const std::wstring& file){
+  std::error_code ec;
+  if (!std::filesystem::exists(std::filesystem::path(file), ec)) return false;
+  auto m = std::make_unique<Mapping>();
+  if (!m->open(file, 0) || m->size < sizeof(Header)) return false;
+  Header* h = reinterpret_cast<Header*>(m->base);
+  const uint64_t bpf = (uint64_t)h->ch * sizeof(int16_t);
+  if (std::memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 || h->sr != wantSr_ || h->ch != wantCh_ ||
+      h->chunkFrames != kChunkFrames || h->chunkCount == 0 ||
+      (uint64_t)h->chunkCount * kChunkFrames < h->capacityFrames ||
+      h->dataOffset < sizeof(Header) + (uint64_t)h->chunkCount * sizeof(uint32_t) ||
+      h->dataOffset + h->capacityFrames * bpf > m->size) {
+    return false;   // чужой или битый — map_new() перезапишет
+  }
+  const uint32_t* filled = reinterpret_cast<const uint32_t*>(m->base + sizeof(Header));
+  uint64_t sum = 0;
+  for (uint32_t c = 0; c < h->chunkCount; ++c) {
+    if (filled[c] > kChunkFrames || (uint64_t)c * kChunkFrames + filled[c] > h->capacityFrames) return false;
+    sum += filled[c];
+  }
+  map_ = std::move(m);
+  hdr_ = h;
+  filled_ = reinterpret_cast<uint32_t*>(map_->base + sizeof(Header));
+  data_ = reinterpret_cast<int16_t*>(map_->base + h->dataOffset);
+  filledFrames_.store(sum);
+  return true;
+}
+
+bool CachedPcmDecoder::map_new(const std::wstring& file, uint64_t capacityFrames){
+  static_assert(sizeof(Header) == 64, "cache header layout is part of the file format");
+  const uint32_t chunks = (uint32_t)((capacityFrames + kChunkFrames - 1) / kChunkFrames);
+  uint64_t dataOffset = sizeof(Header) + (uint64_t)chunks * sizeof(uint32_t);
+  dataOffset = (dataOffset + kPageBytes - 1) / kPageBytes * kPageBytes;
+  const uint64_t size = dataOffset + capacityFrames * wantCh_ * sizeof(int16_t);
+
+  evict_for(size, file);
+  auto m = std::make_unique<Mapping>();
+  if (!m->open(file, size)) return false;
+  // новый файл — из нулей: все чанки пустые
+  Header* h = reinterpret_cast<Header*>(m->base);
+  h->sr = wantSr_;
+  h->ch = wantCh_;
+  h->chunkFrames = kChunkFrames;
+  h->chunkCount = chunks;
+  h->capacityFrames = capacityFrames;
+  h->totalFrames = 0;
+  h->duration100ns = duration_;
+  h->dataOffset = dataOffset;
+  std::memcpy(h->magic, kMagic, sizeof(kMagic));   // последним: до этого файл не наш
+
+  map_ = std::move(m);
+  hdr_ = h;
+  filled_ = reinterpret_cast<uint32_t*>(map_->base + sizeof(Header));
+  data_ = reinterpret_cast<int16_t*>(map_->base + dataOffset);
+  return true;
+}
+
+bool CachedPcmDecoder::ensure_inner(){
+  if (inner_) return true;
+  inner_ = open_audio_decoder(url_, wantSr_, wantCh_);
+  if (!inner_) return false;
+  if (inner_->format().sr != fmt_.sr || inner_->format().ch != fmt_.ch) {
+    std::cerr << "[PcmCache] decoder format differs from cache" << std::endl;
+    inner_.reset();
+    return false;
+  }
+  if (seekIndex_) inner_->set_seek_index(seekIndex_);
+  innerPos_ = -1;
+  return true;
+}
+
+// Сколько кадров с frame подряд есть в кэше (в пределах чанка)
+size_t CachedPcmDecoder::cached_run(uint64_t frame) const{
+  if (!hdr_) return 0;
+  const uint64_t c = frame / kChunkFrames;
+  if (c >= hdr_->chunkCount) return 0;
+  const uint64_t off = frame - c * kChunkFrames;
+  const uint32_t f = filled_[c];
+  return f > off ? (size_t)(f - off) : 0;
+}
+
+size_t CachedPcmDecoder::read(int16_t* dst, size_t maxFrames, int64_t* pts100ns){
+  if (eof_ || failed_ || maxFrames == 0) return 0;
+  if (hdr_ && hdr_->totalFrames && pos_ >= hdr_->totalFrames) {
+    eof_ = true;
+    return 0;
+  }
+  const size_t run = cached_run(pos_);
+  if (run == 0) return read_decoded(dst, maxFrames, pts100ns);
+
+  const size_t n = (std::min)(run, maxFrames);
+  std::memcpy(dst, data_ + pos_ * fmt_.ch, n * fmt_.ch * sizeof(int16_t));
+  if (pts100ns) *pts100ns = (int64_t)(pos_ * 10000000 / fmt_.sr);
+  pos_ += n;
+  copied_ += n * fmt_.ch * sizeof(int16_t);
+  served_.fetch_add(n, std::memory_order_relaxed);
+  return n;
+}
+
+size_t CachedPcmDecoder::read_decoded(int16_t* dst, size_t maxFrames, int64_t* pts100ns){
+  if (!ensure_inner()) {
+    failed_ = true;
+    return 0;
+  }
+  if (innerPos_ != (int64_t)pos_ && innerPos_ >= 0) innerPos_ = -1;
+  if (innerPos_ < 0) {
+    if (!inner_->seek_100ns((int64_t)(pos_ * 10000000 / fmt_.sr))) {
+      std::cerr << "[PcmCache] decoder seek failed" << std::endl;
+    }
+    // встал раньше цели — лишнее выбрасывает сам декодер, без конвертации
+    const int64_t ts = inner_->next_pts();
+    if (ts >= 0) {
+      const int64_t at = std::llround((double)ts * fmt_.sr / 10000000.0);
+      if (at < (int64_t)pos_) inner_->skip((size_t)((int64_t)pos_ - at));
+    }
+  }
+
+  const size_t ch = fmt_.ch;
+  while (true) {
+    int64_t ts = 0;
+    size_t n = inner_->read(dst, maxFrames, &ts);
+    if (n == 0) {
+      eof_ = inner_->eof();
+      failed_ = inner_->failed();
+      if (eof_ && hdr_ && innerPos_ >= 0) hdr_->totalFrames = (uint64_t)innerPos_;
+      return 0;
+    }
+    if (innerPos_ < 0) {
+      // декодер без skip() мог встать раньше цели (на начало пакета) — срезаем здесь
+      int64_t at = (int64_t)std::llround((double)ts * fmt_.sr / 10000000.0);
+      if (at < 0) at = 0;
+      if (at + (int64_t)n <= (int64_t)pos_) continue;
+      if (at < (int64_t)pos_) {
+        const size_t skip = (size_t)((int64_t)pos_ - at);
+        std::memmove(dst, dst + skip * ch, (n - skip) * ch * sizeof(int16_t));
+        n -= skip;
+        at = (int64_t)pos_;
+      }
+      innerPos_ = at;
+    }
+    store(dst, (uint64_t)innerPos_, n);
+    if (pts100ns) *pts100ns = innerPos_ * 10000000 / fmt_.sr;
+    innerPos_ += (int64_t)n;
+    pos_ = (uint64_t)innerPos_;
+    decoded_.fetch_add(n, std::memory_order_relaxed);
+    return n;
+  }
+}
+
+// Кадры [frame, frame+frames) в кэш — только продолжением уже записанного
+// начала чанка, чтобы в чанке не было дыр
+void CachedPcmDecoder::store(const int16_t* src, uint64_t frame, size_t frames){
+  if (!hdr_) return;
+  const size_t ch = fmt_.ch;
+  while (frames > 0 && frame < hdr_->capacityFrames) {
+    const uint64_t c = frame / kChunkFrames;
+    const uint64_t off = frame - c * kChunkFrames;
+    const size_t take = (size_t)(std::min)({ (uint64_t)frames, kChunkFrames - off, hdr_->capacityFrames - frame });
+    if (filled_[c] == off) {
+      std::memcpy(data_ + frame * ch, src, take * ch * sizeof(int16_t));
+      filled_[c] = (uint32_t)(off + take);   // после данных: read() верит filled_
+      copied_ += take * ch * sizeof(int16_t);
+      filledFrames_.fetch_add(take, std::memory_order_relaxed);
+    }
+    frame += take;
+    src += take * ch;
+    frames -= take;
+  }
+}
+
+size_t CachedPcmDecoder::skip(size_t frames){
+  if (eof_ || failed_) return 0;
+  if (hdr_ && hdr_->totalFrames) frames = (size_t)(std::min)((uint64_t)frames, hdr_->totalFrames - (std::min)(pos_, hdr_->totalFrames));
+  pos_ += frames;   // read() сам решит: из отображения или декодером с seek
+  return frames;
+}
+
+bool CachedPcmDecoder::seek_100ns(int64_t pos){
+  uint64_t frame = (uint64_t)(pos > 0 ? pos : 0) * fmt_.sr / 10000000;
+  if (hdr_ && hdr_->totalFrames) frame = (std::min)(frame, hdr_->totalFrames);
+  pos_ = frame;
+  eof_ = false;
+  failed_ = false;
+  return true;   // декодер (если понадобится) перейдёт при следующем read()
+}
+
+uint64_t CachedPcmDecoder::bytes_copied() const{
+  return copied_ + (inner_ ? inner_->bytes_copied() : 0);
+}
+
+uint64_t CachedPcmDecoder::bytes_copy_avoided() const{
+  return inner_ ? inner_->bytes_copy_avoided() : 0;
+}
+
+void CachedPcmDecoder::set_seek_index(std::shared_ptr<const SeekIndex> idx){
+  seekIndex_ = idx;
+  if (inner_) inner_->set_seek_index(std::move(idx));
+}
+
+int CachedPcmDecoder::cached_pct() const{
+  if (!hdr_) return -1;
+  const uint64_t total = hdr_->totalFrames ? hdr_->totalFrames : hdr_->capacityFrames - wantSr_;
+  if (total == 0) return 0;
+  return (int)(std::min)((uint64_t)100, filledFrames_.load(std::memory_order_relaxed) * 100 / total);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "audio_decoder.h"
+
+// Дисковый кэш декодированного PCM: %LOCALAPPDATA%\DualOut\<hash>.<sr>x<ch>.pcm
+// (ключ — путь, размер и mtime файла плюс выходной формат), отображённый в
+// память. Данные лежат чанками по kChunkFrames; в заголовке для каждого чанка —
+// сколько кадров от его начала уже записано. Заполняется по ходу
+// воспроизведения; повторное открытие и seek в записанную часть читают прямо
+// из отображения, декодер открывается только на незаписанные места.
+void pcm_cache_configure(bool enabled, uint64_t maxBytes);   // по умолчанию выключен, 4 ГБ
+bool pcm_cache_enabled();
+
+// С кэшем, если он включён и url — локальный файл; иначе open_audio_decoder()
+std::unique_ptr<AudioDecoder> open_cached_audio_decoder(const std::wstring& url, uint32_t sr = 48000, uint32_t ch = 2);
+
+class CachedPcmDecoder : public AudioDecoder {
+public:
+  static constexpr uint32_t kChunkFrames = 65536;
+
+  CachedPcmDecoder();
+  ~CachedPcmDecoder() override;
+
+  // false — не файл; если кэш завести не вышло, работает как обычный декодер
+  bool open(const std::wstring& url, uint32_t sr = 48000, uint32_t ch = 2) override;
+  void close() override;
+  const PcmDesc& format() const override { return fmt_; }
+  const char* name() const override { return inner_ ? inner_->name() : "cache"; }
+
+  size_t read(int16_t* dst, size_t maxFrames, int64_t* pts100ns) override;
+  bool seek_100ns(int64_t pos) override;
+  int64_t duration_100ns() const override { return duration_; }
+
+  bool eof() const override { return eof_; }
+  bool failed() const override { return failed_; }
+  uint64_t bytes_copied() const override;
+  uint64_t bytes_copy_avoided() const override;
+  void set_seek_index(std::shared_ptr<const SeekIndex> idx) override;
+  int64_t next_pts() override { return (int64_t)(pos_ * 10000000 / fmt_.sr); }   // seek здесь всегда точный
+  size_t skip(size_t frames) override;
+
+  // Для статуса — из любого потока
+  bool     mapped() const { return hdr_ != nullptr; }
+  uint64_t served_frames() const { return served_.load(std::memory_order_relaxed); }   // из отображения
+  uint64_t decoded_frames() const { return decoded_.load(std::memory_order_relaxed); } // через декодер
+  int      cached_pct() const;   // сколько файла уже в кэше
+
+private:
+  struct Header;
+  struct Mapping;
+
+  bool map_existing(const std::wstring& file);
+  bool map_new(const std::wstring& file, uint64_t capacityFrames);
+  bool ensure_inner();
+  size_t cached_run(uint64_t frame) const;
+  size_t read_decoded(int16_t* dst, size_t maxFrames, int64_t* pts100ns);
+  void store(const int16_t* src, uint64_t frame, size_t frames);
+
+  std::wstring url_;
+  uint32_t wantSr_ = 48000, wantCh_ = 2;
+  std::unique_ptr<AudioDecoder> inner_;   // открывается, только когда кэша не хватило
+  std::shared_ptr<const SeekIndex> seekIndex_;   // для inner_, в том числе открытого позже
+  std::unique_ptr<Mapping> map_;
+  Header*   hdr_ = nullptr;
+  uint32_t* filled_ = nullptr;            // кадров записано подряд от начала чанка
+  int16_t*  data_ = nullptr;
+  PcmDesc   fmt_{48000, 2, 16};
+  int64_t   duration_ = 0;
+  uint64_t  pos_ = 0;                     // кадр, с которого отдаёт read()
+  int64_t   innerPos_ = -1;               // где стоит inner_ (-1 — узнать по pts)
+  uint64_t  copied_ = 0;
+  bool eof_ = false;
+  bool failed_ = false;
+  std::atomic<uint64_t> served_{0}, decoded_{0}, filledFrames_{0};
+};
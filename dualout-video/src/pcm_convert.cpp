@@ -0,0 +1,631 @@
+#include "pcm_convert.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+// НОВОЕ: SIMD-ядра. SSE2 — базовый уровень x64, AVX2 — по CPUID во время работы
+// (собирается атрибутом target, без флагов компилятора на весь файл).
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DUALOUT_PCM_SSE 1
+#include <emmintrin.h>
+#if defined(__x86_64__) || defined(_M_X64)
+#define DUALOUT_PCM_AVX2 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define DUALOUT_TARGET_AVX2
+#else
+#define DUALOUT_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+#endif
+
+namespace {
+
+std::atomic<bool> g_dither{false};
+
+inline uint32_t xorshift32(uint32_t& s){
+    s ^= s << 13; s ^= s >> 17; s ^= s << 5;
+    return s;
+}
+
+// Треугольный шум из одного шага генератора: разность старших и младших 16 бит,
+// (-65536, 65536) в единицах 1/65536 LSB s16
+inline int32_t tpdf(uint32_t& s){
+    const uint32_t r = xorshift32(s);
+    return (int32_t)(r >> 16) - (int32_t)(r & 0xFFFF);
+}
+
+inline int16_t sat16(int32_t v){
+    return (int16_t)std::clamp(v, -32768, 32767);
+}
+
+inline int32_t load_s24(const uint8_t* b){
+    // значение в старших 24 битах int32 — дальше как s32
+    return (int32_t)(((uint32_t)b[0] << 8) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 24));
+}
+
+// s32 -> s16: hi + округлённый (и задизеренный) остаток младших 16 бит — без переполнения
+inline int16_t s32_to_s16(int32_t x, int32_t noise){
+    const int32_t hi = x >> 16;
+    const int32_t t  = (x & 0xFFFF) + noise + 0x8000;
+    return sat16(hi + (t >> 16));
+}
+
+inline int16_t f32_to_s16(float x, float noise){
+    const float v = std::clamp(x * 32767.0f + noise, -32768.0f, 32767.0f);
+    return (int16_t)std::lrintf(v);
+}
+
+// ---- скалярные (эталон и хвосты SIMD) ----
+
+void mix2_scalar(int16_t* d, const int16_t* a, const float* ga, const int16_t* b, const float* gb,
+                 size_t frames, uint32_t ch){
+    for (size_t i = 0; i < frames; ++i) {
+        for (uint32_t c = 0; c < ch; ++c) {
+            const size_t k = i * ch + c;
+            const float v = (float)a[k] * ga[i] + (float)b[k] * gb[i];
+            d[k] = (int16_t)std::lrintf(std::clamp(v, -32768.0f, 32767.0f));
+        }
+    }
+}
+
+void to_s16_scalar(int16_t* d, const void* src, PcmFormat fmt, size_t n, PcmDither* dit){
+    uint32_t none = 0;
+    uint32_t& s = dit ? dit->state[0] : none;
+    switch (fmt) {
+    case PcmFormat::S16:
+        std::memcpy(d, src, n * sizeof(int16_t));
+        break;
+    case PcmFormat::F32: {
+        const float* f = static_cast<const float*>(src);
+        for (size_t i = 0; i < n; ++i)
+            d[i] = f32_to_s16(f[i], dit ? tpdf(s) * (1.0f / 65536.0f) : 0.0f);
+        break;
+    }
+    case PcmFormat::S32: {
+        const int32_t* x = static_cast<const int32_t*>(src);
+        for (size_t i = 0; i < n; ++i) d[i] = s32_to_s16(x[i], dit ? tpdf(s) : 0);
+        break;
+    }
+    case PcmFormat::S24: {
+        const uint8_t* b = static_cast<const uint8_t*>(src);
+        for (size_t i = 0; i < n; ++i, b += 3) d[i] = s32_to_s16(load_s24(b), dit ? tpdf(s) : 0);
+        break;
+    }
+    }
+}
+
+void from_s16_scalar(void* dst, PcmFormat fmt, const int16_t* s, size_t n){
+    switch (fmt) {
+    case PcmFormat::S16:
+        std::memcpy(dst, s, n * sizeof(int16_t));
+        break;
+    case PcmFormat::F32: {
+        float* f = static_cast<float*>(dst);
+        for (size_t i = 0; i < n; ++i) f[i] = s[i] * (1.0f / 32768.0f);
+        break;
+    }
+    case PcmFormat::S32: {
+        int32_t* x = static_cast<int32_t*>(dst);
+        for (size_t i = 0; i < n; ++i) x[i] = (int32_t)((uint32_t)(uint16_t)s[i] << 16);
+        break;
+    }
+    case PcmFormat::S24: {
+        uint8_t* b = static_cast<uint8_t*>(dst);
+        for (size_t i = 0; i < n; ++i, b += 3) {
+            b[0] = 0;
+            b[1] = (uint8_t)(s[i] & 0xFF);
+            b[2] = (uint8_t)((uint16_t)s[i] >> 8);
+        }
+        break;
+    }
+    }
+}
+
+#if DUALOUT_PCM_SSE
+// ---- SSE2: 8 сэмплов за шаг, 4 дорожки генератора ----
+
+inline __m128i xorshift_sse(__m128i& s){
+    s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+    s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+    s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+    return s;
+}
+
+inline __m128i tpdf_sse(__m128i& s){
+    const __m128i r = xorshift_sse(s);
+    return _mm_sub_epi32(_mm_srli_epi32(r, 16), _mm_and_si128(r, _mm_set1_epi32(0xFFFF)));
+}
+
+inline __m128i s32_to_s16_sse(__m128i x, __m128i noise){
+    const __m128i hi = _mm_srai_epi32(x, 16);
+    __m128i t = _mm_and_si128(x, _mm_set1_epi32(0xFFFF));
+    t = _mm_add_epi32(_mm_add_epi32(t, noise), _mm_set1_epi32(0x8000));
+    return _mm_add_epi32(hi, _mm_srai_epi32(t, 16));
+}
+
+size_t to_s16_sse2(int16_t* d, const void* src, PcmFormat fmt, size_t n, PcmDither* dit){
+    size_t i = 0;
+    __m128i st = dit ? _mm_loadu_si128((const __m128i*)dit->state) : _mm_setzero_si128();
+    const __m128i zero = _mm_setzero_si128();
+    if (fmt == PcmFormat::F32) {
+        const float* f = static_cast<const float*>(src);
+        const __m128 k = _mm_set1_ps(32767.0f), lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+        const __m128 kn = _mm_set1_ps(1.0f / 65536.0f);
+        for (; i + 8 <= n; i += 8) {
+            __m128 a = _mm_mul_ps(_mm_loadu_ps(f + i), k);
+            __m128 b = _mm_mul_ps(_mm_loadu_ps(f + i + 4), k);
+            if (dit) {
+                a = _mm_add_ps(a, _mm_mul_ps(_mm_cvtepi32_ps(tpdf_sse(st)), kn));
+                b = _mm_add_ps(b, _mm_mul_ps(_mm_cvtepi32_ps(tpdf_sse(st)), kn));
+            }
+            a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+            b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+            _mm_storeu_si128((__m128i*)(d + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+        }
+    } else if (fmt == PcmFormat::S32) {
+        const int32_t* x = static_cast<const int32_t*>(src);
+        for (; i + 8 <= n; i += 8) {
+            const __m128i na = dit ? tpdf_sse(st) : zero;
+            const __m128i nb = dit ? tpdf_sse(st) : zero;
+            const __m128i a = s32_to_s16_sse(_mm_loadu_si128((const __m128i*)(x + i)), na);
+            const __m128i b = s32_to_s16_sse(_mm_loadu_si128((const __m128i*)(x + i + 4)), nb);
+            _mm_storeu_si128((__m128i*)(d + i), _mm_packs_epi32(a, b));
+        }
+    }
+    // S24 без pshufb выгоднее скалярно; S16 — memcpy
+    if (dit) _mm_storeu_si128((__m128i*)dit->state, st);
+    return i;
+}
+
+size_t from_s16_sse2(void* dst, PcmFormat fmt, const int16_t* s, size_t n){
+    size_t i = 0;
+    if (fmt == PcmFormat::F32) {
+        float* f = static_cast<float*>(dst);
+        const __m128 k = _mm_set1_ps(1.0f / 32768.0f);
+        for (; i + 8 <= n; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            const __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            const __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(f + i, _mm_mul_ps(_mm_cvtepi32_ps(a), k));
+            _mm_storeu_ps(f + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), k));
+        }
+    } else if (fmt == PcmFormat::S32) {
+        int32_t* x = static_cast<int32_t*>(dst);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            _mm_storeu_si128((__m128i*)(x + i), _mm_unpacklo_epi16(zero, v));
+            _mm_storeu_si128((__m128i*)(x + i + 4), _mm_unpackhi_epi16(zero, v));
+        }
+    }
+    return i;
+}
+
+inline __m128 s16lo_ps(__m128i v){ return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)); }
+inline __m128 s16hi_ps(__m128i v){ return _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16)); }
+
+// Кадров сведено; стерео — 4 кадра за шаг (огибающая размножается на L/R), моно — 8
+size_t mix2_sse2(int16_t* d, const int16_t* a, const float* ga, const int16_t* b, const float* gb,
+                 size_t frames, uint32_t ch){
+    size_t i = 0;
+    if (ch == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            const __m128 ga4 = _mm_loadu_ps(ga + i), gb4 = _mm_loadu_ps(gb + i);
+            const __m128i va = _mm_loadu_si128((const __m128i*)(a + i * 2));
+            const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i * 2));
+            const __m128 lo = _mm_add_ps(_mm_mul_ps(s16lo_ps(va), _mm_unpacklo_ps(ga4, ga4)),
+                                         _mm_mul_ps(s16lo_ps(vb), _mm_unpacklo_ps(gb4, gb4)));
+            const __m128 hi = _mm_add_ps(_mm_mul_ps(s16hi_ps(va), _mm_unpackhi_ps(ga4, ga4)),
+                                         _mm_mul_ps(s16hi_ps(vb), _mm_unpackhi_ps(gb4, gb4)));
+            _mm_storeu_si128((__m128i*)(d + i * 2), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+        }
+    } else if (ch == 1) {
+        for (; i + 8 <= frames; i += 8) {
+            const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+            const __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+            const __m128 lo = _mm_add_ps(_mm_mul_ps(s16lo_ps(va), _mm_loadu_ps(ga + i)),
+                                         _mm_mul_ps(s16lo_ps(vb), _mm_loadu_ps(gb + i)));
+            const __m128 hi = _mm_add_ps(_mm_mul_ps(s16hi_ps(va), _mm_loadu_ps(ga + i + 4)),
+                                         _mm_mul_ps(s16hi_ps(vb), _mm_loadu_ps(gb + i + 4)));
+            _mm_storeu_si128((__m128i*)(d + i), _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi)));
+        }
+    }
+    return i;
+}
+#endif
+
+#if DUALOUT_PCM_AVX2
+// ---- AVX2: 16 сэмплов за шаг, 8 дорожек генератора; S24 через pshufb ----
+
+DUALOUT_TARGET_AVX2 inline __m256i tpdf_avx2(__m256i& s){
+    s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 13));
+    s = _mm256_xor_si256(s, _mm256_srli_epi32(s, 17));
+    s = _mm256_xor_si256(s, _mm256_slli_epi32(s, 5));
+    return _mm256_sub_epi32(_mm256_srli_epi32(s, 16), _mm256_and_si256(s, _mm256_set1_epi32(0xFFFF)));
+}
+
+DUALOUT_TARGET_AVX2 inline __m256i s32_to_s16_avx2(__m256i x, __m256i noise){
+    const __m256i hi = _mm256_srai_epi32(x, 16);
+    __m256i t = _mm256_and_si256(x, _mm256_set1_epi32(0xFFFF));
+    t = _mm256_add_epi32(_mm256_add_epi32(t, noise), _mm256_set1_epi32(0x8000));
+    return _mm256_add_epi32(hi, _mm256_srai_epi32(t, 16));
+}
+
+// packs_epi32 в AVX2 работает по 128-битным половинам — возвращаем порядок
+DUALOUT_TARGET_AVX2 inline void store_packed_avx2(int16_t* d, __m256i a, __m256i b){
+    const __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+    _mm256_storeu_si256((__m256i*)d, p);
+}
+
+// 8 упакованных s24 (24 байта) -> 8 x int32 со значением в старших битах
+DUALOUT_TARGET_AVX2 inline __m256i load_s24x8_avx2(const uint8_t* b){
+    const __m128i m = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m128i lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)b), m);
+    const __m128i hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(b + 12)), m);
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+DUALOUT_TARGET_AVX2 size_t to_s16_avx2(int16_t* d, const void* src, PcmFormat fmt, size_t n, PcmDither* dit){
+    size_t i = 0;
+    __m256i st = dit ? _mm256_loadu_si256((const __m256i*)dit->state) : _mm256_setzero_si256();
+    const __m256i zero = _mm256_setzero_si256();
+    if (fmt == PcmFormat::F32) {
+        const float* f = static_cast<const float*>(src);
+        const __m256 k = _mm256_set1_ps(32767.0f), lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+        const __m256 kn = _mm256_set1_ps(1.0f / 65536.0f);
+        for (; i + 16 <= n; i += 16) {
+            __m256 a = _mm256_mul_ps(_mm256_loadu_ps(f + i), k);
+            __m256 b = _mm256_mul_ps(_mm256_loadu_ps(f + i + 8), k);
+            if (dit) {
+                a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_cvtepi32_ps(tpdf_avx2(st)), kn));
+                b = _mm256_add_ps(b, _mm256_mul_ps(_mm256_cvtepi32_ps(tpdf_avx2(st)), kn));
+            }
+            a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+            b = _mm256_max_ps(_mm256_min_ps(b, hi), lo);
+            store_packed_avx2(d + i, _mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        }
+    } else if (fmt == PcmFormat::S32) {
+        const int32_t* x = static_cast<const int32_t*>(src);
+        for (; i + 16 <= n; i += 16) {
+            const __m256i na = dit ? tpdf_avx2(st) : zero;
+            const __m256i nb = dit ? tpdf_avx2(st) : zero;
+            store_packed_avx2(d + i,
+                s32_to_s16_avx2(_mm256_loadu_si256((const __m256i*)(x + i)), na),
+                s32_to_s16_avx2(_mm256_loadu_si256((const __m256i*)(x + i + 8)), nb));
+        }
+    } else if (fmt == PcmFormat::S24) {
+        const uint8_t* b = static_cast<const uint8_t*>(src);
+        // вторая загрузка читает 16 байт с +36 — держим запас в хвосте
+        for (; i + 16 + 2 <= n; i += 16) {
+            const __m256i na = dit ? tpdf_avx2(st) : zero;
+            const __m256i nb = dit ? tpdf_avx2(st) : zero;
+            store_packed_avx2(d + i,
+                s32_to_s16_avx2(load_s24x8_avx2(b + i * 3), na),
+                s32_to_s16_avx2(load_s24x8_avx2(b + i * 3 + 24), nb));
+        }
+    }
+    if (dit) _mm256_storeu_si256((__m256i*)dit->state, st);
+    return i;
+}
+
+DUALOUT_TARGET_AVX2 size_t from_s16_avx2(void* dst, PcmFormat fmt, const int16_t* s, size_t n){
+    size_t i = 0;
+    if (fmt == PcmFormat::F32) {
+        float* f = static_cast<float*>(dst);
+        const __m256 k = _mm256_set1_ps(1.0f / 32768.0f);
+        for (; i + 16 <= n; i += 16) {
+            const __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(s + i)));
+            const __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(s + i + 8)));
+            _mm256_storeu_ps(f + i, _mm256_mul_ps(_mm256_cvtepi32_ps(a), k));
+            _mm256_storeu_ps(f + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(b), k));
+        }
+    } else if (fmt == PcmFormat::S32) {
+        int32_t* x = static_cast<int32_t*>(dst);
+        for (; i + 16 <= n; i += 16) {
+            const __m256i a = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(s + i)));
+            const __m256i b = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(s + i + 8)));
+            _mm256_storeu_si256((__m256i*)(x + i), _mm256_slli_epi32(a, 16));
+            _mm256_storeu_si256((__m256i*)(x + i + 8), _mm256_slli_epi32(b, 16));
+        }
+    } else if (fmt == PcmFormat::S24) {
+        uint8_t* b = static_cast<uint8_t*>(dst);
+        // 4 сэмпла -> 12 байт: из (s16 << 16) берём байты 1..3 каждой дорожки
+        const __m128i m = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= n; i += 8) {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(s + i));
+            const __m128i a = _mm_shuffle_epi8(_mm_unpacklo_epi16(zero, v), m);
+            const __m128i c = _mm_shuffle_epi8(_mm_unpackhi_epi16(zero, v), m);
+            uint8_t* o = b + i * 3;
+            _mm_storel_epi64((__m128i*)o, a);
+            const int32_t ta = _mm_cvtsi128_si32(_mm_srli_si128(a, 8));
+            std::memcpy(o + 8, &ta, 4);
+            _mm_storel_epi64((__m128i*)(o + 12), c);
+            const int32_t tc = _mm_cvtsi128_si32(_mm_srli_si128(c, 8));
+            std::memcpy(o + 20, &tc, 4);
+        }
+    }
+    return i;
+}
+
+bool cpu_has_avx2(){
+#ifdef _MSC_VER
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7) return false;
+    __cpuid(r, 1);
+    const bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+PcmSimd detect_simd(){
+#if DUALOUT_PCM_AVX2
+    if (cpu_has_avx2()) return PcmSimd::Avx2;
+#endif
+#if DUALOUT_PCM_SSE
+    return PcmSimd::Sse2;
+#else
+    return PcmSimd::Scalar;
+#endif
+}
+
+size_t sample_bytes(PcmFormat f){
+    switch (f) {
+    case PcmFormat::S16: return 2;
+    case PcmFormat::S24: return 3;
+    case PcmFormat::S32: return 4;
+    case PcmFormat::F32: return 4;
+    }
+    return 2;
+}
+
+} // namespace
+
+PcmSimd pcm_simd_level(){
+    static const PcmSimd level = detect_simd();
+    return level;
+}
+
+const char* pcm_simd_name(PcmSimd s){
+    switch (s) {
+    case PcmSimd::Avx2: return "avx2";
+    case PcmSimd::Sse2: return "sse2";
+    default:            return "scalar";
+    }
+}
+
+PcmDither::PcmDither(uint32_t seed){
+    // дорожки с разными зёрнами, иначе шум соседних сэмплов совпадёт
+    for (int i = 0; i < 8; ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        state[i] = seed ? seed : 1u;
+    }
+}
+
+void pcm_to_s16(int16_t* dst, const void* src, PcmFormat fmt, size_t samples,
+                PcmDither* dither, PcmSimd level){
+    if (level > pcm_simd_level()) level = pcm_simd_level();
+    size_t done = 0;
+#if DUALOUT_PCM_AVX2
+    if (level == PcmSimd::Avx2) done = to_s16_avx2(dst, src, fmt, samples, dither);
+#endif
+#if DUALOUT_PCM_SSE
+    if (level == PcmSimd::Sse2) done = to_s16_sse2(dst, src, fmt, samples, dither);
+#endif
+    if (done < samples) {
+        const uint8_t* rest = static_cast<const uint8_t*>(src) + done * sample_bytes(fmt);
+        to_s16_scalar(dst + done, rest, fmt, samples - done, dither);
+    }
+}
+
+void pcm_from_s16(void* dst, PcmFormat fmt, const int16_t* src, size_t samples, PcmSimd level){
+    if (level > pcm_simd_level()) level = pcm_simd_level();
+    size_t done = 0;
+#if DUALOUT_PCM_AVX2
+    if (level == PcmSimd::Avx2) done = from_s16_avx2(dst, fmt, src, samples);
+#endif
+#if DUALOUT_PCM_SSE
+    if (level == PcmSimd::Sse2) done = from_s16_sse2(dst, fmt, src, samples);
+#endif
+    if (done < samples) {
+        uint8_t* rest = static_cast<uint8_t*>(dst) + done * sample_bytes(fmt);
+        from_s16_scalar(rest, fmt, src + done, samples - done);
+    }
+}
+
+void pcm_mix2_s16(int16_t* dst, const int16_t* a, const float* gainA,
+                  const int16_t* b, const float* gainB, size_t frames, uint32_t ch, PcmSimd level){
+    if (level > pcm_simd_level()) level = pcm_simd_level();
+    size_t done = 0;
+#if DUALOUT_PCM_SSE
+    // упирается в память, не в арифметику: AVX2 тут ничего не даёт
+    if (level >= PcmSimd::Sse2) done = mix2_sse2(dst, a, gainA, b, gainB, frames, ch);
+#endif
+    if (done < frames) {
+        const size_t k = done * ch;
+        mix2_scalar(dst + k, a + k, gainA + done, b + k, gainB + done, frames - done, ch);
+    }
+}
+
+void pcm_set_dither(bool on){ g_dither.store(on, std::memory_order_relaxed); }
+bool pcm_dither(){ return g_dither.load(std::memory_order_relaxed); }
+
+std::string pcm_selftest_json(size_t samples){
+    samples = std::clamp<size_t>(samples, 64, size_t(1) << 24);
+    // нечётная длина — чтобы хвосты скалярного кода тоже проверялись
+    const size_t n = samples | 1;
+
+    // источник: синус + шум + редкие перегрузы, во всех форматах
+    std::vector<float>   f32(n);
+    std::vector<int32_t> s32(n);
+    std::vector<uint8_t> s24(n * 3);
+    std::vector<int16_t> s16(n);
+    uint32_t r = 12345;
+    for (size_t i = 0; i < n; ++i) {
+        float v = 0.9f * std::sin(i * 0.01f) + ((int32_t)xorshift32(r) >> 8) * (0.1f / 8388608.0f);
+        if (i % 997 == 0) v *= 1.5f;
+        f32[i] = v;
+        s32[i] = (int32_t)xorshift32(r);
+        std::memcpy(&s24[i * 3], &s32[i], 3);
+        s16[i] = (int16_t)(s32[i] >> 16);
+    }
+    const void* srcOf[4] = { s16.data(), s24.data(), s32.data(), f32.data() };
+    const PcmFormat fmts[3] = { PcmFormat::F32, PcmFormat::S24, PcmFormat::S32 };
+    const char* fmtName[4] = { "s16", "s24", "s32", "f32" };
+
+    std::vector<int16_t> ref(n), out(n);
+    std::vector<uint8_t> refW(n * 4), outW(n * 4);
+    bool ok = true;
+    std::string js = "{\"simd\":\"";
+    js += pcm_simd_name(pcm_simd_level());
+    js += "\",\"samples\":" + std::to_string(n) + ",\"kernels\":[";
+    bool first = true;
+    char buf[320];
+
+    auto bench = [&](auto&& fn, size_t bytes){
+        const int reps = 5;
+        double best = 1e30;
+        for (int k = 0; k < reps; ++k) {
+            const auto t0 = std::chrono::steady_clock::now();
+            fn();
+            const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            best = std::min(best, s);
+        }
+        return best > 0 ? bytes / best / 1e9 : 0.0;
+    };
+
+    for (int lv = (int)PcmSimd::Scalar; lv <= (int)pcm_simd_level(); ++lv) {
+        const PcmSimd level = (PcmSimd)lv;
+        for (PcmFormat fmt : fmts) {
+            const void* src = srcOf[(int)fmt];
+            const size_t bytes = n * (sample_bytes(fmt) + 2);
+
+            // без дизера — бит в бит со скалярным
+            pcm_to_s16(ref.data(), src, fmt, n, nullptr, PcmSimd::Scalar);
+            pcm_to_s16(out.data(), src, fmt, n, nullptr, level);
+            size_t mism = 0;
+            for (size_t i = 0; i < n; ++i) mism += (ref[i] != out[i]);
+
+            // с дизером — не дальше 1 LSB от округлённого и без смещения
+            PcmDither dit;
+            pcm_to_s16(out.data(), src, fmt, n, &dit, level);
+            int maxDev = 0;
+            double sumDev = 0;
+            for (size_t i = 0; i < n; ++i) {
+                const int dv = out[i] - ref[i];
+                maxDev = std::max(maxDev, std::abs(dv));
+                sumDev += dv;
+            }
+            const double meanDev = sumDev / n;
+
+            const double gbps   = bench([&]{ pcm_to_s16(out.data(), src, fmt, n, nullptr, level); }, bytes);
+            const double gbpsD  = bench([&]{ pcm_to_s16(out.data(), src, fmt, n, &dit, level); }, bytes);
+
+            // обратно из s16 — тоже бит в бит
+            const size_t wb = n * sample_bytes(fmt);
+            pcm_from_s16(refW.data(), fmt, s16.data(), n, PcmSimd::Scalar);
+            pcm_from_s16(outW.data(), fmt, s16.data(), n, level);
+            const bool backOk = std::memcmp(refW.data(), outW.data(), wb) == 0;
+            const double gbpsB = bench([&]{ pcm_from_s16(outW.data(), fmt, s16.data(), n, level); }, bytes);
+
+            // среднее шума ~0 с точностью до статистики (σ одного сэмпла ≈ 0.41 LSB;
+            // первые шаги xorshift от фиксированного зерна перемешаны плохо —
+            // на коротких прогонах запас шире). Смещение округления — 0.5 LSB.
+            const double meanTol = std::max(0.01, 4.0 / std::sqrt((double)n));
+            const bool kOk = mism == 0 && backOk && maxDev <= 1 && std::fabs(meanDev) < meanTol;
+            ok = ok && kOk;
+            std::snprintf(buf, sizeof(buf),
+                "%s{\"level\":\"%s\",\"format\":\"%s\",\"ok\":%s,\"mismatches\":%zu,"
+                "\"dither_max_lsb\":%d,\"dither_mean_lsb\":%.4f,\"from_s16_exact\":%s,"
+                "\"to_s16_gbps\":%.2f,\"to_s16_dither_gbps\":%.2f,\"from_s16_gbps\":%.2f}",
+                first ? "" : ",", pcm_simd_name(level), fmtName[(int)fmt], kOk ? "true" : "false",
+                mism, maxDev, meanDev, backOk ? "true" : "false", gbps, gbpsD, gbpsB);
+            js += buf;
+            first = false;
+        }
+    }
+    // сведение (кроссфейд): бит в бит со скалярным, моно и стерео
+    {
+        const size_t frames = n / 2;
+        std::vector<float> gOut(frames), gIn(frames);
+        for (size_t i = 0; i < frames; ++i) {
+            const float t = 1.5707964f * (float)i / (float)frames;
+            gOut[i] = std::cos(t);
+            gIn[i]  = std::sin(t) * ((i % 509 == 0) ? 1.7f : 1.0f);   // и насыщение
+        }
+        const int16_t* b16 = s16.data() + 1;
+        for (int lv = (int)PcmSimd::Scalar; lv <= (int)pcm_simd_level(); ++lv) {
+            const PcmSimd level = (PcmSimd)lv;
+            size_t mism = 0;
+            for (uint32_t ch = 1; ch <= 2; ++ch) {
+                const size_t fr = (n - 1) / ch;
+                pcm_mix2_s16(ref.data(), s16.data(), gOut.data(), b16, gIn.data(), (std::min)(fr, frames), ch, PcmSimd::Scalar);
+                pcm_mix2_s16(out.data(), s16.data(), gOut.data(), b16, gIn.data(), (std::min)(fr, frames), ch, level);
+                for (size_t i = 0; i < (std::min)(fr, frames) * ch; ++i) mism += (ref[i] != out[i]);
+            }
+            const double gbps = bench([&]{
+                pcm_mix2_s16(out.data(), s16.data(), gOut.data(), b16, gIn.data(), frames, 2, level);
+            }, frames * (2 * 2 * 3 + 2 * 4));
+            const bool kOk = mism == 0;
+            ok = ok && kOk;
+            std::snprintf(buf, sizeof(buf),
+                ",{\"level\":\"%s\",\"format\":\"mix2_s16\",\"ok\":%s,\"mismatches\":%zu,\"mix_gbps\":%.2f}",
+                pcm_simd_name(level), kOk ? "true" : "false", mism, gbps);
+            js += buf;
+        }
+    }
+    js += "],\"ok\":";
+    js += ok ? "true" : "false";
+    js += "}";
+    return js;
+}
+
+void PcmS16Converter::configure(const PcmSourceFormat& f){
+    src_ = f;
+    if (src_.bits == 0) src_.bits = 16;
+    bytesPerFrame_ = src_.bytesPerFrame();
+    if (bytesPerFrame_ == 0) bytesPerFrame_ = src_.ch * 2;
+    floatToS16_ = src_.isFloat;
+    intToS16_   = (!floatToS16_ && src_.bits != 16);
+}
+
+const int16_t* PcmS16Converter::convert(const void* src, size_t frames){
+    if (!needsConversion()) {
+        return static_cast<const int16_t*>(src);
+    }
+    scratch_.resize(frames * src_.ch);
+    convertTo(scratch_.data(), src, frames);
+    return scratch_.data();
+}
+
+void PcmS16Converter::convertTo(int16_t* dst, const void* src, size_t frames){
+    const size_t sampleCount = frames * src_.ch;
+    PcmDither* dit = pcm_dither() ? &dither_ : nullptr;
+    if (floatToS16_) {
+        pcm_to_s16(dst, src, PcmFormat::F32, sampleCount, dit);
+    } else if (src_.bits == 24) {
+        pcm_to_s16(dst, src, PcmFormat::S24, sampleCount, dit);
+    } else if (src_.bits >= 32) {
+        pcm_to_s16(dst, src, PcmFormat::S32, sampleCount, dit);
+    } else if (src_.bits == 8) {
+        // 8-bit PCM беззнаковый
+        const uint8_t* bytes = static_cast<const uint8_t*>(src);
+        for (size_t i=0; i<sampleCount; ++i) {
+            dst[i] = static_cast<int16_t>((static_cast<int>(bytes[i]) - 128) << 8);
+        }
+    } else {
+        std::memcpy(dst, src, sampleCount * sizeof(int16_t));
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Что реально отдаёт декодер (после SetCurrentMediaType — не всегда то, что просили)
+struct PcmSourceFormat {
+    uint32_t sr = 48000;
+    uint32_t ch = 2;
+    uint32_t bits = 16;
+    bool     isFloat = false;
+
+    uint32_t bytesPerFrame() const { return ch * ((bits + 7) / 8); }
+};
+
+// НОВОЕ: ядра конверсии сэмплов. S24 — упакованные 3 байта, little-endian;
+// F32 — ±1.0 (в s16 — x * 32767). В s16 округляем к ближайшему с насыщением,
+// с дизером — TPDF ±1 LSB.
+enum class PcmFormat { S16, S24, S32, F32 };
+
+// Какими ядрами считать; выбор по CPU — pcm_simd_level()
+enum class PcmSimd { Scalar = 0, Sse2, Avx2 };
+PcmSimd     pcm_simd_level();
+const char* pcm_simd_name(PcmSimd s);
+
+// Генератор дизера: xorshift32 на каждую дорожку SIMD (до 8)
+struct PcmDither {
+    uint32_t state[8];
+    explicit PcmDither(uint32_t seed = 0x9E3779B9u);
+};
+
+// dither == nullptr — без дизера. level выше доступного на этом CPU понижается.
+void pcm_to_s16(int16_t* dst, const void* src, PcmFormat fmt, size_t samples,
+                PcmDither* dither = nullptr, PcmSimd level = pcm_simd_level());
+void pcm_from_s16(void* dst, PcmFormat fmt, const int16_t* src, size_t samples,
+                  PcmSimd level = pcm_simd_level());
+
+// НОВОЕ: сведение двух потоков s16 с огибающими по кадрам (кроссфейд):
+// dst = a * gainA[i] + b * gainB[i] во всех ch каналах кадра i, с насыщением.
+// dst может совпадать с a или b. SIMD — для моно и стерео, иначе скалярно.
+void pcm_mix2_s16(int16_t* dst, const int16_t* a, const float* gainA,
+                  const int16_t* b, const float* gainB, size_t frames, uint32_t ch,
+                  PcmSimd level = pcm_simd_level());
+
+// Дизер при сведении в s16 в декодерах (по умолчанию выключен)
+void pcm_set_dither(bool on);
+bool pcm_dither();
+
+// Сверка SIMD-ядер со скалярными и скорость (ГБ/с: прочитано + записано), JSON
+std::string pcm_selftest_json(size_t samples);
+
+// Приведение PCM декодера к interleaved s16 для DualOutEngine.
+// Общий для PlayerCore и mf_stream_audio_pcm.
+class PcmS16Converter {
+public:
+    void configure(const PcmSourceFormat& f);
+    const PcmSourceFormat& source() const { return src_; }
+
+    bool needsConversion() const { return floatToS16_ || intToS16_; }
+    uint32_t bytesPerFrame() const { return bytesPerFrame_; }
+
+    // Вернёт s16: либо сам src (если конверсия не нужна), либо внутренний буфер,
+    // живущий до следующего вызова.
+    const int16_t* convert(const void* src, size_t frames);
+    // НОВОЕ: то же сразу в память вызывающего (frames * ch сэмплов), без scratch
+    void convertTo(int16_t* dst, const void* src, size_t frames);
+
+private:
+    PcmSourceFormat src_{};
+    uint32_t bytesPerFrame_ = 4;
+    bool floatToS16_ = false;
+    bool intToS16_   = false;
+    std::vector<int16_t> scratch_;
+    PcmDither dither_;
+};
@@ -0,0 +1,47 @@
+#include "pcm_window.h"
+#include <algorithm>
+#include <cstring>
+
+void PcmWindow::configure(uint32_t ch, size_t capacityFrames){
+  ch_ = ch ? ch : 2;
+  cap_ = capacityFrames;
+  buf_.assign(cap_ * ch_, 0);
+  begin_ = end_ = 0;
+}
+
+void PcmWindow::reset(int64_t frame){
+  begin_ = end_ = frame;
+}
+
+void PcmWindow::append(const int16_t* src, int64_t frame, size_t frames){
+  if (cap_ == 0 || frames == 0) return;
+  if (frame != end_) reset(frame);   // разрыв (seek мимо окна) — окно заново
+  if (frames > cap_) {               // больше окна — нужен только хвост
+    src += (frames - cap_) * ch_;
+    frame += (int64_t)(frames - cap_);
+    frames = cap_;
+    reset(frame);
+  }
+  size_t done = 0;
+  while (done < frames) {
+    const size_t slot = (size_t)((end_ + (int64_t)done) % (int64_t)cap_);
+    const size_t n = (std::min)(frames - done, cap_ - slot);
+    std::memcpy(buf_.data() + slot * ch_, src + done * ch_, n * ch_ * sizeof(int16_t));
+    done += n;
+  }
+  end_ += (int64_t)frames;
+  if (end_ - begin_ > (int64_t)cap_) begin_ = end_ - (int64_t)cap_;
+}
+
+size_t PcmWindow::copy(int16_t* dst, int64_t frame, size_t maxFrames) const{
+  if (!contains(frame)) return 0;
+  const size_t total = (std::min)(maxFrames, (size_t)(end_ - frame));
+  size_t done = 0;
+  while (done < total) {
+    const size_t slot = (size_t)((frame + (int64_t)done) % (int64_t)cap_);
+    const size_t n = (std::min)(total - done, cap_ - slot);
+    std::memcpy(dst + done * ch_, buf_.data() + slot * ch_, n * ch_ * sizeof(int16_t));
+    done += n;
+  }
+  return total;
+}
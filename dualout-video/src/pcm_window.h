@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Окно декодированного PCM вокруг позиции воспроизведения: кольцо на
+// capacity кадров, непрерывный кусок [begin, end) по номерам кадров. Новое
+// дописывается в конец, старое вытесняется с начала; кусок не с конца окна
+// начинает его заново. Один поток (стадия декодирования), без блокировок.
+class PcmWindow {
+public:
+  void configure(uint32_t ch, size_t capacityFrames);   // выделяет память; окно пустое
+  void reset(int64_t frame);                           // пустое окно с началом в frame
+
+  void append(const int16_t* src, int64_t frame, size_t frames);
+  // Кадры с frame подряд в dst (не больше maxFrames); 0 — frame вне окна
+  size_t copy(int16_t* dst, int64_t frame, size_t maxFrames) const;
+
+  bool    contains(int64_t frame) const { return frame >= begin_ && frame < end_; }
+  int64_t begin_frame() const { return begin_; }
+  int64_t end_frame() const { return end_; }
+  size_t  frames() const { return (size_t)(end_ - begin_); }
+  size_t  capacity() const { return cap_; }
+  size_t  bytes() const { return buf_.size() * sizeof(int16_t); }
+
+private:
+  std::vector<int16_t> buf_;
+  uint32_t ch_ = 2;
+  size_t   cap_ = 0;
+  int64_t  begin_ = 0, end_ = 0;   // кадр begin_ лежит в слоте begin_ % cap_
+};
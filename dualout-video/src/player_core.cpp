@@ -1,110 +1,54 @@
 #include "player_core.h"
+#include "dualout_telemetry.h"
+#include "pcm_cache.h"
+#include "media_cache.h"
+#include "pcm_convert.h"
+#ifdef _WIN32
 #include "mf_utils.h"
 #include <mfapi.h>
-#include <mfreadwrite.h>
-#include <mfobjects.h>
-#include <mferror.h>
-#include <mftransform.h>
+#include <mfidl.h>
+#endif
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <iomanip>
-#include <sstream>
 #include <chrono>
 #include <algorithm>
 #include <cmath>
 
-using Microsoft::WRL::ComPtr;
-
-namespace {
-std::string hr_to_string(HRESULT hr) {
-    std::ostringstream oss;
-    oss << "0x" << std::hex << std::setw(8) << std::setfill('0')
-        << static_cast<unsigned long>(hr);
-    return oss.str();
-}
-
-std::string guid_to_utf8(const GUID& guid) {
-    wchar_t wide[64]{};
-    int chars = StringFromGUID2(guid, wide, ARRAYSIZE(wide));
-    if (chars <= 0) return {};
-    int bytes = WideCharToMultiByte(CP_UTF8, 0, wide, -1, nullptr, 0, nullptr, nullptr);
-    if (bytes <= 1) return {};
-    std::string result(static_cast<size_t>(bytes - 1), '\0');
-    WideCharToMultiByte(CP_UTF8, 0, wide, -1, result.data(), bytes - 1, nullptr, nullptr);
-    return result;
-}
-
-void log_media_type(const char* prefix, IMFMediaType* type) {
-    if (!type) return;
-    UINT32 sr = 0, ch = 0, bps = 0, block = 0;
-    GUID subtype{};
-    type->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &sr);
-    type->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &ch);
-    type->GetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, &bps);
-    type->GetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT, &block);
-    type->GetGUID(MF_MT_SUBTYPE, &subtype);
-    std::cerr << "[PlayerCore] " << prefix
-              << " sr=" << sr
-              << " ch=" << ch
-              << " bps=" << bps
-              << " block=" << block
-              << " subtype=" << guid_to_utf8(subtype)
-              << std::endl;
-}
-
-void log_codec_hint(HRESULT hr) {
-    std::cerr << "[PlayerCore] Media Foundation reader failed (" << hr_to_string(hr)
-              << "). If this file carries AAC audio (e.g. MOV/MP4) install the Media "
-              << "Feature Pack or register the AAC decoder (CLSID_CMSAACDecMFT)." << std::endl;
-}
-} // namespace
-static bool setReaderToPcm16(ComPtr<IMFSourceReader>& r, PcmDesc& fmt) {
-    ComPtr<IMFMediaType> native;
-    HRESULT hr = r->GetNativeMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &native);
-    if (FAILED(hr)) {
-        std::cerr << "[PlayerCore] GetNativeMediaType failed hr=" << hr_to_string(hr) << std::endl;
-        return false;
+// Пул декодера: 256 блоков по 1024 кадра — ~5.5 с вперёд при 48 кГц
+static constexpr size_t kDecodeBlockFrames = 1024;
+static constexpr size_t kPoolBlocks        = 256;
+static constexpr size_t kFeedMaxSpans      = 8;     // блоков на один writev()
+
+// Строка в JSON: кавычки, обратные слэши (пути Windows) и управляющие
+static std::string json_escape(const std::string& s){
+    std::string out;
+    out.reserve(s.size() + 8);
+    for (const char c : s) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if ((unsigned char)c < 0x20) { char e[8]; std::snprintf(e, sizeof(e), "\\u%04x", c); out += e; }
+        else out += c;
     }
-    log_media_type("native-audio-type", native.Get());
-
-    // Наш целевой формат: 48000 / 2 / 16
-    fmt.sr  = 48000;
-    fmt.ch  = 2;
-    fmt.bps = 16;
+    return out;
+}
 
-    ComPtr<IMFMediaType> out;
-    hr = MFCreateMediaType(&out);
-    if (FAILED(hr)) {
-        std::cerr << "[PlayerCore] MFCreateMediaType failed hr=" << hr_to_string(hr) << std::endl;
-        return false;
-    }
-    out->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
-    out->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_PCM);
-    out->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, fmt.sr);
-    out->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS,       fmt.ch);
-    out->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE,    fmt.bps);
-    out->SetUINT32(MF_MT_AUDIO_BLOCK_ALIGNMENT,    fmt.ch * (fmt.bps / 8));
-    out->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, fmt.sr * fmt.ch * (fmt.bps / 8));
-
-    hr = r->SetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, out.Get());
-    if (FAILED(hr)) {
-        std::cerr << "[PlayerCore] SetCurrentMediaType(PCM16) failed hr=" << hr_to_string(hr) << std::endl;
-        ComPtr<IMFMediaType> current;
-        if (SUCCEEDED(r->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &current))) {
-            log_media_type("reader-current-after-fail", current.Get());
-        }
-        return false;
-    }
+static long long steady_now_ns(){
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    ComPtr<IMFMediaType> resolved;
-    if (SUCCEEDED(r->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &resolved))) {
-        log_media_type("resolved-reader-type", resolved.Get());
-    }
-    return true;
+// Скользящее среднее и максимум стадии, мкс (пишет один поток)
+static void stage_time(std::atomic<float>& avg, std::atomic<float>& mx, long long ns){
+    const float us = (float)ns / 1000.0f;
+    const float a = avg.load(std::memory_order_relaxed);
+    avg.store(a + (us - a) * 0.05f, std::memory_order_relaxed);
+    if (us > mx.load(std::memory_order_relaxed)) mx.store(us, std::memory_order_relaxed);
 }
 
 PlayerCore::PlayerCore() {
-    readerBytesPerFrame_ = fmt_.ch * (fmt_.bps / 8);
+    loudness_.set_done([this](const std::wstring& url, const LoudnessInfo& info){ on_loudness(url, info); });
+    seekIndex_.set_done([this](const std::wstring& url, std::shared_ptr<const SeekIndex> idx){ on_seek_index(url, std::move(idx)); });
 }
 PlayerCore::~PlayerCore(){ stop(); }
 
@@ -113,82 +57,204 @@ bool PlayerCore::open(const std::wstring& url, DualOutBridge* bridge){
     bridge_ = bridge;
     url_ = url;
 
-    com_ = std::make_unique<ComInit>();
-    mf_  = std::make_unique<MFInit>();
-
-    ComPtr<IMFAttributes> attr;
-    if (FAILED(MFCreateAttributes(&attr, 2))) return false;
-    attr->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE);
-    attr->SetUINT32(MF_SOURCE_READER_DISCONNECT_MEDIASOURCE_ON_SHUTDOWN, TRUE);
-
-    ComPtr<IMFSourceReader> r;
-    HRESULT hr = MFCreateSourceReaderFromURL(url.c_str(), attr.Get(), &r);
-    if (FAILED(hr)) {
-        std::cerr << "[PlayerCore] MFCreateSourceReaderFromURL failed hr=" << hr_to_string(hr) << std::endl;
-        log_codec_hint(hr);
-        ComPtr<IMFByteStream> byteStream;
-        HRESULT fileHr = MFCreateFile(MF_ACCESSMODE_READ, MF_OPENMODE_FAIL_IF_NOT_EXIST, MF_FILEFLAGS_NONE, url.c_str(), &byteStream);
-        if (FAILED(fileHr)) {
-            std::cerr << "[PlayerCore] MFCreateFile fallback failed hr=" << hr_to_string(fileHr) << std::endl;
-            return false;
-        }
-        hr = MFCreateSourceReaderFromByteStream(byteStream.Get(), attr.Get(), &r);
-        if (FAILED(hr)) {
-            std::cerr << "[PlayerCore] MFCreateSourceReaderFromByteStream failed hr=" << hr_to_string(hr) << std::endl;
-            log_codec_hint(hr);
-            return false;
-        }
-        std::cerr << "[PlayerCore] Fallback to byte-stream reader succeeded" << std::endl;
+    // Наш целевой формат: 48000 / 2 / 16; декодер приводит к нему сам
+    dec_ = open_cached_audio_decoder(url, 48000, 2);
+    if (!dec_) {
+        std::cerr << "[PlayerCore] no audio decoder for this file" << std::endl;
+        return false;
     }
-
-    if (!setReaderToPcm16(r, fmt_)) return false;
-    reader_ = r;
-    convertFloatToS16_ = false;
-    downmixIntToS16_ = false;
-    readerBitsPerSample_ = fmt_.bps;
-    readerBytesPerFrame_ = fmt_.ch * (fmt_.bps / 8);
+    fmt_ = dec_->format();
+    decName_.store(dec_->name());
+    pcmCache_ = dynamic_cast<CachedPcmDecoder*>(dec_.get());
+    publish_cache_stats();
+    duration_100ns_.store(dec_->duration_100ns());
+    // пул и очереди — пока потоков нет
+    pool_.resize(kPoolBlocks);
+    freeQ_.clear();
+    readyQ_.clear();
+    for (PcmBlock& b : pool_) {
+        b.pcm.assign(kDecodeBlockFrames * fmt_.ch, 0);
+        freeQ_.push(&b);
+    }
+    decGen_.store(0);
+    decSeekTo_.store(0);
+    eosGen_ = ~0u;
+    queuedFrames_.store(0);
+    starved_.store(0);
+    decodeUsAvg_.store(0.0f); decodeUsMax_.store(0.0f);
+    feedUsAvg_.store(0.0f);   feedUsMax_.store(0.0f);
+    decodedFrames_.store(0);
+    decCopyBytes_.store(0);   decCopyAvoided_.store(0);
+    feedWrites_.store(0);     feedSpans_.store(0);
+    seekTargetFrame_.store(-1); seekFirstFrame_.store(-1);
+    seekDiscarded_.store(0);    seekDiscardedFast_.store(0);
+    // окно PCM: позади + впереди + запас на то, что уже в кольцах движка
+    const bool winOn = winBehindMs_ > 0 || winAheadMs_ > 0;
+    window_.configure(fmt_.ch, winOn ? (size_t)((int64_t)(winBehindMs_ + winAheadMs_ + 1000) * fmt_.sr / 1000) : 0);
+    winHits_.store(0); winMisses_.store(0); winFrames_.store(0);
+    ringBytesAtOpen_ = bridge_ ? bridge_->eng.ringBytesWritten() : 0;
+    std::cerr << "[PlayerCore] decoder=" << decName_.load() << " sr=" << fmt_.sr << " ch=" << fmt_.ch
+              << " dur_ms=" << duration_100ns_.load() / 10000 << std::endl;
     framesFedSinceLog_ = 0;
     failedWritesSinceLog_ = 0;
     feedLogStart_ = {};
-    if (!refresh_reader_media_type("initial-reader-type")) return false;
 
-    // длительность
-    ComPtr<IMFPresentationDescriptor> pd;
-    ComPtr<IMFMediaSource> src;
-    {
-        // хитрый путь: через атрибуты у ридера не всегда есть длительность, поэтому создаём из URL вторично
-        ComPtr<IMFSourceResolver> resolver;
-        MFCreateSourceResolver(&resolver);
-        MF_OBJECT_TYPE objType;
-        IUnknown* unk = nullptr;
-        if (SUCCEEDED(resolver->CreateObjectFromURL(url.c_str(), MF_RESOLUTION_MEDIASOURCE, nullptr, &objType, &unk))){
-            unk->QueryInterface(IID_PPV_ARGS(&src));
-            unk->Release();
-        }
-        if (src){
-            src->CreatePresentationDescriptor(&pd);
-            PROPVARIANT var{}; PropVariantInit(&var);
-            if (SUCCEEDED(pd->GetUINT64(MF_PD_DURATION, (UINT64*)&duration_100ns_))) {
-                // ok
-            }
-        }
-    }
     last_pts_100ns_.store(0);
+    pendingSeek100ns_.store(-1);
+    ended_.store(false);
     stop_.store(false);
     paused_.store(true);
     opened_.store(true);
+    if (bridge_) {
+        bridge_->eng.setWatermarksMs(bufLowMs_, bufHighMs_);
+        bridge_->eng.setPlayerState(DUALOUT_TM_PAUSED);
+    }
 
-    // Запускаем рабочий поток, но в паузе
+    begin_loudness(url);
+    begin_seek_index(url);
+
+    // Плейлист начинается заново: открытый файл — элемент 0
+    {
+        std::lock_guard<std::mutex> lk(plMtx_);
+        queue_.clear();
+        next_ = NextItem{};
+        items_.assign(1, ItemInfo{url, duration_100ns_.load()});
+        ++plGen_;
+    }
+    decItem_ = 0;
+    decUrl_ = url;
+    marks_.clear();
+    feedItem_ = 0;
+    playItem_.store(0);
+    seekItem_.store(0);
+    itemSwitches_.store(0);
+    xfPhase_ = XfPhase::None;
+    xfTailN_ = 0;
+    xfadeCount_.store(0);
+
+    // Декодер начинает сразу и уходит вперёд на весь пул; рабочий поток — в паузе
+    decTh_ = std::thread(&PlayerCore::decode_loop, this);
     th_ = std::thread(&PlayerCore::worker_loop, this);
+    preTh_ = std::thread(&PlayerCore::preload_loop, this);
     return true;
 }
 
+// Нормализация: из кэша — сразу, иначе нейтрально до конца фонового скана
+void PlayerCore::begin_loudness(const std::wstring& url){
+    {
+        std::lock_guard<std::mutex> lk(loudMtx_);
+        loudUrl_ = url;
+        loudReady_ = false;
+        loudGainDb_ = 0.0f;
+    }
+    LoudnessInfo li;
+    if (loudness_.lookup(url, li)) {
+        on_loudness(url, li);
+    } else {
+        apply_loudness_gain();
+        loudness_.request(url);
+    }
+}
+
+// Индекс seek для dec_: из кэша — сразу, иначе строится в фоне.
+// open() (до потоков) или поток декодера
+void PlayerCore::begin_seek_index(const std::wstring& url){
+    std::shared_ptr<const SeekIndex> idx = seekIndex_.lookup(url);
+    {
+        std::lock_guard<std::mutex> lk(seekIdxMtx_);
+        seekIdxUrl_ = url;
+        seekIdx_ = idx;
+    }
+    seekIdxNew_.store(false);
+    if (idx) {
+        dec_->set_seek_index(idx);
+    } else {
+#ifdef _WIN32
+        seekIndex_.request(url);   // без MF индекс не нужен: miniaudio ищет точно
+#endif
+    }
+}
+
+bool PlayerCore::enqueue(const std::wstring& url){
+    if (!opened_.load()) return false;
+    {
+        std::lock_guard<std::mutex> lk(plMtx_);
+        queue_.push_back(url);
+    }
+    plCv_.notify_all();
+    return true;
+}
+
+void PlayerCore::set_crossfade(int ms){
+    xfadeMs_.store(std::clamp(ms, 0, 12000));
+}
+
+void PlayerCore::clear_queue(){
+    std::lock_guard<std::mutex> lk(plMtx_);
+    queue_.clear();
+    next_ = NextItem{};
+    ++plGen_;   // что сейчас открывается — тоже не нужно
+}
+
+// Поток предзагрузки: следующий url из очереди -> открытый декодер и его
+// первый блок, пока играет текущий. Держит не больше одного готового.
+void PlayerCore::preload_loop(){
+    audio_decoder_thread_init();
+    std::unique_lock<std::mutex> lk(plMtx_);
+    while (!stop_.load()) {
+        plCv_.wait(lk, [this]{ return stop_.load() || (!next_.dec && !next_.opening && !queue_.empty()); });
+        if (stop_.load()) break;
+        const std::wstring url = queue_.front();
+        queue_.pop_front();
+        const uint32_t plGen = plGen_;
+        next_.url = url;
+        next_.opening = true;
+        lk.unlock();
+
+        const long long t0 = steady_now_ns();
+        std::unique_ptr<AudioDecoder> dec = open_cached_audio_decoder(url, fmt_.sr, fmt_.ch);
+        std::vector<int16_t> head;
+        size_t headFrames = 0;
+        int64_t headPts = 0;
+        const bool sameFmt = dec && dec->format().sr == fmt_.sr && dec->format().ch == fmt_.ch;
+        if (sameFmt) {
+            head.resize(kDecodeBlockFrames * fmt_.ch);
+            headFrames = dec->read(head.data(), kDecodeBlockFrames, &headPts);
+        }
+        const long long openMs = (steady_now_ns() - t0) / 1000000;
+
+        lk.lock();
+        if (plGen != plGen_) continue;   // очередь очистили, пока открывали
+        next_.opening = false;
+        if (!sameFmt || headFrames == 0) {
+            next_ = NextItem{};
+            lk.unlock();
+            std::cerr << "[PlayerCore] cannot preload " << utf8_from_wide(url)
+                      << (dec && !sameFmt ? " (format differs)" : "") << std::endl;
+            emit_event("{\"event\":\"item_error\",\"url\":\"" + json_escape(utf8_from_wide(url)) + "\"}");
+            lk.lock();
+            continue;
+        }
+        next_.dec = std::move(dec);
+        next_.head = std::move(head);
+        next_.headFrames = headFrames;
+        next_.headPts = headPts;
+        std::cerr << "[PlayerCore] preloaded " << utf8_from_wide(url) << " (" << next_.dec->name()
+                  << ") in " << openMs << "ms" << std::endl;
+    }
+}
+
 bool PlayerCore::play(){
     if(!opened_.load()) return false;
+    ended_.store(false);
     {
         std::lock_guard<std::mutex> lk(mtx_);
         paused_.store(false);
     }
+    if (bridge_) {
+        bridge_->eng.armWatermarks(true);
+        bridge_->eng.setPlayerState(DUALOUT_TM_PLAYING);
+    }
     cv_.notify_all();
       if (videoReady_) video_start();
     return true;
@@ -197,6 +263,10 @@ bool PlayerCore::play(){
 bool PlayerCore::pause(){
     if(!opened_.load()) return false;
     paused_.store(true);
+    if (bridge_) {
+        bridge_->eng.armWatermarks(false);
+        bridge_->eng.setPlayerState(DUALOUT_TM_PAUSED);
+    }
      if (videoReady_) video_pause();
     return true;
 }
@@ -206,43 +276,78 @@ bool PlayerCore::stop(){
     stop_.store(true);
     cv_.notify_all();
     if (th_.joinable()) th_.join();
+    if (decTh_.joinable()) decTh_.join();
+    { std::lock_guard<std::mutex> lk(plMtx_); }   // поток предзагрузки не пропустит stop_
+    plCv_.notify_all();
+    if (preTh_.joinable()) preTh_.join();
+    if (bridge_) {
+        bridge_->eng.armWatermarks(false);
+        bridge_->eng.setPlayerState(DUALOUT_TM_STOPPED);
+    }
      if (videoReady_) { video_stop(); destroy_video_session(); }
-    reader_.Reset();
+    pcmCache_ = nullptr;
+    publish_cache_stats();
+    dec_.reset();
+    prevDec_.reset();
+    {
+        std::lock_guard<std::mutex> lk(plMtx_);
+        queue_.clear();
+        next_ = NextItem{};
+    }
+    decName_.store("none");
+#ifdef _WIN32
     vSource_.Reset();
     vSession_.Reset();
-    videoReady_ = false;
     mf_.reset();
     com_.reset();
+#endif
+    videoReady_ = false;
     return wasOpen;
 }
 
-bool PlayerCore::seek_ms(int64_t ms){
+bool PlayerCore::seek_ms(int64_t ms, bool crossfade){
     if (!opened_.load()) return false;
 
     // Запоминаем, играл ли плеер до seek
     const bool wasPlaying = !paused_.load();
 
+    ended_.store(false);
+    if (bridge_) bridge_->eng.clearEos();
+    seekItem_.store(playItem_.load());   // позиция — в том элементе, что звучит
+
+    // Во время игры: отдаём seek рабочему потоку, старое аудио не трогаем
+    if (crossfade && wasPlaying && bridge_) {
+        const int64_t pts100ns = ms * 10000;
+        seekRequestNs_.store(steady_now_ns());
+        pendingSeek100ns_.store(pts100ns);
+        last_pts_100ns_.store(pts100ns);
+        cv_.notify_all();
+        if (videoReady_) {
+            video_seek_100ns(pts100ns);
+        }
+        return true;
+    }
+
     // Ставим на паузу и стопаем воркер
     paused_.store(true);
     cv_.notify_all();
 
-    // Переводим MF reader на новую позицию (в 100-нс)
-    const LONGLONG pts100ns = ms * 10000;
-    PROPVARIANT pos{};
-    pos.vt = VT_I8;
-    pos.hVal.QuadPart = pts100ns;
-    HRESULT hr = reader_->SetCurrentPosition(GUID_NULL, pos);
-    PropVariantClear(&pos);
-    if (FAILED(hr)) {
-        return false;
+    // Декодер переходит на новую позицию сам (новое поколение блоков);
+    // старые блоки рабочий поток выбросит. Под feedMtx_ — чтобы уже
+    // вынутый старый блок не ушёл в движок после flush.
+    const int64_t pts100ns = ms * 10000;
+    {
+        std::lock_guard<std::mutex> lk(feedMtx_);
+        request_decode_seek(pts100ns);
+        // Сбрасываем очереди dualout, чтобы не было хвостов старого аудио
+        if (bridge_) {
+            bridge_->eng.flush();
+        }
     }
 
     last_pts_100ns_.store(pts100ns);
-
-    // Сбрасываем очереди dualout, чтобы не было хвостов старого аудио
-    if (bridge_) {
-        bridge_->eng.flush();
-    }
+    seekCount_.fetch_add(1);
+    seekLatencyMs_.store(-1);
 
     // Видео тоже перескакиваем
     if (videoReady_) {
@@ -264,6 +369,18 @@ bool PlayerCore::seek_ms(int64_t ms){
     return true;
 }
 
+void PlayerCore::set_seek_window(int behindMs, int aheadMs){
+    winBehindMs_ = (std::clamp)(behindMs, 0, 60000);
+    winAheadMs_  = (std::clamp)(aheadMs, 0, 60000);
+}
+
+void PlayerCore::set_watermarks(int lowMs, int highMs){
+    bufHighMs_ = (std::max)(0, highMs);
+    bufLowMs_  = (std::clamp)(lowMs, 0, bufHighMs_);
+    if (bridge_) bridge_->eng.setWatermarksMs(bufLowMs_, bufHighMs_);
+}
+
+#ifdef _WIN32
 bool PlayerCore::set_hwnd(HWND hwnd){
     hwnd_ = hwnd;
     // если уже открыт url_ — готовим видео-сессию
@@ -276,105 +393,486 @@ bool PlayerCore::set_hwnd(HWND hwnd){
     }
     return true;
 }
+#endif
 
 std::string PlayerCore::status_json() const{
     const bool isOpen = opened_.load();
     const bool isPaused = paused_.load();
     long long pts = last_pts_100ns_.load();
-    long long dur = duration_100ns_;
+    long long dur = duration_100ns_.load();
     auto ms = pts / 10000;
     auto total = dur>0 ? dur/10000 : 0;
 
-    char buf[256];
+    DualOutBufferingStats bs{};
+    if (bridge_) bridge_->eng.getBufferingStats(bs);
+    const bool buffering = isOpen && !isPaused && bs.buffering;
+
+    LoudnessInfo li;
+    const char* loudState = "none";
+    float loudGain = 0.0f;
+    int scanPct = -1;
+    {
+        std::lock_guard<std::mutex> lk(loudMtx_);
+        li = loudInfo_;
+        loudGain = loudGainDb_;
+        if (loudReady_) {
+            loudState = "ready";
+        } else if (isOpen && loudness_.busy(loudUrl_)) {
+            loudState = "scanning";
+            scanPct = loudness_.progress_pct();
+        }
+    }
+
+    // копии на секунду декодированного: декодер (в блок пула) + движок (в кольца A и B)
+    const double decodedSec = (double)decodedFrames_.load() / (fmt_.sr ? fmt_.sr : 48000);
+    const uint64_t ringBytes = bridge_ ? bridge_->eng.ringBytesWritten() - ringBytesAtOpen_ : 0;
+    const double copyPerSec  = decodedSec > 0 ? (decCopyBytes_.load() + ringBytes) / decodedSec : 0.0;
+    const double savedPerSec = decodedSec > 0 ? decCopyAvoided_.load() / decodedSec : 0.0;
+    const uint64_t writes = feedWrites_.load();
+
+    // кэш PCM: сколько файла уже записано и какая доля отдана из него, а не декодером
+    const int cachePct = isOpen ? cachePct_.load() : -1;
+    const int cacheServedPct = isOpen ? cacheServedPct_.load() : -1;
+
+    // индекс seek: готов, строится или нет (поток / не MF)
+    const char* seekIdxState = "none";
+    size_t seekIdxPoints = 0;
+    {
+        std::lock_guard<std::mutex> lk(seekIdxMtx_);
+        if (isOpen && seekIdx_) {
+            seekIdxState = "ready";
+            seekIdxPoints = seekIdx_->pts.size();
+        } else if (isOpen && seekIndex_.busy(seekIdxUrl_)) {
+            seekIdxState = "building";
+        }
+    }
+
+    // окно PCM: сколько держим, сколько памяти и доля seek, отданных из него
+    const uint32_t winHits = winHits_.load(), winSeeks = winHits + winMisses_.load();
+    const long long winMs = winFrames_.load() * 1000 / (fmt_.sr ? fmt_.sr : 48000);
+
+    // плейлист: что звучит, сколько впереди и готов ли следующий декодер
+    size_t queued = 0;
+    bool nextReady = false;
+    {
+        std::lock_guard<std::mutex> lk(plMtx_);
+        queued = queue_.size() + (next_.dec || next_.opening ? 1 : 0);
+        nextReady = next_.dec != nullptr;
+    }
+    // переход между элементами: доля прозвучавшего на A (-1 — не звучит)
+    const float xfProgress = isOpen && bridge_ ? bridge_->eng.transitionProgress(0) : -1.0f;
+
+    char buf[2048];
     std::snprintf(buf, sizeof(buf),
         "{\"ok\":true,\"state\":\"%s\",\"pos_ms\":%lld,\"dur_ms\":%lld,"
-        "\"sr\":%u,\"ch\":%u,\"bps\":%u}",
-        (!isOpen ? "stopped" : (isPaused ? "paused" : "playing")),
+        "\"sr\":%u,\"ch\":%u,\"bps\":%u,\"decoder\":\"%s\","
+        "\"seeks\":%u,\"seek_ms_to_audible\":%d,"
+        "\"buffering\":%s,\"fill_pct\":%d,\"stalls\":%u,"
+        "\"stall_ms_now\":%d,\"stall_ms_last\":%d,\"stall_ms_total\":%lld,"
+        "\"loudness\":\"%s\",\"lufs\":%.1f,\"true_peak_db\":%.1f,\"norm_gain_db\":%.1f,\"scan_pct\":%d,"
+        "\"decode_q_blocks\":%u,\"decode_q_ms\":%lld,\"decode_starved\":%u,"
+        "\"decode_us\":%.1f,\"decode_us_max\":%.1f,\"feed_us\":%.1f,\"feed_us_max\":%.1f,"
+        "\"copy_bytes_per_s\":%.0f,\"copy_avoided_bytes_per_s\":%.0f,\"feed_spans_avg\":%.2f,"
+        "\"pcm_cache_pct\":%d,\"pcm_cache_served_pct\":%d,"
+        "\"seek_index\":\"%s\",\"seek_index_points\":%zu,"
+        "\"seek_target_frame\":%lld,\"seek_first_frame\":%lld,"
+        "\"seek_discarded_frames\":%lld,\"seek_discarded_fast_frames\":%lld,"
+        "\"seek_window_ms\":%lld,\"seek_window_bytes\":%zu,\"seek_window_hits\":%u,\"seek_window_hit_pct\":%d,"
+        "\"item\":%u,\"queued\":%zu,\"next_ready\":%s,\"item_switches\":%u,"
+        "\"crossfade_ms\":%d,\"crossfades\":%u,\"crossfade_active\":%s,\"crossfade_progress\":%.2f}",
+        (!isOpen ? "stopped" : (ended_.load() ? "ended" : (isPaused ? "paused" : (buffering ? "buffering" : "playing")))),
         (long long)ms, (long long)total,
-        fmt_.sr, fmt_.ch, fmt_.bps);
+        fmt_.sr, fmt_.ch, fmt_.bps, decName_.load(),
+        seekCount_.load(), seekLatencyMs_.load(),
+        buffering ? "true" : "false", bs.fillPct, bs.stalls,
+        bs.currentStallMs, bs.lastStallMs, (long long)bs.totalStallMs,
+        loudState, li.lufs, li.truePeakDb, loudGain, scanPct,
+        (unsigned)readyQ_.size(), (long long)(queuedFrames_.load() * 1000 / (fmt_.sr ? fmt_.sr : 48000)),
+        starved_.load(), decodeUsAvg_.load(), decodeUsMax_.load(), feedUsAvg_.load(), feedUsMax_.load(),
+        copyPerSec, savedPerSec, writes ? (double)feedSpans_.load() / writes : 0.0,
+        cachePct, cacheServedPct,
+        seekIdxState, seekIdxPoints,
+        seekTargetFrame_.load(), seekFirstFrame_.load(),
+        seekDiscarded_.load(), seekDiscardedFast_.load(),
+        isOpen ? winMs : 0LL, isOpen ? window_.bytes() : (size_t)0, winHits,
+        winSeeks ? (int)(winHits * 100 / winSeeks) : -1,
+        playItem_.load(), queued, nextReady ? "true" : "false", itemSwitches_.load(),
+        xfadeMs_.load(), xfadeCount_.load(), xfProgress >= 0.0f ? "true" : "false", xfProgress);
     return std::string(buf);
 }
 
-bool PlayerCore::refresh_reader_media_type(const char* reason){
-    if (!reader_) return false;
-    ComPtr<IMFMediaType> current;
-    HRESULT hr = reader_->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &current);
-    if (FAILED(hr)) {
-        std::cerr << "[PlayerCore] GetCurrentMediaType failed hr=" << hr_to_string(hr) << std::endl;
+// Новое поколение блоков: декодер перейдёт на pts100ns, старые блоки выбросятся
+void PlayerCore::request_decode_seek(int64_t pts100ns){
+    decSeekTo_.store(pts100ns);
+    decGen_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+static int64_t frame_at(int64_t pts100ns, uint32_t sr){
+    return (int64_t)std::llround((double)pts100ns * sr / 10000000.0);
+}
+
+// Seek декодера (поток декодера). Возвращает кадр цели; если декодер встал
+// раньше и знает где, лишнее до цели выбрасывает он сам — без конвертации
+int64_t PlayerCore::seek_to_frame(int64_t pts100ns){
+    const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+    const int64_t target = frame_at(pts100ns > 0 ? pts100ns : 0, sr);
+    seekTargetFrame_.store(target);
+    seekFirstFrame_.store(-1);
+    seekDiscarded_.store(0);
+    seekDiscardedFast_.store(0);
+    if (!dec_->seek_100ns(pts100ns)) {
+        std::cerr << "[PlayerCore] " << decName_.load() << " seek failed" << std::endl;
+        return target;
+    }
+    const int64_t at = dec_->next_pts();
+    if (at >= 0 && frame_at(at, sr) < target) {
+        const size_t n = dec_->skip((size_t)(target - frame_at(at, sr)));
+        seekDiscarded_.store((long long)n);
+        seekDiscardedFast_.store((long long)n);
+    }
+    return target;
+}
+
+// Срезает начало блока до кадра target. false — блок целиком до цели, нужен
+// следующий; true — в блоке есть что отдать, pts и статистика точности обновлены
+bool PlayerCore::trim_block(PcmBlock* b, int64_t target){
+    const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+    const uint32_t ch = fmt_.ch ? fmt_.ch : 2;
+    int64_t at = frame_at(b->pts, sr);
+    if (at + (int64_t)b->frames <= target) {
+        seekDiscarded_.fetch_add((long long)b->frames);
         return false;
     }
-    std::string tag = reason ? std::string(reason) : std::string("reader-type");
-    log_media_type(tag.c_str(), current.Get());
-
-    UINT32 sr = fmt_.sr;
-    UINT32 ch = fmt_.ch;
-    UINT32 bps = fmt_.bps;
-    current->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &sr);
-    current->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &ch);
-    current->GetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, &bps);
-    GUID subtype{};
-    current->GetGUID(MF_MT_SUBTYPE, &subtype);
-
-    fmt_.sr = sr;
-    fmt_.ch = ch;
-    readerSubtype_ = subtype;
-    readerBitsPerSample_ = bps ? bps : 16;
-    readerBytesPerFrame_ = fmt_.ch * ((readerBitsPerSample_ + 7) / 8);
-    if (readerBytesPerFrame_ == 0) {
-        readerBytesPerFrame_ = fmt_.ch * (fmt_.bps / 8);
-    }
-    convertFloatToS16_ = IsEqualGUID(subtype, MFAudioFormat_Float);
-    downmixIntToS16_ = (!convertFloatToS16_ && readerBitsPerSample_ != 16);
-    fmt_.bps = (convertFloatToS16_ || downmixIntToS16_) ? 16u : readerBitsPerSample_;
-    if (convertFloatToS16_) {
-        std::cerr << "[PlayerCore] Reader delivers float32 PCM; enabling float->s16 conversion" << std::endl;
-    } else if (downmixIntToS16_) {
-        std::cerr << "[PlayerCore] Reader delivers PCM " << readerBitsPerSample_ << " bits; downmixing to s16" << std::endl;
+    if (at < target) {
+        const size_t k = (size_t)(target - at);
+        std::memmove(b->pcm.data(), b->pcm.data() + k * ch, (b->frames - k) * ch * sizeof(int16_t));
+        b->frames -= k;
+        seekDiscarded_.fetch_add((long long)k);
+        at = target;
+        b->pts = target * 10000000 / sr;
     }
+    seekFirstFrame_.store(at);   // > target — декодер встал позже цели
     return true;
 }
 
-void PlayerCore::convert_samples_to_s16(const uint8_t* src, size_t frames){
-    const size_t sampleCount = frames * fmt_.ch;
-    scratch16_.resize(sampleCount);
-    if (convertFloatToS16_) {
-        const float* fsrc = reinterpret_cast<const float*>(src);
-        for (size_t i=0; i<sampleCount; ++i) {
-            float v = std::clamp(fsrc[i], -1.0f, 1.0f);
-            scratch16_[i] = static_cast<int16_t>(std::lrintf(v * 32767.0f));
+// Поток декодера (или open/stop без потоков): кэш PCM в атомики для статуса
+void PlayerCore::publish_cache_stats(){
+    int pct = -1, servedPct = -1;
+    if (pcmCache_ && pcmCache_->mapped()) {
+        pct = pcmCache_->cached_pct();
+        const uint64_t served = pcmCache_->served_frames(), total = served + pcmCache_->decoded_frames();
+        servedPct = total ? (int)(served * 100 / total) : 0;
+    }
+    cachePct_.store(pct, std::memory_order_relaxed);
+    cacheServedPct_.store(servedPct, std::memory_order_relaxed);
+}
+
+// Стадия декодирования: пока есть свободные блоки — читаем вперёд, без пауз
+// плеера (после паузы или seek очередь уже полна).
+void PlayerCore::decode_loop(){
+    audio_decoder_thread_init();
+    const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+    const int64_t aheadFrames = window_.capacity() ? (int64_t)winAheadMs_ * sr / 1000 : 0;
+    uint32_t gen = decGen_.load(std::memory_order_acquire);
+    bool done = false;   // в этом поколении уже отдан маркер конца/ошибки
+    int64_t trimTo = -1; // кадр цели seek, пока не отдан первый блок поколения
+    int64_t replay = -1; // следующий кадр из окна PCM (-1 — читаем декодер)
+    while (!stop_.load()) {
+        if (seekIdxNew_.exchange(false)) {
+            std::shared_ptr<const SeekIndex> idx;
+            { std::lock_guard<std::mutex> lk(seekIdxMtx_); idx = seekIdx_; }
+            dec_->set_seek_index(std::move(idx));
         }
-        return;
+        publish_cache_stats();
+        // следующий элемент зазвучал — предыдущий декодер больше не нужен
+        if (prevDec_ && playItem_.load() == decItem_) prevDec_.reset();
+        const uint32_t now = decGen_.load(std::memory_order_acquire);
+        if (now != gen) {
+            gen = now;
+            done = false;
+            trimTo = replay = -1;
+            // хвост перехода декодер уже прочитал дальше конца окна: после
+            // повтора из окна read() продолжил бы с дырой — окно сбрасываем,
+            // seek идёт через декодер
+            if ((xfPhase_ == XfPhase::Tail || xfPhase_ == XfPhase::Drain) && xfTailN_ > 0) {
+                window_.reset(0);
+            }
+            xfPhase_ = XfPhase::None;   // переход не доигран — seek важнее
+            xfTailN_ = 0;
+            const uint32_t want = seekItem_.load();
+            if (want != decItem_ && !back_to_item(want)) {
+                std::cerr << "[PlayerCore] seek: item " << want << " already closed, seeking item " << decItem_ << std::endl;
+            }
+            const int64_t target = frame_at((std::max)(0LL, decSeekTo_.load()), sr);
+            if (window_.contains(target)) {
+                // декодер стоит на конце окна: отдаём из памяти до него и читаем дальше
+                replay = target;
+                winHits_.fetch_add(1);
+                seekTargetFrame_.store(target);
+                seekFirstFrame_.store(target);
+                seekDiscarded_.store(0);
+                seekDiscardedFast_.store(0);
+            } else {
+                if (window_.capacity()) winMisses_.fetch_add(1);
+                trimTo = seek_to_frame(decSeekTo_.load());
+            }
+        }
+        PcmBlock* b = nullptr;
+        if (done || (aheadFrames && queuedFrames_.load(std::memory_order_relaxed) >= aheadFrames) ||
+            !freeQ_.pop(b)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+
+        const long long t0 = steady_now_ns();
+        b->frames = 0;
+        b->xfade = 0;
+        if (replay >= 0) {
+            b->frames = window_.copy(b->pcm.data(), replay, kDecodeBlockFrames);
+            b->pts = replay * 10000000 / sr;
+            replay += (int64_t)b->frames;
+            if (b->frames == 0 || replay >= window_.end_frame()) replay = -1;
+        }
+        const bool decoded = b->frames == 0;   // не из окна
+        if (decoded && xfPhase_ != XfPhase::None) {
+            xfade_block(b);
+        } else if (decoded) {
+            b->frames = dec_->read(b->pcm.data(), kDecodeBlockFrames, &b->pts);
+            // первый блок после seek: то, что декодер не выбросил сам, срезаем по pts
+            while (trimTo >= 0 && b->frames > 0 && decGen_.load(std::memory_order_acquire) == gen &&
+                   !trim_block(b, trimTo)) {
+                b->frames = dec_->read(b->pcm.data(), kDecodeBlockFrames, &b->pts);
+            }
+            if (b->frames > 0 && xfade_begin(b)) {
+                xfade_block(b);
+            } else if (b->frames == 0 && !dec_->failed() && decGen_.load(std::memory_order_acquire) == gen &&
+                       next_item(b, 0)) {
+                // элемент кончился — продолжаем следующим из плейлиста, без разрыва
+                trimTo = -1;
+            }
+        }
+        if (decoded) {
+            if (b->frames > 0) trimTo = -1;
+            if (b->frames > 0 && !b->xfade) {   // сведённое с хвостом в окно не кладём
+                // pts декодера округлены: сдвиг на кадр от конца окна — тот же поток
+                int64_t at = frame_at(b->pts, sr);
+                if (std::llabs(at - window_.end_frame()) <= 1) at = window_.end_frame();
+                if (at >= 0) window_.append(b->pcm.data(), at, b->frames);
+                winFrames_.store((long long)window_.frames(), std::memory_order_relaxed);
+            }
+            decodedFrames_.fetch_add(b->frames, std::memory_order_relaxed);
+            decCopyBytes_.store(dec_->bytes_copied(), std::memory_order_relaxed);
+            decCopyAvoided_.store(dec_->bytes_copy_avoided(), std::memory_order_relaxed);
+        }
+        stage_time(decodeUsAvg_, decodeUsMax_, steady_now_ns() - t0);
+        b->gen = gen;
+        b->item = decItem_;
+        b->eos = b->frames == 0 && !dec_->failed();
+        b->failed = b->frames == 0 && dec_->failed();
+        if (b->frames == 0) {
+            if (b->failed) std::cerr << "[PlayerCore] " << decName_.load() << " decoder failed" << std::endl;
+            done = true;
+        }
+        queuedFrames_.fetch_add((int64_t)b->frames, std::memory_order_relaxed);
+        readyQ_.push(b);   // блоков в пуле не больше ёмкости очереди
     }
-    if (!downmixIntToS16_) {
-        const int16_t* ssrc = reinterpret_cast<const int16_t*>(src);
-        std::copy(ssrc, ssrc + sampleCount, scratch16_.begin());
-        return;
+}
+
+// Текущий элемент кончился (поток декодера): декодер из предзагрузки
+// становится текущим, его первый блок — в b. false — плейлист пуст.
+// Пустой плейлист ждём, пока у рабочего потока больше holdFrames кадров:
+// enqueue() в это время ещё успевает встык.
+bool PlayerCore::next_item(PcmBlock* b, int64_t holdFrames){
+    const uint32_t gen = decGen_.load(std::memory_order_acquire);
+    // не больше одного элемента вперёд: пока предыдущий звучит, его декодер
+    // нужен для seek назад
+    while (prevDec_ && playItem_.load() != decItem_) {
+        if (stop_.load() || decGen_.load(std::memory_order_acquire) != gen) return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
     }
-    if (readerBitsPerSample_ == 24) {
-        const uint8_t* bytes = src;
-        for (size_t i=0; i<sampleCount; ++i) {
-            int32_t value = (static_cast<int32_t>(bytes[0]) |
-                            (static_cast<int32_t>(bytes[1]) << 8) |
-                            (static_cast<int32_t>(bytes[2]) << 16));
-            if (value & 0x800000) value |= ~0xFFFFFF;
-            scratch16_[i] = static_cast<int16_t>(value >> 8);
-            bytes += 3;
+    prevDec_.reset();
+    NextItem n;
+    uint32_t item = 0;
+    {
+        std::unique_lock<std::mutex> lk(plMtx_);
+        // предзагрузка ещё идёт: ждём, поток декодера впереди позиции на секунды
+        while (!next_.dec && (next_.opening || !queue_.empty() ||
+                              queuedFrames_.load(std::memory_order_relaxed) > holdFrames)) {
+            if (stop_.load() || decGen_.load(std::memory_order_acquire) != gen) return false;
+            lk.unlock();
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            lk.lock();
         }
-        return;
+        if (!next_.dec) return false;
+        n = std::move(next_);
+        next_ = NextItem{};
+        item = decItem_ + 1;
+        const ItemInfo info{n.url, n.dec->duration_100ns()};
+        if (item < items_.size()) items_[item] = info; else items_.push_back(info);
+    }
+    plCv_.notify_all();   // предзагрузка берёт следующий url
+
+    prevDec_ = std::move(dec_);
+    prevItem_ = decItem_;
+    prevUrl_ = decUrl_;
+    dec_ = std::move(n.dec);
+    decItem_ = item;
+    decUrl_ = n.url;
+    decName_.store(dec_->name());
+    pcmCache_ = dynamic_cast<CachedPcmDecoder*>(dec_.get());
+    begin_seek_index(decUrl_);
+    window_.reset(0);
+
+    if (n.headFrames) {
+        std::memcpy(b->pcm.data(), n.head.data(), n.headFrames * fmt_.ch * sizeof(int16_t));
+        b->frames = n.headFrames;
+        b->pts = n.headPts;
+    } else {
+        b->frames = dec_->read(b->pcm.data(), kDecodeBlockFrames, &b->pts);   // вернулся после back_to_item()
+    }
+    std::cerr << "[PlayerCore] item " << item << " queued gapless after item " << prevItem_ << std::endl;
+    return true;
+}
+
+// Seek в элементе, который ещё звучит, а декодер уже перешёл к следующему:
+// возвращаем предыдущий декодер, следующий — снова в предзагрузку, с начала
+bool PlayerCore::back_to_item(uint32_t item){
+    if (!prevDec_ || prevItem_ != item) return false;
+    dec_->seek_100ns(0);
+    {
+        std::lock_guard<std::mutex> lk(plMtx_);
+        if (next_.dec || next_.opening) queue_.push_front(next_.url);
+        if (next_.opening) ++plGen_;   // открываемое сейчас выбросится
+        next_ = NextItem{};
+        next_.url = decUrl_;
+        next_.dec = std::move(dec_);
     }
-    if (readerBitsPerSample_ >= 32) {
-        const int32_t* isrc = reinterpret_cast<const int32_t*>(src);
-        for (size_t i=0; i<sampleCount; ++i) {
-            scratch16_[i] = static_cast<int16_t>(isrc[i] >> 16);
+    dec_ = std::move(prevDec_);
+    decItem_ = prevItem_;
+    decUrl_ = prevUrl_;
+    decName_.store(dec_->name());
+    pcmCache_ = dynamic_cast<CachedPcmDecoder*>(dec_.get());
+    begin_seek_index(decUrl_);
+    window_.reset(0);
+    return true;
+}
+
+// Кроссфейд: b — блок текущего элемента. Если до конца по длительности
+// меньше перехода, b уходит в хвост (true); следующий элемент может
+// появиться в очереди и позже, пока хвост копится
+bool PlayerCore::xfade_begin(PcmBlock* b){
+    const int ms = xfadeMs_.load();
+    const long long dur = dec_->duration_100ns();
+    if (ms <= 0 || dur <= 0) return false;   // поток без длительности — встык
+    const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+    const uint32_t ch = fmt_.ch ? fmt_.ch : 2;
+    const size_t xf = (size_t)((int64_t)ms * sr / 1000);
+    const int64_t at = frame_at(b->pts, sr);
+    if (at + (int64_t)(b->frames + xf + kDecodeBlockFrames) < frame_at(dur, sr)) return false;
+    // длительность из контейнера приблизительна: хвост копится до конца
+    // потока, длина перехода — сколько в нём окажется, но не больше xf
+    xfFrames_ = xf;
+    xfTail_.resize((xf + 2 * kDecodeBlockFrames) * ch);
+    std::memcpy(xfTail_.data(), b->pcm.data(), b->frames * ch * sizeof(int16_t));
+    xfTailOff_ = 0;
+    xfTailN_ = b->frames;
+    xfTailAt_ = at;
+    xfTailEos_ = false;
+    xfPhase_ = XfPhase::Tail;
+    b->frames = 0;
+    return true;
+}
+
+// Следующий блок перехода (поток декодера): часть хвоста, которая в
+// переход не войдёт, или начало следующего элемента, сведённое с хвостом
+void PlayerCore::xfade_block(PcmBlock* b){
+    const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+    const uint32_t ch = fmt_.ch ? fmt_.ch : 2;
+    if (xfPhase_ == XfPhase::Mix) {
+        b->frames = dec_->read(b->pcm.data(), kDecodeBlockFrames, &b->pts);
+        if (b->frames == 0) {
+            if (dec_->failed()) { xfPhase_ = XfPhase::None; return; }
+            // следующий короче перехода: хвост затухает дальше на тишине
+            b->frames = (std::min)(kDecodeBlockFrames, xfLen_ - xfPos_);
+            std::memset(b->pcm.data(), 0, b->frames * ch * sizeof(int16_t));
+            b->pts = (xfInAt_ + (int64_t)xfPos_) * 10000000 / sr;
         }
+        xfade_mix(b);
         return;
     }
-    const int16_t* fallback = reinterpret_cast<const int16_t*>(src);
-    std::copy(fallback, fallback + sampleCount, scratch16_.begin());
+    if (xfPhase_ == XfPhase::Tail) {
+        const size_t cap = xfTail_.size() / ch;
+        while (!xfTailEos_ && xfTailN_ < xfFrames_ + kDecodeBlockFrames) {
+            if (xfTailOff_ + xfTailN_ + kDecodeBlockFrames > cap) {
+                std::memmove(xfTail_.data(), xfTail_.data() + xfTailOff_ * ch, xfTailN_ * ch * sizeof(int16_t));
+                xfTailOff_ = 0;
+            }
+            int64_t pts = 0;
+            const size_t n = dec_->read(xfTail_.data() + (xfTailOff_ + xfTailN_) * ch, kDecodeBlockFrames, &pts);
+            if (n == 0) xfTailEos_ = true;   // и при ошибке: переход из того, что успели
+            xfTailN_ += n;
+        }
+        if (xfTailEos_ && xfTailN_ <= xfFrames_) {
+            // следующего ждём, пока не пора отдавать хвост: очередь почти пуста
+            if (xfTailN_ > 0 && next_item(b, (int64_t)sr / 5)) {
+                // переход ровно на длину хвоста; огибающие equal-power, cos² + sin² = 1
+                xfLen_ = xfTailN_;
+                xfPos_ = 0;
+                xfInAt_ = frame_at(b->pts, sr);
+                xfGainOut_.resize(xfLen_);
+                xfGainIn_.resize(xfLen_);
+                for (size_t k = 0; k < xfLen_; ++k) {
+                    const double t = 1.5707963267948966 * ((double)k + 0.5) / (double)xfLen_;
+                    xfGainOut_[k] = (float)std::cos(t);
+                    xfGainIn_[k]  = (float)std::sin(t);
+                }
+                xfPhase_ = XfPhase::Mix;
+                xfadeCount_.fetch_add(1);
+                std::cerr << "[PlayerCore] crossfade " << xfLen_ * 1000 / sr << "ms into item " << decItem_ << std::endl;
+                xfade_mix(b);
+                return;
+            }
+            xfPhase_ = XfPhase::Drain;   // переходить некуда — хвост как есть
+        }
+    }
+    const size_t keep = xfPhase_ == XfPhase::Tail ? (std::min)(xfTailN_, xfFrames_) : 0;
+    const size_t n = (std::min)(kDecodeBlockFrames, xfTailN_ - keep);
+    std::memcpy(b->pcm.data(), xfTail_.data() + xfTailOff_ * ch, n * ch * sizeof(int16_t));
+    b->frames = n;
+    b->pts = xfTailAt_ * 10000000 / sr;
+    xfTailAt_ += (int64_t)n;
+    xfTailOff_ += n;
+    xfTailN_ -= n;
+    if (xfPhase_ == XfPhase::Drain && xfTailN_ == 0) xfPhase_ = XfPhase::None;
 }
 
-bool PlayerCore::needs_sample_conversion() const{
-    return convertFloatToS16_ || downmixIntToS16_;
+// Сводит начало b (следующий элемент) с хвостом предыдущего
+void PlayerCore::xfade_mix(PcmBlock* b){
+    const uint32_t ch = fmt_.ch ? fmt_.ch : 2;
+    const size_t n = (std::min)(b->frames, xfLen_ - xfPos_);
+    pcm_mix2_s16(b->pcm.data(), xfTail_.data() + xfTailOff_ * ch, xfGainOut_.data() + xfPos_,
+                 b->pcm.data(), xfGainIn_.data() + xfPos_, n, ch);
+    xfTailOff_ += n;
+    xfTailN_ -= n;
+    xfPos_ += n;
+    b->xfade = (uint32_t)xfLen_;
+    if (xfPos_ >= xfLen_) xfPhase_ = XfPhase::None;
+}
+
+// Следующий блок текущего поколения (nullptr — очередь пуста). Блоки
+// старых поколений сразу возвращаются в пул.
+PcmBlock* PlayerCore::pop_block(){
+    PcmBlock* b = nullptr;
+    while (readyQ_.pop(b)) {
+        queuedFrames_.fetch_sub((int64_t)b->frames, std::memory_order_relaxed);
+        if (b->gen == decGen_.load(std::memory_order_acquire)) return b;
+        freeQ_.push(b);
+    }
+    return nullptr;
+}
+
+void PlayerCore::release_block(PcmBlock* b){
+    freeQ_.push(b);
 }
 
 void PlayerCore::log_feed_stats(size_t frames, bool writeOk){
@@ -396,96 +894,310 @@ void PlayerCore::log_feed_stats(size_t frames, bool writeOk){
         failedWritesSinceLog_ = 0;
     }
 }
+// Собирает из очереди декодера минимум minFrames кадров (s16) в конец dst.
+// false — поток кончился/ошибка
+bool PlayerCore::decode_pcm(std::vector<int16_t>& dst, size_t minFrames, int64_t* firstTs){
+    const uint32_t ch = fmt_.ch ? fmt_.ch : 2;
+    size_t got = 0;
+    bool haveTs = false;
+    while (got < minFrames && !stop_.load()) {
+        PcmBlock* b = pop_block();
+        if (!b) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (b->frames == 0) {
+            if (b->eos) eosGen_ = b->gen;
+            release_block(b);
+            return false;
+        }
+        if (!haveTs && firstTs) { *firstTs = b->pts; haveTs = true; }
+        dst.insert(dst.end(), b->pcm.data(), b->pcm.data() + b->frames * ch);
+        got += b->frames;
+        release_block(b);
+    }
+    return got >= minFrames;
+}
+
+// Seek во время игры: pre-roll декодируется в боковой буфер, пока звучит
+// старое аудио, затем движок подменяет очередь с кроссфейдом
+void PlayerCore::seek_crossfade(int64_t pts100ns){
+    request_decode_seek(pts100ns);
+
+    DualOutEngine& eng = bridge_->eng;
+    const uint32_t ch = fmt_.ch ? fmt_.ch : 2;
+    const size_t want = (std::min)((size_t)fmt_.sr * seekPrerollMs_ / 1000, eng.spliceCapacityFrames());
+
+    seekPreroll_.clear();
+    int64_t firstTs = pts100ns;
+    decode_pcm(seekPreroll_, want, &firstTs);
+    const size_t have = seekPreroll_.size() / ch;
+    const size_t head = (std::min)(have, want);
+
+    bool spliced = head > 0 && eng.splice(seekPreroll_.data(), head, firstTs, seekXfadeMs_);
+    if (spliced) {
+        // Пока колбэки не подхватили новый кусок, в ринги писать нельзя
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+        while (eng.splicePending() && !stop_.load() &&
+               std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (eng.splicePending()) {
+            std::cerr << "[PlayerCore] splice not picked up in time; falling back to flush" << std::endl;
+            spliced = false;
+        }
+    }
+
+    long long latencyNs = 0;
+    if (spliced) {
+        latencyNs = eng.lastSpliceAudibleNs() - seekRequestNs_.load();
+    } else {
+        eng.flush();
+        if (head) eng.write(seekPreroll_.data(), head, firstTs);
+        latencyNs = steady_now_ns() - seekRequestNs_.load();
+    }
+    if (have > head) {
+        const int64_t restTs = firstTs + (int64_t)head * 10000000 / (fmt_.sr ? fmt_.sr : 48000);
+        eng.write(seekPreroll_.data() + head * ch, have - head, restTs);
+    }
+
+    last_pts_100ns_.store(firstTs);
+    seekCount_.fetch_add(1);
+    seekLatencyMs_.store((int)(latencyNs / 1000000));
+    std::cerr << "[PlayerCore] seek " << (spliced ? "crossfade" : "flush")
+              << " to " << pts100ns / 10000 << "ms, audible after "
+              << latencyNs / 1000000 << "ms" << std::endl;
+}
+
+// Индекс seek построен (поток индексатора): декодеру его передаст decode_loop
+void PlayerCore::on_seek_index(const std::wstring& url, std::shared_ptr<const SeekIndex> idx){
+    {
+        std::lock_guard<std::mutex> lk(seekIdxMtx_);
+        if (url != seekIdxUrl_) return;   // уже открыт другой файл
+        seekIdx_ = std::move(idx);
+    }
+    seekIdxNew_.store(true);
+}
+
+// Скан громкости закончился (поток сканера) или нашёлся в кэше (open)
+void PlayerCore::on_loudness(const std::wstring& url, const LoudnessInfo& info){
+    {
+        std::lock_guard<std::mutex> lk(loudMtx_);
+        if (url != loudUrl_) return;   // уже открыт другой файл
+        loudInfo_ = info;
+        loudReady_ = true;
+    }
+    apply_loudness_gain();
+    float gain;
+    { std::lock_guard<std::mutex> lk(loudMtx_); gain = loudGainDb_; }
+    char buf[192];
+    std::snprintf(buf, sizeof(buf),
+        "{\"event\":\"loudness\",\"lufs\":%.1f,\"true_peak_db\":%.1f,\"gain_db\":%.1f,\"cached\":%s,\"scan_x\":%.1f}",
+        info.lufs, info.truePeakDb, gain, info.cached ? "true" : "false",
+        info.scanSeconds > 0.0 ? info.seconds / info.scanSeconds : 0.0);
+    emit_event(buf);
+}
+
+// Усиление до целевого уровня, но не выше -1 dBTP и не больше +12 дБ
+void PlayerCore::apply_loudness_gain(){
+    float gain = 0.0f;
+    {
+        std::lock_guard<std::mutex> lk(loudMtx_);
+        if (loudAuto_ && loudReady_ && loudInfo_.lufs > -70.0) {
+            gain = loudTarget_ - (float)loudInfo_.lufs;
+            gain = (std::min)(gain, -1.0f - (float)loudInfo_.truePeakDb);
+            gain = (std::clamp)(gain, -20.0f, 12.0f);
+        }
+        loudGainDb_ = gain;
+    }
+    if (bridge_) bridge_->eng.setTrimDb(gain);
+}
+
+void PlayerCore::set_loudness(float targetLufs, bool autoGain){
+    {
+        std::lock_guard<std::mutex> lk(loudMtx_);
+        loudTarget_ = (std::clamp)(targetLufs, -40.0f, -5.0f);
+        loudAuto_ = autoGain;
+    }
+    apply_loudness_gain();
+}
+
+void PlayerCore::emit_event(const std::string& json){
+    if (eventSink_) eventSink_(json);
+}
+
+// Следующий элемент зазвучал на обоих устройствах (рабочий поток): теперь
+// он текущий — длительность, нормализация, событие item_change
+void PlayerCore::present_items(){
+    if (!bridge_) return;
+    const uint32_t gen = decGen_.load(std::memory_order_acquire);
+    while (!marks_.empty()) {
+        const ItemMark m = marks_.front();
+        if (m.gen == gen && !bridge_->eng.cursorPlayed(m.at)) break;
+        marks_.pop_front();
+        if (m.gen != gen || m.item == playItem_.load()) continue;   // seek выбросил или уже текущий
+
+        ItemInfo info;
+        {
+            std::lock_guard<std::mutex> pl(plMtx_);
+            if (m.item < items_.size()) info = items_[m.item];
+        }
+        const uint32_t prev = playItem_.exchange(m.item);
+        duration_100ns_.store(info.dur100ns);
+        itemSwitches_.fetch_add(1);
+        begin_loudness(info.url);
+        std::cerr << "[PlayerCore] now playing item " << m.item << ": " << utf8_from_wide(info.url) << std::endl;
+        const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+        char buf[160];
+        std::snprintf(buf, sizeof(buf), "{\"event\":\"item_change\",\"item\":%u,\"prev_item\":%u,\"dur_ms\":%lld,"
+                      "\"crossfade_ms\":%u,\"url\":\"",
+                      m.item, prev, info.dur100ns / 10000, (uint32_t)((uint64_t)m.xfade * 1000 / sr));
+        emit_event(buf + json_escape(utf8_from_wide(info.url)) + "\"}");
+    }
+}
+
+// Декодер кончился: ставим EOS-маркер и ждём, пока движок доиграет очередь.
+// Seek, пауза или stop прерывают ожидание.
+void PlayerCore::wait_eos_drained(){
+    if (bridge_) {
+        bridge_->eng.markEos();
+        bridge_->eng.armWatermarks(false);
+        while (!stop_.load() && !paused_.load() && pendingSeek100ns_.load() < 0) {
+            if (bridge_->eng.eosReached()) break;
+            present_items();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        if (!bridge_->eng.eosReached()) return;
+        present_items();
+    }
+
+    paused_.store(true);
+    ended_.store(true);
+    if (bridge_) bridge_->eng.setPlayerState(DUALOUT_TM_ENDED);
+    const long long posMs = last_pts_100ns_.load() / 10000;
+    std::cerr << "[PlayerCore] playback ended at " << posMs << "ms" << std::endl;
+    char buf[96];
+    std::snprintf(buf, sizeof(buf), "{\"event\":\"eos\",\"pos_ms\":%lld}", posMs);
+    emit_event(buf);
+}
+
+// Стадия подачи: блоки из очереди декодера -> движок, с пейсингом по его очереди
 void PlayerCore::worker_loop(){
+    bool starving = false;
     while (!stop_.load()) {
+        present_items();
         {
             std::unique_lock<std::mutex> lk(mtx_);
             cv_.wait(lk, [&]{ return stop_.load() || !paused_.load(); });
             if (stop_.load()) break;
         }
 
-        DWORD idx = 0, flags = 0; LONGLONG ts = 0;
-        ComPtr<IMFSample> sample;
-        HRESULT hr = reader_->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &idx, &flags, &ts, &sample);
-        if (FAILED(hr)) {
-            std::cerr << "[PlayerCore] ReadSample failed hr=" << hr_to_string(hr) << std::endl;
-            paused_.store(true);
+        const long long seekTo = pendingSeek100ns_.exchange(-1);
+        if (seekTo >= 0) {
+            seek_crossfade(seekTo);
             continue;
         }
 
-        if (flags & MF_SOURCE_READERF_CURRENTMEDIATYPECHANGED) {
-            if (!refresh_reader_media_type("reader-type-changed")) {
-                std::cerr << "[PlayerCore] Failed to refresh media type change" << std::endl;
-            }
-        }
-        if (flags & MF_SOURCE_READERF_STREAMTICK) {
-            std::cerr << "[PlayerCore] stream tick (audio gap) ts=" << ts << std::endl;
-            if (!sample) continue;
-        }
-        if (flags & MF_SOURCE_READERF_ENDOFSTREAM) {
-            std::cerr << "[PlayerCore] end of stream" << std::endl;
-            paused_.store(true);
+        // декодер уже отдал конец потока в этом поколении — ждём, пока доиграет
+        if (eosGen_ == decGen_.load(std::memory_order_acquire)) {
+            wait_eos_drained();
             continue;
         }
-        if (!sample) continue;
 
-        last_pts_100ns_.store(ts);
-
-        ComPtr<IMFMediaBuffer> buf;
-        if (FAILED(sample->ConvertToContiguousBuffer(&buf))) continue;
-
-        BYTE* p = nullptr;
-        DWORD cb = 0;
-        if (FAILED(buf->Lock(&p, nullptr, &cb))) continue;
-
-        if (readerBytesPerFrame_ == 0) {
-            std::cerr << "[PlayerCore] readerBytesPerFrame_ is zero, skipping buffer" << std::endl;
-            buf->Unlock();
+        PcmBlock* b = pop_block();
+        if (!b) {
+            // декодер не успевает: очередь пуста посреди игры
+            if (!starving) starved_.fetch_add(1);
+            starving = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
             continue;
         }
-
-        if (cb % readerBytesPerFrame_ != 0) {
-            std::cerr << "[PlayerCore] sample size " << cb << " not aligned to frame size "
-                      << readerBytesPerFrame_ << std::endl;
-        }
-
-        size_t frames = cb / readerBytesPerFrame_;
-        if (frames == 0) {
-            buf->Unlock();
+        starving = false;
+        if (b->frames == 0) {
+            const bool failed = b->failed;
+            if (b->eos) eosGen_ = b->gen;
+            release_block(b);
+            if (failed) {
+                paused_.store(true);
+                if (bridge_) bridge_->eng.setPlayerState(DUALOUT_TM_PAUSED);
+            } else {
+                std::cerr << "[PlayerCore] end of stream" << std::endl;
+            }
             continue;
         }
 
-        const void* payload = nullptr;
-        if (needs_sample_conversion()) {
-            convert_samples_to_s16(reinterpret_cast<const uint8_t*>(p), frames);
-            payload = scratch16_.data();
-        } else {
-            payload = p;
+        // держим очередь движка с запасом над high watermark
+        const int targetMs = (std::max)(250, bufHighMs_ + 50);
+
+        // НОВОЕ: следующие блоки того же поколения, продолжающие этот по pts,
+        // уходят одним writev() — сколько нужно до цели и влезет в кольца
+        PcmBlock* batch[kFeedMaxSpans] = { b };
+        size_t nb = 1;
+        if (bridge_) {
+            const uint32_t sr = fmt_.sr ? fmt_.sr : 48000;
+            const int qMin = (std::min)(bridge_->eng.queueMsA(), bridge_->eng.queueMsB());
+            const size_t want = (std::min)(bridge_->eng.writableFrames(),
+                                           (size_t)(std::max)(0, targetMs - qMin) * sr / 1000);
+            size_t frames = b->frames;
+            while (nb < kFeedMaxSpans) {
+                PcmBlock* const* next = readyQ_.peek();
+                if (!next) break;
+                PcmBlock* n = *next;
+                const PcmBlock* last = batch[nb - 1];
+                const int64_t expect = last->pts + (int64_t)last->frames * 10000000 / sr;
+                if (n->gen != b->gen || n->item != b->item || n->frames == 0 || frames + n->frames > want ||
+                    std::llabs(n->pts - expect) > 10000000 / sr + 1) break;
+                readyQ_.drop();
+                queuedFrames_.fetch_sub((int64_t)n->frames, std::memory_order_relaxed);
+                batch[nb++] = n;
+                frames += n->frames;
+            }
         }
 
-                bool writeOk = false;
+        bool writeOk = false;
         if (!bridge_) {
-            std::cerr << "[PlayerCore] DualOut bridge missing; dropping " << frames << " frames" << std::endl;
+            std::cerr << "[PlayerCore] DualOut bridge missing; dropping " << b->frames << " frames" << std::endl;
         } else {
-            writeOk = bridge_->eng.write(payload, frames, ts);
-            log_feed_stats(frames, writeOk);
-            if (!writeOk) {
-                std::cerr << "[PlayerCore] DualOutEngine::write returned false" << std::endl;
+            std::lock_guard<std::mutex> lk(feedMtx_);
+            // seek без кроссфейда мог случиться, пока блоки были у нас
+            if (b->gen == decGen_.load(std::memory_order_acquire)) {
+                DualOutSpan spans[kFeedMaxSpans];
+                size_t frames = 0;
+                for (size_t i = 0; i < nb; ++i) {
+                    spans[i] = DualOutSpan{ batch[i]->pcm.data(), batch[i]->frames };
+                    frames += batch[i]->frames;
+                }
+                last_pts_100ns_.store(batch[nb - 1]->pts);
+                if (b->item != feedItem_) {
+                    // первый кадр следующего элемента: запоминаем, где он в кольцах
+                    const DualOutCursor at = bridge_->eng.writeCursor();
+                    marks_.push_back(ItemMark{ b->gen, b->item, b->xfade, at });
+                    feedItem_ = b->item;
+                    if (b->xfade) bridge_->eng.markTransition(at, DualOutCursor{ at.a + b->xfade, at.b + b->xfade });
+                }
+                const long long t0 = steady_now_ns();
+                writeOk = bridge_->eng.writev(spans, nb, b->pts);
+                stage_time(feedUsAvg_, feedUsMax_, steady_now_ns() - t0);
+                feedWrites_.fetch_add(1, std::memory_order_relaxed);
+                feedSpans_.fetch_add(nb, std::memory_order_relaxed);
+                log_feed_stats(frames, writeOk);
+                if (!writeOk) {
+                    std::cerr << "[PlayerCore] DualOutEngine::writev returned false" << std::endl;
+                }
             }
         }
-
-        buf->Unlock();
+        for (size_t i = 0; i < nb; ++i) release_block(batch[i]);
 
         // Пейсинг по очереди
         if (bridge_) {
-            while (!stop_.load() && !paused_.load()) {
+            while (!stop_.load() && !paused_.load() && pendingSeek100ns_.load() < 0) {
                 int qA = bridge_->eng.queueMsA();
                 int qB = bridge_->eng.queueMsB();
                 int qMin = (std::min)(qA, qB);
-
-                if (qMin < 250)
+                if (qMin < targetMs)
                     break;
 
+                present_items();
                 std::this_thread::sleep_for(std::chrono::milliseconds(5));
             }
         }
@@ -494,6 +1206,7 @@ void PlayerCore::worker_loop(){
 
 
 
+#ifdef _WIN32
 bool PlayerCore::build_video_session(){
       lastHr_ = 0; lastErr_.clear();
     if (!hwnd_ || url_.empty()) { lastErr_="no hwnd or url"; return false; }
@@ -614,7 +1327,7 @@ bool PlayerCore::video_stop(){
     return vSession_ ? SUCCEEDED(vSession_->Stop()) : false;
 }
 
-bool PlayerCore::video_seek_100ns(LONGLONG pos){
+bool PlayerCore::video_seek_100ns(int64_t pos){
     if (!vSession_) return false;
     PROPVARIANT var; PropVariantInit(&var);
     var.vt = VT_I8; var.hVal.QuadPart = pos;
@@ -623,3 +1336,12 @@ bool PlayerCore::video_seek_100ns(LONGLONG pos){
     PropVariantClear(&var);
     return SUCCEEDED(hr);
 }
+#else
+// Без Media Foundation видео нет: аудио-конвейер работает сам по себе
+bool PlayerCore::build_video_session(){ lastErr_ = "video requires Windows"; return false; }
+void PlayerCore::destroy_video_session(){}
+bool PlayerCore::video_start(){ return false; }
+bool PlayerCore::video_pause(){ return false; }
+bool PlayerCore::video_stop(){ return false; }
+bool PlayerCore::video_seek_100ns(int64_t){ return false; }
+#endif
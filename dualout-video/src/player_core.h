@@ -1,8 +1,4 @@
 #pragma once
-#include <mfapi.h>
-#include <mfidl.h>
-#include <mfreadwrite.h>
-#include <wrl/client.h>
 #include <string>
 #include <atomic>
 #include <thread>
@@ -11,12 +7,36 @@
 #include <cstdint>
 #include <vector>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <deque>
+#include "dualout_bridge.h" // чтобы писать PCM в DualOutEngine
+#include "audio_decoder.h"
+#include "loudness_scan.h"
+#include "seek_index.h"
+#include "pcm_window.h"
+#include "SpscQueue.h"
+#ifdef _WIN32
+#include <mfapi.h>
 #include <mfidl.h>
 #include <wrl/client.h>
-#include "dualout_bridge.h" // чтобы писать PCM в DualOutEngine
 #include <windows.h>
 #include <evr.h>
 struct ComInit; struct MFInit; // forward
+#endif
+class CachedPcmDecoder;
+
+// Блок PCM из пула декодера: память выделяется один раз в open()
+struct PcmBlock {
+    std::vector<int16_t> pcm;   // kDecodeBlockFrames * ch
+    size_t   frames = 0;
+    int64_t  pts = 0;
+    uint32_t gen = 0;           // поколение seek: блоки старых поколений выбрасываются
+    uint32_t item = 0;          // элемент плейлиста (0 — открытый open())
+    uint32_t xfade = 0;         // кадров перехода в этот элемент, если блок сведён с хвостом
+    bool     eos = false;       // маркер конца потока (frames == 0)
+    bool     failed = false;    // маркер ошибки декодера
+};
 
 class PlayerCore {
 public:
@@ -30,58 +50,232 @@ public:
     bool play();
     bool pause();
     bool stop();
-    bool seek_ms(int64_t ms);
+    // crossfade=true: новое аудио декодируется заранее, пока играет старое,
+    // и подменяет очередь с коротким кроссфейдом (только во время игры)
+    bool seek_ms(int64_t ms, bool crossfade = true);
+    // Плейлист: файлы после текущего играют без паузы. Декодер следующего
+    // открывается и читает первый блок заранее, его PCM встаёт в движок сразу
+    // за последним кадром текущего; item_change — когда он зазвучал.
+    // open() очищает очередь.
+    bool enqueue(const std::wstring& url);
+    void clear_queue();
+    // Кроссфейд между элементами плейлиста (equal-power), мс; 0 — без паузы
+    // встык. Хвост текущего и начало следующего сводятся в потоке декодера,
+    // отрезок перехода отмечается на ленте движка.
+    void set_crossfade(int ms);
+#ifdef _WIN32
   bool set_hwnd(HWND hwnd);
+#endif
+    // Буферизация: ниже low выход глушится до набора high (мс очереди)
+    void set_watermarks(int lowMs, int highMs);
+    // Окно декодированного PCM для seek без декодера: behind мс позади
+    // позиции, ahead — предел чтения вперёд. 0/0 — выключено. Со следующего open()
+    void set_seek_window(int behindMs, int aheadMs);
+    // Нормализация громкости: целевой уровень (LUFS) и авто-применение при open()
+    void set_loudness(float targetLufs, bool autoGain);
     // Статус в JSON-строке без зависимостей
     std::string status_json() const;
+    // События (одна JSON-строка, без \n), например eos. Зовётся из рабочего потока.
+    void set_event_sink(std::function<void(const std::string&)> sink) { eventSink_ = std::move(sink); }
   // diagnostics for error reporting
    long last_hr() const { return lastHr_; }
     const std::string& last_err() const { return lastErr_; }
 private:
     void worker_loop();
-    bool refresh_reader_media_type(const char* reason);
-    void convert_samples_to_s16(const uint8_t* src, size_t frames);
-    bool needs_sample_conversion() const;
+    void decode_loop();
+    void publish_cache_stats();
+    void request_decode_seek(int64_t pts100ns);
+    int64_t seek_to_frame(int64_t pts100ns);
+    bool trim_block(PcmBlock* b, int64_t target);
+    PcmBlock* pop_block();
+    void release_block(PcmBlock* b);
     void log_feed_stats(size_t frames, bool writeOk);
+    bool decode_pcm(std::vector<int16_t>& dst, size_t minFrames, int64_t* firstTs);
+    void seek_crossfade(int64_t pts100ns);
+    void preload_loop();
+    bool next_item(PcmBlock* b, int64_t holdFrames);
+    bool back_to_item(uint32_t item);
+    void present_items();
+    void begin_loudness(const std::wstring& url);
+    void begin_seek_index(const std::wstring& url);
+    void wait_eos_drained();
+    void emit_event(const std::string& json);
+    void on_loudness(const std::wstring& url, const LoudnessInfo& info);
+    void apply_loudness_gain();
+    void on_seek_index(const std::wstring& url, std::shared_ptr<const SeekIndex> idx);
   bool build_video_session();      // создать сессию EVR по текущему url_ и hwnd_
     void destroy_video_session();    // освободить
     bool video_start();              // старт
     bool video_pause();              // пауза
     bool video_stop();               // стоп
-    bool video_seek_100ns(LONGLONG pos);
-    Microsoft::WRL::ComPtr<IMFSourceReader> reader_;
+    bool video_seek_100ns(int64_t pos);
+    // Аудио — через AudioDecoder (MF или miniaudio). Две стадии: поток
+    // декодера (decode_loop, владеет dec_) заполняет блоки из пула и кладёт
+    // в readyQ_, рабочий поток (worker_loop) отдаёт их движку и возвращает
+    // в freeQ_. Обе очереди lock-free SPSC, без аллокаций на блок.
+    std::unique_ptr<AudioDecoder> dec_;
+    std::atomic<const char*> decName_{"none"};
+    CachedPcmDecoder* pcmCache_ = nullptr;   // dec_, если он с дисковым кэшем; только поток декодера
+    // снимок кэша для status_json: декодер меняется и разрушается в своём потоке
+    std::atomic<int> cachePct_{-1};
+    std::atomic<int> cacheServedPct_{-1};
+    std::vector<PcmBlock> pool_;
+    SpscQueue<PcmBlock*, 256> freeQ_;    // рабочий поток -> декодер
+    SpscQueue<PcmBlock*, 256> readyQ_;   // декодер -> рабочий поток
+    std::thread decTh_;
+    std::atomic<uint32_t>  decGen_{0};      // растёт на каждый seek
+    std::atomic<long long> decSeekTo_{0};   // позиция для нового поколения
+    std::mutex feedMtx_;                    // write() рабочего потока против flush при seek
+    uint32_t eosGen_ = ~0u;                 // рабочий поток: поколение, дошедшее до конца потока
+    // инструментирование стадий
+    std::atomic<int64_t>  queuedFrames_{0};
+    std::atomic<uint32_t> starved_{0};      // очередь опустела во время игры
+    std::atomic<float> decodeUsAvg_{0.0f}, decodeUsMax_{0.0f};
+    std::atomic<float> feedUsAvg_{0.0f}, feedUsMax_{0.0f};
+    // НОВОЕ: учёт копий PCM (декодер + кольца движка) и склейки блоков в writev()
+    std::atomic<uint64_t> decodedFrames_{0};
+    std::atomic<uint64_t> decCopyBytes_{0}, decCopyAvoided_{0};
+    std::atomic<uint64_t> feedWrites_{0}, feedSpans_{0};
+    uint64_t ringBytesAtOpen_ = 0;
     DualOutBridge* bridge_ = nullptr;
+#ifdef _WIN32
  std::unique_ptr<ComInit> com_;
     std::unique_ptr<MFInit>  mf_;
+#endif
     std::thread th_;
     std::atomic_bool stop_{false};
     std::atomic_bool paused_{true};
+    std::atomic_bool ended_{false};   // последний кадр реально проигран
+    std::function<void(const std::string&)> eventSink_;
 
     mutable std::mutex mtx_;
     std::condition_variable cv_;
 
-    // Текущий формат входа (после конверсии в PCM 16)
+    // Текущий формат входа (декодер отдаёт PCM 16)
     PcmDesc fmt_{48000,2,16};
-    GUID readerSubtype_{};
-    uint32_t readerBitsPerSample_{16};
-    uint32_t readerBytesPerFrame_{0};
-    bool convertFloatToS16_{false};
-    bool downmixIntToS16_{false};
-    std::vector<int16_t> scratch16_;
     std::chrono::steady_clock::time_point feedLogStart_{};
     uint64_t framesFedSinceLog_{0};
     uint64_t failedWritesSinceLog_{0};
 
+    // Seek с кроссфейдом: позицию забирает рабочий поток
+    std::atomic<long long> pendingSeek100ns_{-1};
+    std::atomic<long long> seekRequestNs_{0};
+    std::atomic<int> seekLatencyMs_{-1};
+    std::atomic<uint32_t> seekCount_{0};
+    // НОВОЕ: точность последнего seek (кадры): цель, первый отданный кадр,
+    // сколько выброшено до цели и сколько из них без конвертации (skip())
+    std::atomic<long long> seekTargetFrame_{-1}, seekFirstFrame_{-1};
+    std::atomic<long long> seekDiscarded_{0}, seekDiscardedFast_{0};
+    std::vector<int16_t> seekPreroll_;
+    int seekPrerollMs_{150};
+    int seekXfadeMs_{30};
+
+    // Watermarks для медленных источников (мс очереди движка)
+    int bufLowMs_{40};
+    int bufHighMs_{150};
+
+    // НОВОЕ: окно PCM вокруг позиции (владеет поток декодера); seek внутрь
+    // окна отдаётся из памяти, декодер не трогается
+    PcmWindow window_;
+    int winBehindMs_{10000};
+    int winAheadMs_{6000};
+    std::atomic<uint32_t>  winHits_{0}, winMisses_{0};
+    std::atomic<long long> winFrames_{0};
+
+    // НОВОЕ: плейлист. queue_ и next_ — под plMtx_: поток предзагрузки берёт
+    // url из очереди, открывает декодер и читает первый блок; поток декодера
+    // на конце текущего забирает next_ и продолжает им же поколение.
+    struct NextItem {
+        std::wstring url;
+        std::unique_ptr<AudioDecoder> dec;
+        std::vector<int16_t> head;     // первый блок (pre-roll)
+        size_t  headFrames = 0;
+        int64_t headPts = 0;
+        bool    opening = false;       // поток предзагрузки сейчас открывает url
+    };
+    struct ItemInfo {
+        std::wstring url;
+        long long dur100ns = 0;
+    };
+    mutable std::mutex plMtx_;
+    std::condition_variable plCv_;
+    std::deque<std::wstring> queue_;
+    NextItem next_;
+    std::vector<ItemInfo> items_;          // по номеру элемента
+    uint32_t plGen_ = 0;                   // растёт на clear_queue(): открытое до него — выбросить
+    std::thread preTh_;
+    // поток декодера: текущий элемент и предыдущий (до того, как зазвучит
+    // следующий, — seek в нём возвращает декодер назад)
+    uint32_t decItem_ = 0;
+    std::wstring decUrl_;
+    std::unique_ptr<AudioDecoder> prevDec_;
+    uint32_t prevItem_ = 0;
+    std::wstring prevUrl_;
+    // рабочий поток: границы элементов на ленте движка, ещё не прозвучавшие
+    struct ItemMark {
+        uint32_t gen, item;
+        uint32_t xfade;                   // переход в него, кадры (0 — встык)
+        DualOutCursor at;
+    };
+    std::deque<ItemMark> marks_;
+    uint32_t feedItem_ = 0;
+    std::atomic<uint32_t> playItem_{0};     // элемент, который сейчас звучит
+    std::atomic<uint32_t> seekItem_{0};     // к какому элементу относится seek
+    std::atomic<uint32_t> itemSwitches_{0};
+
+    // НОВОЕ: кроссфейд между элементами (владеет поток декодера). Tail — хвост
+    // текущего элемента копится до его конца, чтобы точно знать длину
+    // перехода; Mix — начало следующего сводится с хвостом; Drain — следующего
+    // нет, хвост уходит как есть.
+    enum class XfPhase { None, Tail, Mix, Drain };
+    bool xfade_begin(PcmBlock* b);   // true — b ушёл в хвост, переход начался
+    void xfade_block(PcmBlock* b);
+    void xfade_mix(PcmBlock* b);
+    std::atomic<int> xfadeMs_{0};
+    XfPhase xfPhase_ = XfPhase::None;
+    std::vector<int16_t> xfTail_;    // кадры [xfTailOff_, xfTailOff_ + xfTailN_)
+    size_t  xfTailOff_ = 0, xfTailN_ = 0;
+    int64_t xfTailAt_ = 0;           // кадр хвоста по pts текущего элемента
+    bool    xfTailEos_ = false;
+    size_t  xfFrames_ = 0;           // длина перехода, заказанная при входе в хвост
+    size_t  xfLen_ = 0, xfPos_ = 0;  // фактическая длина и сколько уже сведено
+    int64_t xfInAt_ = 0;             // кадр следующего элемента в начале перехода
+    std::vector<float> xfGainOut_, xfGainIn_;
+    std::atomic<uint32_t> xfadeCount_{0};
+
     // Позиция и длительность (100-нс и мс)
     std::atomic<long long> last_pts_100ns_{0};
-    long long duration_100ns_{0};
+    std::atomic<long long> duration_100ns_{0};
     std::wstring url_;
     std::atomic<bool> opened_{false};\
-        // --- видео (EVR + Media Session)
+        // --- видео (EVR + Media Session), только Windows
+#ifdef _WIN32
     HWND hwnd_{nullptr};
     Microsoft::WRL::ComPtr<IMFMediaSession> vSession_;
     Microsoft::WRL::ComPtr<IMFMediaSource>  vSource_;
+#endif
       bool videoReady_{false};
     long lastHr_{0};
     std::string lastErr_;
+
+    // Нормализация громкости: скан в фоне, результат — в trim движка.
+    mutable std::mutex loudMtx_;
+    std::wstring loudUrl_;          // для какого файла ждём результат
+    LoudnessInfo loudInfo_;
+    bool loudReady_{false};
+    bool loudAuto_{true};
+    float loudTarget_{-18.0f};
+    float loudGainDb_{0.0f};
+
+    // НОВОЕ: индекс seek (MF) — из кэша при open(), иначе строится в фоне и
+    // отдаётся декодеру его потоком между read()
+    mutable std::mutex seekIdxMtx_;
+    std::wstring seekIdxUrl_;
+    std::shared_ptr<const SeekIndex> seekIdx_;
+    std::atomic_bool seekIdxNew_{false};
+
+    // Фоновые сервисы — последними полями: разрушаются первыми (и ждут свои
+    // потоки), пока их колбэки ещё могут трогать поля выше.
+    LoudnessScanner loudness_;
+    SeekIndexService seekIndex_;
 };
@@ -0,0 +1,170 @@
+#include "seek_index.h"
+#include "media_cache.h"
+#ifdef _WIN32
+#include "mf_audio_reader.h"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+// Заголовок кэша; за ним count точек int64 (100 нс)
+struct SeekIndexFileHeader {
+  char     magic[4];   // "DOSI"
+  uint32_t version;
+  uint32_t preroll;
+  uint32_t reserved;
+  uint64_t count;
+};
+
+int64_t SeekIndex::seek_point(int64_t t) const{
+  if (pts.empty()) return -1;
+  // последний пакет, начавшийся не позже t, и ещё preroll назад
+  auto it = std::upper_bound(pts.begin(), pts.end(), t);
+  size_t i = it == pts.begin() ? 0 : (size_t)(it - pts.begin()) - 1;
+  i = i > preroll ? i - preroll : 0;
+  return pts[i];
+}
+
+SeekIndexService::SeekIndexService() = default;
+
+SeekIndexService::~SeekIndexService(){
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_.store(true);
+    queue_.clear();
+  }
+  cv_.notify_all();
+  if (th_.joinable()) th_.join();
+}
+
+void SeekIndexService::set_done(DoneFn fn){
+  std::lock_guard<std::mutex> lk(mtx_);
+  done_ = std::move(fn);
+}
+
+std::shared_ptr<const SeekIndex> SeekIndexService::lookup(const std::wstring& path){
+  FileIdentity id;
+  if (!file_identity(path, id)) return nullptr;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = ready_.find(path);
+    if (it != ready_.end()) return it->second;
+  }
+  auto idx = std::make_shared<SeekIndex>();
+  if (!load(cache_file_name(path, id, L".sidx"), *idx)) return nullptr;
+  std::lock_guard<std::mutex> lk(mtx_);
+  ready_[path] = idx;
+  return idx;
+}
+
+void SeekIndexService::request(const std::wstring& path){
+  FileIdentity id;
+  if (!file_identity(path, id)) return;   // не файл (поток) — не индексируем
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    if (path == current_) return;
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), path), queue_.end());
+    queue_.push_front(path);              // открытый сейчас файл — первым
+    if (!th_.joinable()) th_ = std::thread(&SeekIndexService::worker_loop, this);
+  }
+  cv_.notify_one();
+}
+
+bool SeekIndexService::busy(const std::wstring& path) const{
+  std::lock_guard<std::mutex> lk(mtx_);
+  return path == current_ || std::find(queue_.begin(), queue_.end(), path) != queue_.end();
+}
+
+void SeekIndexService::worker_loop(){
+  // фоновый режим: ниже приоритет CPU и I/O, чем у воспроизведения
+  set_background_priority(true);
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (!stop_.load()) {
+    cv_.wait(lk, [this]{ return stop_.load() || !queue_.empty(); });
+    if (stop_.load()) break;
+    const std::wstring path = queue_.front();
+    queue_.pop_front();
+    current_ = path;
+    lk.unlock();
+
+    FileIdentity id;
+    auto idx = std::make_shared<SeekIndex>();
+    bool ok = file_identity(path, id);
+    if (ok) {
+      const auto t0 = std::chrono::steady_clock::now();
+#ifdef _WIN32
+      ok = mf_build_seek_index(path, *idx, stop_);
+#else
+      ok = false;
+#endif
+      idx->buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+    if (ok && !idx->pts.empty()) {
+      save(cache_file_name(path, id, L".sidx"), *idx);
+      std::cerr << "[SeekIndex] " << idx->pts.size() << " points, preroll=" << idx->preroll
+                << " in " << idx->buildSeconds << " s" << std::endl;
+    } else {
+      ok = false;
+    }
+
+    lk.lock();
+    current_.clear();
+    if (!ok) continue;
+    ready_[path] = idx;
+    DoneFn done = done_;
+    lk.unlock();
+    if (done) done(path, idx);
+    lk.lock();
+  }
+  set_background_priority(false);
+}
+
+bool SeekIndexService::save(const std::wstring& file, const SeekIndex& idx){
+  SeekIndexFileHeader h{};
+  std::memcpy(h.magic, "DOSI", 4);
+  h.version = 1;
+  h.preroll = idx.preroll;
+  h.count   = idx.pts.size();
+
+  // пишем во временный файл и подменяем — недописанный кэш не прочитается
+  const std::filesystem::path dst(file), tmp(file + L".tmp");
+  {
+    std::ofstream f{tmp, std::ios::binary | std::ios::trunc};
+    if (!f) return false;
+    f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    f.write(reinterpret_cast<const char*>(idx.pts.data()), idx.pts.size() * sizeof(int64_t));
+    if (!f) return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, dst, ec);
+  if (ec) {
+    std::cerr << "[SeekIndex] cache write failed: " << ec.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool SeekIndexService::load(const std::wstring& file, SeekIndex& idx){
+  std::ifstream f{std::filesystem::path(file), std::ios::binary};
+  if (!f) return false;
+  SeekIndexFileHeader h{};
+  if (!f.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+  if (std::memcmp(h.magic, "DOSI", 4) != 0 || h.version != 1 || h.count == 0 || h.count > (1ull << 28)) {
+    return false;
+  }
+  idx.pts.resize((size_t)h.count);
+  if (!f.read(reinterpret_cast<char*>(idx.pts.data()), idx.pts.size() * sizeof(int64_t))) {
+    idx.pts.clear();
+    return false;
+  }
+  if (!std::is_sorted(idx.pts.begin(), idx.pts.end())) {
+    idx.pts.clear();
+    return false;
+  }
+  idx.preroll = h.preroll;
+  idx.buildSeconds = 0.0;
+  return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+// Индекс seek по файлу: начала пакетов сжатого потока — точки, в которые
+// источник встаёт точно, — и сколько пакетов перед целью декодеру нужно на
+// прогрев (перекрытие MDCT у AAC/MP3). Seek идёт в ближайшую точку не позже
+// цели минус прогрев, остаток до цели декодер пропускает.
+struct SeekIndex {
+  std::vector<int64_t> pts;     // 100 нс, по возрастанию
+  uint32_t preroll = 0;         // пакетов прогрева
+  double   buildSeconds = 0.0;  // сколько строился (0 — из кэша)
+
+  // Куда ставить источник для цели t; -1 — индекс пуст
+  int64_t seek_point(int64_t t) const;
+};
+
+// Фоновое построение индекса (только демультиплексор, без декодирования) в
+// потоке с фоновым приоритетом, как у скана громкости. Готовые индексы —
+// в %LOCALAPPDATA%\DualOut\<hash>.sidx. Без Media Foundation строить нечего:
+// miniaudio ищет с точностью до кадра сам.
+class SeekIndexService {
+public:
+  using DoneFn = std::function<void(const std::wstring& path, std::shared_ptr<const SeekIndex> idx)>;
+
+  SeekIndexService();
+  ~SeekIndexService();
+
+  std::shared_ptr<const SeekIndex> lookup(const std::wstring& path);  // память или файл кэша
+  void request(const std::wstring& path);   // встаёт в начало очереди
+  void set_done(DoneFn fn);                 // зовётся из потока построения
+  bool busy(const std::wstring& path) const;
+
+private:
+  void worker_loop();
+  bool load(const std::wstring& file, SeekIndex& idx);
+  bool save(const std::wstring& file, const SeekIndex& idx);
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::wstring> queue_;
+  std::wstring current_;
+  std::map<std::wstring, std::shared_ptr<const SeekIndex>> ready_;
+  DoneFn done_;
+  std::thread th_;
+  std::atomic_bool stop_{false};
+};
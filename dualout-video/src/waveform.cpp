@@ -0,0 +1,329 @@
+#include "waveform.h"
+#include "media_cache.h"
+#include "audio_decoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static constexpr size_t kReadFrames = 4096;   // кадров за read()
+
+// Заголовок кэша; за ним уровни подряд, пары min,max int16
+struct WaveformFileHeader {
+  char     magic[4];         // "DOWF"
+  uint32_t version;
+  uint32_t sr;
+  uint32_t baseFrames;
+  uint32_t factor;
+  uint32_t levels;
+  uint64_t totalFrames;
+  uint64_t bins[6];
+};
+
+WaveformService::WaveformService() = default;
+
+WaveformService::~WaveformService(){
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    stop_.store(true);
+    queue_.clear();
+  }
+  cv_.notify_all();
+  if (th_.joinable()) th_.join();
+}
+
+void WaveformService::set_progress(ProgressFn fn){
+  std::lock_guard<std::mutex> lk(mtx_);
+  progress_ = std::move(fn);
+}
+
+void WaveformService::set_error(ErrorFn fn){
+  std::lock_guard<std::mutex> lk(mtx_);
+  error_ = std::move(fn);
+}
+
+bool WaveformService::ensure(const std::wstring& path){
+  FileIdentity id;
+  if (!file_identity(path, id)) return false;
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = pyramids_.find(path);
+  if (it != pyramids_.end()) {
+    std::lock_guard<std::mutex> plk(it->second->mtx);
+    if (!it->second->failed) return true;
+    // тот же файл уже не построился — не перезапускаем на каждый запрос
+    if (it->second->id.size == id.size && it->second->id.mtime == id.mtime) return false;
+  }
+  if (it != pyramids_.end()) pyramids_.erase(it);
+
+  // держим немного файлов: старые пирамиды (готовые или неудачные) выбрасываем
+  while (pyramids_.size() >= 4) {
+    auto victim = std::find_if(pyramids_.begin(), pyramids_.end(), [](auto& kv){
+      std::lock_guard<std::mutex> plk(kv.second->mtx);
+      return kv.second->complete || kv.second->failed;
+    });
+    if (victim == pyramids_.end()) break;
+    pyramids_.erase(victim);
+  }
+
+  auto pyr = std::make_shared<Pyramid>();
+  pyr->id = id;
+  pyramids_[path] = pyr;
+  if (load(cache_file_name(path, id, L".wfm"), *pyr)) return true;
+
+  queue_.push_back(path);
+  if (!th_.joinable()) th_ = std::thread(&WaveformService::worker_loop, this);
+  cv_.notify_one();
+  return true;
+}
+
+bool WaveformService::failed(const std::wstring& path){
+  std::lock_guard<std::mutex> lk(mtx_);
+  auto it = pyramids_.find(path);
+  if (it == pyramids_.end()) return false;
+  std::lock_guard<std::mutex> plk(it->second->mtx);
+  return it->second->failed;
+}
+
+void WaveformService::worker_loop(){
+  set_background_priority(true);
+  std::unique_lock<std::mutex> lk(mtx_);
+  while (!stop_.load()) {
+    cv_.wait(lk, [this]{ return stop_.load() || !queue_.empty(); });
+    if (stop_.load()) break;
+    const std::wstring path = queue_.front();
+    queue_.pop_front();
+    auto it = pyramids_.find(path);
+    if (it == pyramids_.end()) continue;   // уже выброшена
+    std::shared_ptr<Pyramid> pyr = it->second;
+    lk.unlock();
+
+    FileIdentity id;
+    if (file_identity(path, id) && build(path, *pyr)) {
+      save(cache_file_name(path, id, L".wfm"), *pyr);
+    } else if (!stop_.load()) {
+      // недостроенное не держим: память освобождаем, ensure() ответит false
+      {
+        std::lock_guard<std::mutex> plk(pyr->mtx);
+        pyr->failed = true;
+        pyr->builtFrames = 0;
+        for (auto& l : pyr->level) std::vector<int16_t>().swap(l);
+      }
+      ErrorFn cb;
+      { std::lock_guard<std::mutex> elk(mtx_); cb = error_; }
+      std::cerr << "[Waveform] build failed" << std::endl;
+      if (cb) cb(path);
+    }
+    lk.lock();
+  }
+  set_background_priority(false);
+}
+
+bool WaveformService::build(const std::wstring& path, Pyramid& pyr){
+  std::unique_ptr<AudioDecoder> src = open_audio_decoder(path, 48000, 2);
+  if (!src) {
+    std::cerr << "[Waveform] open failed" << std::endl;
+    return false;
+  }
+  const PcmDesc fmt = src->format();
+  const int64_t dur = src->duration_100ns();
+  {
+    std::lock_guard<std::mutex> lk(pyr.mtx);
+    pyr.sr = fmt.sr;
+    pyr.totalFrames = dur > 0 ? (uint64_t)(dur * fmt.sr / 10000000) : 0;
+    uint64_t binFrames = kBaseFrames;
+    for (uint32_t l = 0; l < kLevels; ++l, binFrames *= kFactor) {
+      pyr.level[l].reserve((size_t)(pyr.totalFrames / binFrames + 1) * 2);
+    }
+  }
+
+  // бины уровней копим локально и отдаём пачкой под мьютексом
+  int16_t curMin = INT16_MAX, curMax = INT16_MIN;
+  uint32_t inBin = 0;
+  int16_t accMin[kLevels], accMax[kLevels];
+  uint32_t accN[kLevels] = {};
+  for (uint32_t l = 0; l < kLevels; ++l) { accMin[l] = INT16_MAX; accMax[l] = INT16_MIN; }
+  std::vector<int16_t> pending[kLevels];
+  uint64_t frames = 0;
+  int lastPct = -1;
+
+  auto push_bin = [&](uint32_t l, int16_t mn, int16_t mx){
+    for (;;) {
+      pending[l].push_back(mn);
+      pending[l].push_back(mx);
+      if (l + 1 >= kLevels) return;
+      accMin[l + 1] = std::min(accMin[l + 1], mn);
+      accMax[l + 1] = std::max(accMax[l + 1], mx);
+      if (++accN[l + 1] < kFactor) return;
+      mn = accMin[l + 1]; mx = accMax[l + 1];
+      accMin[l + 1] = INT16_MAX; accMax[l + 1] = INT16_MIN; accN[l + 1] = 0;
+      ++l;
+    }
+  };
+  auto flush = [&](bool done){
+    std::lock_guard<std::mutex> lk(pyr.mtx);
+    for (uint32_t l = 0; l < kLevels; ++l) {
+      pyr.level[l].insert(pyr.level[l].end(), pending[l].begin(), pending[l].end());
+      pending[l].clear();
+    }
+    pyr.builtFrames = frames;
+    if (done) {
+      pyr.totalFrames = frames;
+      pyr.complete = true;
+    }
+  };
+
+  std::vector<int16_t> buf((size_t)kReadFrames * fmt.ch);
+  const int16_t* data = buf.data();
+  int64_t pts = 0;
+  while (!stop_.load()) {
+    const size_t n = src->read(buf.data(), kReadFrames, &pts);
+    if (n == 0) break;
+    for (size_t i = 0; i < n; ++i) {
+      const int16_t* f = data + i * fmt.ch;
+      for (uint32_t c = 0; c < fmt.ch; ++c) {
+        curMin = std::min(curMin, f[c]);
+        curMax = std::max(curMax, f[c]);
+      }
+      if (++inBin == kBaseFrames) {
+        push_bin(0, curMin, curMax);
+        curMin = INT16_MAX; curMax = INT16_MIN; inBin = 0;
+      }
+    }
+    frames += n;
+    if (pending[0].size() >= 2048) flush(false);
+
+    const int pct = pyr.totalFrames ? (int)std::min<uint64_t>(99, frames * 100 / pyr.totalFrames) : 0;
+    if (pct >= lastPct + 2) {
+      lastPct = pct;
+      ProgressFn cb;
+      { std::lock_guard<std::mutex> lk(mtx_); cb = progress_; }
+      if (cb) cb(path, pct);
+    }
+  }
+  if (stop_.load() || src->failed()) return false;
+
+  // хвосты: неполный базовый бин и неполные бины верхних уровней
+  if (inBin) push_bin(0, curMin, curMax);
+  for (uint32_t l = 1; l < kLevels; ++l) {
+    if (accN[l]) {
+      pending[l].push_back(accMin[l]);
+      pending[l].push_back(accMax[l]);
+      accN[l] = 0;
+      if (l + 1 < kLevels) {
+        accMin[l + 1] = std::min(accMin[l + 1], accMin[l]);
+        accMax[l + 1] = std::max(accMax[l + 1], accMax[l]);
+        ++accN[l + 1];
+      }
+    }
+  }
+  flush(true);
+
+  ProgressFn cb;
+  { std::lock_guard<std::mutex> lk(mtx_); cb = progress_; }
+  if (cb) cb(path, 100);
+  return true;
+}
+
+bool WaveformService::save(const std::wstring& file, Pyramid& pyr){
+  std::lock_guard<std::mutex> lk(pyr.mtx);
+  WaveformFileHeader h{};
+  std::memcpy(h.magic, "DOWF", 4);
+  h.version     = 1;
+  h.sr          = pyr.sr;
+  h.baseFrames  = kBaseFrames;
+  h.factor      = kFactor;
+  h.levels      = kLevels;
+  h.totalFrames = pyr.totalFrames;
+  for (uint32_t l = 0; l < kLevels; ++l) h.bins[l] = pyr.level[l].size() / 2;
+
+  // пишем во временный файл и подменяем — недописанный кэш не прочитается
+  const std::filesystem::path dst(file), tmp(file + L".tmp");
+  {
+    std::ofstream f{tmp, std::ios::binary | std::ios::trunc};
+    if (!f) return false;
+    f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    for (uint32_t l = 0; l < kLevels; ++l) {
+      f.write(reinterpret_cast<const char*>(pyr.level[l].data()), pyr.level[l].size() * sizeof(int16_t));
+    }
+    if (!f) return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, dst, ec);
+  if (ec) {
+    std::cerr << "[Waveform] cache write failed: " << ec.message() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool WaveformService::load(const std::wstring& file, Pyramid& pyr){
+  std::ifstream f{std::filesystem::path(file), std::ios::binary};
+  if (!f) return false;
+  WaveformFileHeader h{};
+  if (!f.read(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+  if (std::memcmp(h.magic, "DOWF", 4) != 0 || h.version != 1 || h.baseFrames != kBaseFrames ||
+      h.factor != kFactor || h.levels != kLevels || h.sr == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lk(pyr.mtx);
+  for (uint32_t l = 0; l < kLevels; ++l) {
+    if (h.bins[l] > (1ull << 32)) return false;
+    pyr.level[l].resize((size_t)h.bins[l] * 2);
+    if (!f.read(reinterpret_cast<char*>(pyr.level[l].data()), pyr.level[l].size() * sizeof(int16_t))) {
+      for (auto& v : pyr.level) v.clear();
+      return false;
+    }
+  }
+  pyr.sr = h.sr;
+  pyr.totalFrames = pyr.builtFrames = h.totalFrames;
+  pyr.complete = true;
+  return true;
+}
+
+bool WaveformService::slice(const std::wstring& path, int64_t startMs, int64_t endMs, uint32_t points, WaveformSlice& out){
+  std::shared_ptr<Pyramid> pyr;
+  {
+    std::lock_guard<std::mutex> lk(mtx_);
+    auto it = pyramids_.find(path);
+    if (it == pyramids_.end()) return false;
+    pyr = it->second;
+  }
+  if (points == 0 || endMs <= startMs) return false;
+
+  std::lock_guard<std::mutex> lk(pyr->mtx);
+  const double f0  = (double)std::max<int64_t>(0, startMs) * pyr->sr / 1000.0;
+  const double f1  = (double)endMs * pyr->sr / 1000.0;
+  const double fpp = (f1 - f0) / points;
+
+  // самый грубый уровень, у которого бин не крупнее точки
+  uint32_t lvl = 0;
+  uint64_t binFrames = kBaseFrames;
+  while (lvl + 1 < kLevels && binFrames * kFactor <= fpp) {
+    binFrames *= kFactor;
+    ++lvl;
+  }
+  const std::vector<int16_t>& bins = pyr->level[lvl];
+  const uint64_t have = bins.size() / 2;
+
+  out.mins.assign(points, 0);
+  out.maxs.assign(points, 0);
+  out.framesPerBin = (uint32_t)binFrames;
+  out.complete = pyr->complete;
+  out.pct = pyr->complete ? 100 : (pyr->totalFrames ? (int)std::min<uint64_t>(99, pyr->builtFrames * 100 / pyr->totalFrames) : 0);
+  for (uint32_t p = 0; p < points; ++p) {
+    const uint64_t b0 = (uint64_t)((f0 + p * fpp) / binFrames);
+    const uint64_t b1 = std::max<uint64_t>(b0 + 1, (uint64_t)std::ceil((f0 + (p + 1) * fpp) / binFrames));
+    int16_t mn = INT16_MAX, mx = INT16_MIN;
+    for (uint64_t b = b0; b < b1 && b < have; ++b) {
+      mn = std::min(mn, bins[b * 2]);
+      mx = std::max(mx, bins[b * 2 + 1]);
+    }
+    if (mn <= mx) {
+      out.mins[p] = mn;
+      out.maxs[p] = mx;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include "media_cache.h"
+
+// Кусок waveform для отрисовки: min/max на точку (s16, по всем каналам)
+struct WaveformSlice {
+  std::vector<int16_t> mins, maxs;
+  uint32_t framesPerBin = 0;   // уровень пирамиды, из которого собран кусок
+  int      pct = 0;            // сколько файла уже построено
+  bool     complete = false;
+};
+
+// Пирамида min/max пиков: базовый уровень — 256 кадров на бин, каждый
+// следующий крупнее в 4 раза. Строится в фоне своим декодером (open_audio_decoder),
+// готовая пирамида пишется в компактный бинарный кэш рядом с кэшем
+// громкости (%LOCALAPPDATA%\DualOut\<hash>.wfm) и при следующем открытии
+// читается целиком без декодирования.
+class WaveformService {
+public:
+  using ProgressFn = std::function<void(const std::wstring& path, int pct)>;
+  using ErrorFn    = std::function<void(const std::wstring& path)>;
+
+  WaveformService();
+  ~WaveformService();
+
+  void set_progress(ProgressFn fn);           // зовётся из потока построения
+  void set_error(ErrorFn fn);                 // построение не удалось (поток построения)
+  // кэш или фоновое построение; false — не файл или этот же файл не построился
+  // (failed()). Изменившийся файл строится заново.
+  bool ensure(const std::wstring& path);
+  bool failed(const std::wstring& path);
+  // [startMs, endMs) в points точек; отдаёт уже построенную часть
+  bool slice(const std::wstring& path, int64_t startMs, int64_t endMs, uint32_t points, WaveformSlice& out);
+
+private:
+  static constexpr uint32_t kBaseFrames = 256;
+  static constexpr uint32_t kFactor     = 4;
+  static constexpr uint32_t kLevels     = 6;
+
+  struct Pyramid {
+    std::mutex mtx;
+    uint32_t sr = 48000;
+    uint64_t totalFrames = 0;      // оценка по длительности, после построения — точно
+    uint64_t builtFrames = 0;
+    bool complete = false;
+    bool failed = false;           // декодер не открылся или упал: данных нет
+    FileIdentity id;               // файл, из которого строим
+    std::vector<int16_t> level[kLevels];   // пары min,max
+  };
+
+  void worker_loop();
+  bool build(const std::wstring& path, Pyramid& pyr);
+  bool load(const std::wstring& file, Pyramid& pyr);
+  bool save(const std::wstring& file, Pyramid& pyr);
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::map<std::wstring, std::shared_ptr<Pyramid>> pyramids_;
+  std::deque<std::wstring> queue_;
+  ProgressFn progress_;
+  ErrorFn error_;
+  std::thread th_;
+  std::atomic_bool stop_{false};
+};
@@ -0,0 +1,87 @@
+// Лимитер: скользящий минимум против перебора по окну и true-peak на
+// выходе при усилении низкочастотного синуса.
+#include "Limiter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+static int g_fail = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { std::printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+    std::printf(__VA_ARGS__); std::printf("\n"); ++g_fail; } } while (0)
+
+static uint32_t xorshift32(uint32_t& s) { s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+
+// SlidingMin против минимума по последним win значениям
+static void check_sliding_min(const char* name, const std::vector<float>& v, uint32_t win)
+{
+    SlidingMin sm;
+    sm.reset(win);
+    for (size_t t = 0; t < v.size(); ++t) {
+        const float got = sm.push(v[t]);
+        float want = v[t];
+        for (size_t k = t + 1 > win ? t + 1 - win : 0; k <= t; ++k) want = std::min(want, v[k]);
+        if (got != want) {
+            CHECK(false, "%s win=%u t=%zu: min %.4f, перебор %.4f", name, win, t, got, want);
+            return;
+        }
+    }
+}
+
+static void test_sliding_min()
+{
+    for (uint32_t win : { 1u, 2u, 50u }) {
+        std::vector<float> rising(400), falling(400), noise(4000), saw(4000);
+        uint32_t r = 1;
+        for (size_t i = 0; i < rising.size(); ++i) {
+            rising[i]  = 0.2f + 0.002f * (float)i;   // растёт каждый шаг — очередь полная
+            falling[i] = 1.0f - 0.002f * (float)i;
+        }
+        for (size_t i = 0; i < noise.size(); ++i) {
+            noise[i] = (float)(xorshift32(r) % 1000) / 1000.0f;
+            saw[i]   = (float)(i % 137) / 137.0f;
+        }
+        check_sliding_min("rising", rising, win);
+        check_sliding_min("falling", falling, win);
+        check_sliding_min("noise", noise, win);
+        check_sliding_min("saw", saw, win);
+    }
+}
+
+// 100 Гц на +6 dBFS: длинные монотонные участки требуемого усиления
+static void test_low_freq_boost()
+{
+    const uint32_t sr = 48000, ch = 2;
+    const float ceiling = 0.891f * 32768.0f;   // -1 dBTP
+    Limiter lim;
+    lim.reset(sr, ch);
+    const uint32_t total = sr;   // 1 с
+    std::vector<float> blk((size_t)Limiter::kMaxBlock * ch);
+    float outPeak = 0.0f;
+    for (uint32_t done = 0; done < total; done += Limiter::kMaxBlock) {
+        for (uint32_t i = 0; i < Limiter::kMaxBlock; ++i) {
+            const float v = 2.0f * 32767.0f * std::sin(2.0f * 3.14159265f * 100.0f * (float)(done + i) / (float)sr);
+            blk[(size_t)i * ch] = blk[(size_t)i * ch + 1] = v;
+        }
+        lim.process(blk.data(), Limiter::kMaxBlock, true, ceiling);
+        if (done >= lim.latency()) {
+            for (float s : blk) outPeak = std::max(outPeak, std::fabs(s));
+        }
+    }
+    // сэмпловый пик не выше true-peak: потолок с запасом на округление float
+    CHECK(outPeak <= ceiling * 1.001f, "100 Гц +6 dBFS: пик %.1f выше потолка %.1f", outPeak, ceiling);
+}
+
+int main()
+{
+    test_sliding_min();
+    test_low_freq_boost();
+    if (g_fail) {
+        std::printf("limiter_test: %d FAIL\n", g_fail);
+        return 1;
+    }
+    std::printf("limiter_test: ok\n");
+    return 0;
+}
@@ -0,0 +1,202 @@
+// Ядра конверсии и сведения PCM: SIMD против скалярного эталона на всех
+// уровнях, которые есть на этом CPU, плюс крайние случаи — нечётные длины,
+// невыровненные хвосты, насыщение на ±1.0 и на краях s32.
+#include "pcm_convert.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+static int g_fail = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { std::printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+    std::printf(__VA_ARGS__); std::printf("\n"); ++g_fail; } } while (0)
+
+static uint32_t xorshift32(uint32_t& s) { s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+
+static size_t sample_size(PcmFormat f)
+{
+    switch (f) {
+    case PcmFormat::S16: return 2;
+    case PcmFormat::S24: return 3;
+    default:             return 4;
+    }
+}
+
+static const char* format_name(PcmFormat f)
+{
+    switch (f) {
+    case PcmFormat::S16: return "s16";
+    case PcmFormat::S24: return "s24";
+    case PcmFormat::S32: return "s32";
+    default:             return "f32";
+    }
+}
+
+// Тот же прогон, что команда pcm_selftest: бит в бит, дизер, обратная конверсия, mix2
+static void test_selftest()
+{
+    for (size_t n : { 64u, 1001u, 65537u }) {
+        const std::string js = pcm_selftest_json(n);
+        CHECK(js.size() > 10 && js.compare(js.size() - 10, 10, "\"ok\":true}") == 0,
+              "pcm_selftest(%zu): %s", n, js.c_str());
+    }
+}
+
+// Источник с крайними значениями: ±1.0, чуть за ним, далеко за ним, края s32
+static std::vector<uint8_t> make_source(PcmFormat fmt, size_t n, uint32_t seed)
+{
+    static const float kF32Edges[] = { 1.0f, -1.0f, 1.0000001f, -1.0000001f, 2.0f, -2.0f,
+                                       0.99998f, -0.99998f, 0.0f, -0.0f, 1e-6f, 1000.0f, -1000.0f };
+    static const int32_t kS32Edges[] = { INT32_MAX, INT32_MIN, INT32_MAX - 0x7FFF, INT32_MIN + 1,
+                                         0x7FFF8000, -0x7FFF8000, 0x8000, -0x8000, 0 };
+    std::vector<uint8_t> v(n * sample_size(fmt) + 1);   // +1: источник сдвигаем на байт
+    uint32_t r = seed;
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t* p = v.data() + 1 + i * sample_size(fmt);
+        const uint32_t pick = xorshift32(r);
+        if (fmt == PcmFormat::F32) {
+            float f = (pick & 3) ? kF32Edges[pick % (sizeof(kF32Edges) / sizeof(kF32Edges[0]))]
+                                 : ((int32_t)xorshift32(r) >> 8) * (1.2f / 8388608.0f);
+            std::memcpy(p, &f, 4);
+        } else {
+            int32_t x = (pick & 3) ? kS32Edges[pick % (sizeof(kS32Edges) / sizeof(kS32Edges[0]))]
+                                   : (int32_t)xorshift32(r);
+            std::memcpy(p, &x, sample_size(fmt));   // s24 — младшие 3 байта, s16 — 2
+        }
+    }
+    return v;
+}
+
+// to_s16 / from_s16: длины 0..67 и покрупнее, источник и приёмник не выровнены
+static void test_convert_edges()
+{
+    const PcmSimd top = pcm_simd_level();
+    for (PcmFormat fmt : { PcmFormat::S16, PcmFormat::S24, PcmFormat::S32, PcmFormat::F32 }) {
+        for (size_t n = 0; n < 300; n += (n < 67 ? 1 : 37)) {
+            const std::vector<uint8_t> src = make_source(fmt, n, 0x1234u + (uint32_t)n);
+            const void* s = src.data() + 1;
+            std::vector<int16_t> ref(n + 1), out(n + 1);
+            pcm_to_s16(ref.data() + 1, s, fmt, n, nullptr, PcmSimd::Scalar);
+            for (int lv = (int)PcmSimd::Sse2; lv <= (int)top; ++lv) {
+                std::fill(out.begin(), out.end(), (int16_t)0x5A5A);
+                pcm_to_s16(out.data() + 1, s, fmt, n, nullptr, (PcmSimd)lv);
+                for (size_t i = 0; i < n; ++i) {
+                    if (out[i + 1] != ref[i + 1]) {
+                        CHECK(false, "to_s16 %s %s n=%zu i=%zu: %d, эталон %d", pcm_simd_name((PcmSimd)lv),
+                              format_name(fmt), n, i, out[i + 1], ref[i + 1]);
+                        break;
+                    }
+                }
+                CHECK(out[0] == (int16_t)0x5A5A, "to_s16 %s %s n=%zu: запись до начала приёмника",
+                      pcm_simd_name((PcmSimd)lv), format_name(fmt), n);
+
+                // с дизером — не дальше 1 LSB от округлённого
+                PcmDither dit;
+                pcm_to_s16(out.data() + 1, s, fmt, n, &dit, (PcmSimd)lv);
+                for (size_t i = 0; i < n; ++i) {
+                    if (std::abs(out[i + 1] - ref[i + 1]) > 1) {
+                        CHECK(false, "to_s16 dither %s %s n=%zu i=%zu: %d, без дизера %d",
+                              pcm_simd_name((PcmSimd)lv), format_name(fmt), n, i, out[i + 1], ref[i + 1]);
+                        break;
+                    }
+                }
+            }
+
+            // обратно: из невыровненного s16 в невыровненный приёмник
+            const size_t wb = n * sample_size(fmt);
+            std::vector<uint8_t> refW(wb + 2, 0xA5), outW(wb + 2, 0xA5);
+            pcm_from_s16(refW.data() + 1, fmt, ref.data() + 1, n, PcmSimd::Scalar);
+            for (int lv = (int)PcmSimd::Sse2; lv <= (int)top; ++lv) {
+                std::fill(outW.begin(), outW.end(), (uint8_t)0xA5);
+                pcm_from_s16(outW.data() + 1, fmt, ref.data() + 1, n, (PcmSimd)lv);
+                CHECK(std::memcmp(refW.data(), outW.data(), wb + 2) == 0, "from_s16 %s %s n=%zu",
+                      pcm_simd_name((PcmSimd)lv), format_name(fmt), n);
+            }
+        }
+    }
+}
+
+// ±1.0 и за ним: значения эталона, а не только совпадение уровней
+static void test_f32_clipping()
+{
+    const float in[]      = { 1.0f, -1.0f, 1.5f, -1.5f, 2.0f, -2.0f, 0.5f, -0.5f, 1.0000001f };
+    const int16_t want[]  = { 32767, -32767, 32767, -32768, 32767, -32768, 16384, -16384, 32767 };
+    const size_t n = sizeof(in) / sizeof(in[0]);
+    for (int lv = (int)PcmSimd::Scalar; lv <= (int)pcm_simd_level(); ++lv) {
+        // повторяем, чтобы значения попали и в SIMD-часть, и в хвост
+        std::vector<float> src;
+        for (int k = 0; k < 5; ++k) src.insert(src.end(), in, in + n);
+        std::vector<int16_t> out(src.size());
+        pcm_to_s16(out.data(), src.data(), PcmFormat::F32, src.size(), nullptr, (PcmSimd)lv);
+        for (size_t i = 0; i < src.size(); ++i) {
+            CHECK(out[i] == want[i % n], "f32 %s: %.7f -> %d, ждали %d", pcm_simd_name((PcmSimd)lv),
+                  src[i], out[i], want[i % n]);
+        }
+    }
+}
+
+// mix2: 1..3 канала, нечётные длины, насыщение при сумме двух полных шкал
+static void test_mix_edges()
+{
+    const PcmSimd top = pcm_simd_level();
+    uint32_t r = 77;
+    for (uint32_t ch = 1; ch <= 3; ++ch) {
+        for (size_t frames = 0; frames < 80; ++frames) {
+            const size_t n = frames * ch;
+            std::vector<int16_t> a(n + 1), b(n + 1), ref(n + 1), out(n + 1);
+            std::vector<float> ga(frames + 1), gb(frames + 1);
+            for (size_t i = 0; i < n + 1; ++i) {
+                const uint32_t x = xorshift32(r);
+                a[i] = (x & 1) ? (int16_t)((x & 2) ? 32767 : -32768) : (int16_t)(x >> 16);
+                b[i] = (int16_t)xorshift32(r);
+            }
+            for (size_t i = 0; i < frames + 1; ++i) {
+                ga[i] = (i % 3 == 0) ? 1.0f : (float)(xorshift32(r) % 1000) / 999.0f;
+                gb[i] = (i % 5 == 0) ? 1.0f : (float)(xorshift32(r) % 1000) / 999.0f;
+            }
+            // всё со сдвигом на элемент: SIMD идёт по невыровненной памяти
+            pcm_mix2_s16(ref.data() + 1, a.data() + 1, ga.data() + 1, b.data() + 1, gb.data() + 1,
+                         frames, ch, PcmSimd::Scalar);
+            for (size_t i = 0; i < n; ++i) {
+                const float v = (float)a[i + 1] * ga[i / ch + 1] + (float)b[i + 1] * gb[i / ch + 1];
+                const int16_t want = (int16_t)std::lrintf(std::clamp(v, -32768.0f, 32767.0f));
+                if (ref[i + 1] != want) {
+                    CHECK(false, "mix2 scalar ch=%u frames=%zu i=%zu: %d, ждали %d", ch, frames, i, ref[i + 1], want);
+                    break;
+                }
+            }
+            for (int lv = (int)PcmSimd::Sse2; lv <= (int)top; ++lv) {
+                pcm_mix2_s16(out.data() + 1, a.data() + 1, ga.data() + 1, b.data() + 1, gb.data() + 1,
+                             frames, ch, (PcmSimd)lv);
+                CHECK(std::memcmp(out.data() + 1, ref.data() + 1, n * sizeof(int16_t)) == 0,
+                      "mix2 %s ch=%u frames=%zu", pcm_simd_name((PcmSimd)lv), ch, frames);
+            }
+            // на месте: dst == a
+            std::vector<int16_t> inPlace(a);
+            pcm_mix2_s16(inPlace.data() + 1, inPlace.data() + 1, ga.data() + 1, b.data() + 1, gb.data() + 1,
+                         frames, ch, top);
+            CHECK(std::memcmp(inPlace.data() + 1, ref.data() + 1, n * sizeof(int16_t)) == 0,
+                  "mix2 in-place %s ch=%u frames=%zu", pcm_simd_name(top), ch, frames);
+        }
+    }
+}
+
+int main()
+{
+    std::printf("pcm_convert_test: simd=%s\n", pcm_simd_name(pcm_simd_level()));
+    test_selftest();
+    test_convert_edges();
+    test_f32_clipping();
+    test_mix_edges();
+    if (g_fail) {
+        std::printf("pcm_convert_test: %d FAIL\n", g_fail);
+        return 1;
+    }
+    std::printf("pcm_convert_test: ok\n");
+    return 0;
+}